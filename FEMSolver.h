@@ -2,35 +2,41 @@
 
 #include "globalincludes.h"
 #include "mesh/TetraMesh.h"
+#include "mesh/SurfaceMesh.h"
+#include "mesh/RenderMesh.h"
+#include "mesh/Islands.h"
+#include "mesh/MeshQuality.h"
+#include "mesh/GraphColoring.h"
 #include "mesh/Tetrahedron.h"
 #include "integrator/ForwardEuler.h"
 //#include "scene/squareplane.h"
 //#include "scene/sphere.h"
 #include "scene/scene.h"
-#include "scene/defaultScene.h"
-#include "scene/plinkoScene.h"
-#include "scene/constrainedTop.h"
-#include "scene/bulldozeScene.h"
+#include "scene/sceneFactory.h"
 #include "integrator/BackwardEuler.h"
+#include "integrator/ModalReduction.h"
+#include "integrator/Multirate.h"
+#include "integrator/SubspaceDynamics.h"
+#include "integrator/ProjectiveDynamics.h"
+#include "integrator/SymplecticEuler.h"
+#include "integrator/XPBD.h"
+#include "utility/BlockGaussSeidel.h"
+#include "utility/Checkpoint.h"
+#include "utility/PrecomputeCache.h"
+#include "utility/FileHelper.h"
+#include "utility/FrameStream.h"
+#include "utility/Multigrid.h"
+#include "utility/Profiler.h"
+#include "utility/SimConfig.h"
+#include "utility/TaskGraph.h"
+#include <future>
+#include <iomanip>
+#include <sstream>
+#include <Eigen/Geometry>
 #include <Eigen/IterativeLinearSolvers>
 #include <unsupported/Eigen/IterativeSolvers>
-
-#define USE_EXPLICIT
-//#define USE_IMPLICIT
-
-// values are for rubber;
-template<class T, int dim>
-double TetraMesh<T,dim>::k = 500000.f;
-template<class T, int dim>
-double TetraMesh<T,dim>::nu = 0.3f;
-
-#ifdef USE_EXPLICIT
-const double cTimeStep = 1e-5;
-const int stepsPerFrame = 600;
-#endif
-#ifdef USE_IMPLICIT
-const double cTimeStep = 0.01;
-const int stepsPerFrame = 10;
+#ifdef _OPENMP
+#include <omp.h>
 #endif
 
 const double gravity = 9.8f;
@@ -43,7 +49,7 @@ inline double epsilonCheck(double n) {
     return n;
 }
 
-inline double epsilonCheckSquareMatrix(Eigen::Matrix<T,dim,dim> &matrix) {
+inline void epsilonCheckSquareMatrix(Eigen::Matrix<T,dim,dim> &matrix) {
     // epsilon check
     for (int i = 0; i < dim; ++i) {
         for (int j = 0; j < dim; ++j) {
@@ -56,12 +62,49 @@ template<class T, int dim>
 class FEMSolver {
 private:
 
+    SimConfig mConfig;
     TetraMesh<T,dim> mTetraMesh;
+    Scene<T,dim>* mScene;
     int mSteps;
+    int mStartFrame;                // last completed frame, nonzero after a resume
+    bool mPrecomputed;              // tetrahedra and masses already precomputed
+    double mTimeStep;
+    int mStepsPerFrame;
+    Profiler mProfiler;
+    FrameStreamWriter<T,dim> mFrameStream;      // open when output.format is stream
+    SurfaceMesh<T,dim> mSurface;                // extracted when output.format is surface
+    RenderMesh<T,dim> mRenderMesh;              // bound when render.path is set
+    Islands<T,dim> mIslands;                    // sleep state, used when sleep.enabled
+    TaskGraph mTaskGraph;                       // tetrahedron chunks, then particle chunks, for solver.scheduler tasks
+    int mTetChunks;
+    std::vector<Eigen::Matrix<T,dim,1>> mCornerForces;     // dim + 1 per tetrahedron, gathered per particle
+    Multirate<T,dim> mMultirate;                // time levels of the tetrahedra for solver.integrator multirate
+    TetraMesh<T,dim> mOutputMesh;               // particle snapshot written by mPendingOutput
+    struct ElementDeformation {
+        Eigen::Matrix<T,dim,dim> F, R, S, JFinvT;
+    };
+    std::vector<ElementDeformation> mDeformations;     // per tetrahedron from the force pass, for the implicit stiffness
+    std::vector<Eigen::Quaternion<T>> mRotationCache;  // last rotation per tetrahedron when solver.rotation is warm_start
+    bool mCorotatedLinear;                      // material.model is corotated_linear
+    // rest stiffness K0 per tetrahedron for the corotated linear implicit step, the blocks
+    // (a, b) with a <= b < dim; corner dim's blocks follow from translation invariance
+    std::vector<Eigen::Matrix<T,dim,dim>> mRestStiffness;
+    BlockGaussSeidel<T,dim> mSystem;            // M / dt^2 - K when solver.linear_solver is gauss_seidel or multigrid
+    GraphColoring<T,dim> mTetColoring;          // tetrahedra assembling into mSystem in parallel
+    MultigridHierarchy<T,dim> mHierarchy;       // embedding grids preconditioning CG when solver.linear_solver is multigrid
+    ProjectiveDynamics<T,dim> mProjective;      // prefactored global system for solver.integrator projective
+    std::vector<Eigen::Matrix<T,dim,dim>> mRotations;      // local step result per tetrahedron
+    std::vector<Eigen::Matrix<T,dim,1>> mInertial;         // x + dt v + dt^2 g per particle
+    std::vector<Eigen::Matrix<T,dim,1>> mStepStart;        // positions at the start of a projective or xpbd step
+    XPBD<T,dim> mXPBD;                          // colored constraint projection for solver.integrator xpbd
+    ModalReduction<T,dim> mModal;               // rest shape modes and reduced state for solver.integrator modal
+    SubspaceDynamics<T,dim> mSubspace;          // trained basis and cubature for solver.integrator subspace
+    std::future<void> mPendingOutput;
     double mu;
     double lambda;
     ForwardEuler<T, dim> mExplicitIntegrator;
     BackwardEuler<T, dim> mImplicitIntegrator;
+    SymplecticEuler<T, dim> mSymplecticIntegrator;
 
     void calculateMaterialConstants();    // calculates mu and lambda values for material
     void precomputeTetraConstants();      // precompute tetrahedron constant values
@@ -74,13 +117,52 @@ private:
     void computeRS(Eigen::Matrix<T,dim,dim>& R,
                     Eigen::Matrix<T,dim,dim>& S,
                     const Eigen::Matrix<T,dim,dim>& F); // computes R and S matrices from F using SVD
+    // R and S of tetrahedron n: with a rotation cache, a few polar iterations from its
+    // last rotation and the SVD only for inverted, flat or unconverged elements, else computeRS
+    void computeRotation(Eigen::Matrix<T,dim,dim>& R,
+                    Eigen::Matrix<T,dim,dim>& S,
+                    const Eigen::Matrix<T,dim,dim>& F, int n);
+    // rotation maximizing tr(R^T F) by Newton iterations from q,
+    // false if it has not converged within solver.rotation_iterations
+    bool warmStartRotation(Eigen::Quaternion<T>& q, Eigen::Matrix<T,dim,dim>& R,
+                    const Eigen::Matrix<T,dim,dim>& F);
     void computeJFinvT(Eigen::Matrix<T,dim,dim>& JFinvT,
                     const Eigen::Matrix<T,dim,dim>& F); // computes det(F) * (F^-1)^T
-    void computeK(Eigen::MatrixXf& KMatrix,
+    void computeElementForce(Eigen::Matrix<T,dim,dim>& G,
+                    Eigen::Matrix<T,dim,dim>& F,
+                    Eigen::Matrix<T,dim,dim>& R,
+                    Eigen::Matrix<T,dim,dim>& S,
+                    Eigen::Matrix<T,dim,dim>& JFinvT,
+                    const Tetrahedron<T,dim>& t, int n);    // force matrix G of tetrahedron n, column j is the force on vertex j
+    void computeElementForce(Eigen::Matrix<T,dim,dim>& G,
+                    Eigen::Matrix<T,dim,dim>& F,
+                    Eigen::Matrix<T,dim,dim>& R,
+                    Eigen::Matrix<T,dim,dim>& S,
+                    Eigen::Matrix<T,dim,dim>& JFinvT,
+                    const Eigen::Matrix<T,dim,dim>& Ds,
+                    const Tetrahedron<T,dim>& t, int n);    // the same for a given deformed edge matrix Ds
+    // G of tetrahedron n with its corners at x[0..dim], thread safe and without the rotation cache,
+    // and unless K is null its warped stiffness R K0 R^T
+    void computeElementForceAt(Eigen::Matrix<T,dim,dim>& G, const Eigen::Matrix<T,dim,1>* x, int n,
+                    Eigen::Matrix<T,Eigen::Dynamic,Eigen::Dynamic>* K);
+    // adds the Rayleigh stiffness damping -damping.stiffness R K0 R^T v of the corners' velocities to G,
+    // with R the rotation G was computed with
+    void addElementDamping(Eigen::Matrix<T,dim,dim>& G, const Eigen::Matrix<T,dim,dim>& R,
+                    const Tetrahedron<T,dim>& t);
+    void computeK(Eigen::MatrixXf& KMatrix);          // dense K from every element's deformation
+    void precomputeRestStiffness();                     // K0 of every tetrahedron at F = I
+    void restStiffnessBlock(Eigen::Matrix<T,dim,dim>& K0,
+                    int n, int a, int b);               // dforce_a / dx_b of tetrahedron n at rest, any corners
+    void computeWarpedK(Eigen::MatrixXf& K, int n,
+                    const Eigen::Matrix<T,dim,dim>& R); // R K0 R^T, the corotated linear element stiffness
+    void assembleSystem();                              // mSystem = M / dt^2 - K, plus Rayleigh damping / dt
+    void assembleRestStiffness(Eigen::SparseMatrix<T>& K);     // -K0 of the whole mesh, positive semidefinite
+    void computeElementK(Eigen::MatrixXf& K,
+                    const Tetrahedron<T,dim>& t,
                     const Eigen::Matrix<T,dim,dim>& F,
                     const Eigen::Matrix<T,dim,dim>& JFinvT,
                     const Eigen::Matrix<T,dim,dim>& R,
-                    const Eigen::Matrix<T,dim,dim>& S);
+                    const Eigen::Matrix<T,dim,dim>& S);    // 4*dim x 4*dim element stiffness
     void distributeMass();          // distributes tetrahedron mass to its constituent particles
 
     // helper functions for computeK
@@ -101,67 +183,877 @@ private:
                 const Eigen::Matrix<T,dim,dim>& S);
     double leviCevita(int i, int j, int k);
 
+    void writeCheckpoint(int frame);
+    void writeFrame(int frame, TetraMesh<T,dim>& mesh);    // particle output, colliders are written separately
+    void waitForOutput();
+
+    void buildTaskGraph();
+    // forces and, for the explicit integrator, integration of one substep as a task graph
+    void stepTasks(bool sleeping, bool integrate);
+    // forward Euler and collision response of particle j under the elastic force,
+    // against the colliders advanced by colliderTime
+    void integrateParticle(int j, const Eigen::Matrix<T,dim,1>& force, T colliderTime);
+    // one Projective Dynamics step: solver.projective_iterations local and global steps,
+    // then velocities and collision response as in integrateParticle
+    void stepProjective();
+    // one multirate step of mTimeStep: after every fine substep the particles of the levels due are
+    // advanced by semi-implicit Euler under the tetrahedra around them, then the colliders' moves
+    void stepMultirate();
+    // one XPBD substep: prediction, solver.xpbd_iterations colored sweeps, velocities and collisions
+    void stepXPBD();
+    // velocities from the displacement since mStepStart and collision response of a
+    // position based step, then the colliders' moves
+    void finishPositionStep();
+    // mModal's basis from modal.basis if it is current, else from the rest stiffness, written back
+    bool prepareModalBasis();
+    // one reduced step: oscillators and center of mass, then finishReducedStep
+    void stepModal();
+    // the subspace for solver.integrator subspace from subspace.basis, false if it is missing or stale
+    bool loadSubspace();
+    uint64_t subspaceKey() const;
+    // one reduced step: linearly implicit cubature step and center of mass, then finishReducedStep
+    void stepSubspace();
+    // particles from the reduced state, reduced response to their collisions, then the colliders' moves
+    void finishReducedStep(ReducedBody<T,dim>& body);
+    // the files and parameters the mesh is built from, the key of cached data derived from it
+    void meshSource(std::vector<std::string>& files, std::string& parameters) const;
+    // quality.report and the quality.mass_scale_step repair of the precomputed mesh
+    void analyzeMesh();
+    // the repair's part of the keys of data derived from the masses, empty without it
+    std::string massScaleKey() const;
+
+    friend struct FEMBenchmarkAccess;     // exposes the kernels to bench/FEMBenchmarks.cpp
 
 public:
-    FEMSolver(int steps);
+    FEMSolver(const SimConfig& config);
+    // runs on a copy of an already precomputed mesh, sharing its tetrahedra
+    FEMSolver(const SimConfig& config, const TetraMesh<T,dim>& precomputedMesh);
     ~FEMSolver();
 
     void initializeMesh();
+    void precomputeMesh();          // adjacency, Dm, tetrahedron constants and mass, independent of material and timestep
     void cookMyJello();
+
+    const TetraMesh<T,dim>& mesh() const;
+
+    bool resumeFromCheckpoint(const std::string& path);    // replaces initializeMesh
+
+    // subspace basis and cubature from the particle positions of a full run's checkpoints,
+    // written to subspace.basis; the initialized mesh is the rest shape
+    bool trainSubspace(const std::vector<std::string>& checkpoints);
 };
 
 template<class T, int dim>
-FEMSolver<T,dim>::FEMSolver(int steps) : mTetraMesh(TetraMesh<T,dim>("objects/cube.1")), mSteps(steps), mu(0.0f), lambda(0.0f), mExplicitIntegrator("explicit"), mImplicitIntegrator("implicit") {
+FEMSolver<T,dim>::FEMSolver(const SimConfig& config) : mConfig(config), mTetraMesh(TetraMesh<T,dim>(config.meshPath)), mScene(nullptr), mSteps(config.frames), mStartFrame(0), mPrecomputed(false), mTimeStep(config.timeStep), mStepsPerFrame(config.stepsPerFrame), mTetChunks(0), mOutputMesh(TetraMesh<T,dim>(config.meshPath)), mCorotatedLinear(config.materialModel == "corotated_linear"), mu(0.0f), lambda(0.0f), mExplicitIntegrator("explicit"), mImplicitIntegrator("implicit"), mSymplecticIntegrator("symplectic") {
+
+    // default, plinko, bulldoze or constrained, see scene/sceneFactory.h
+    mScene = createScene<T, dim>(config.scene);
+    if(mScene == nullptr){
+        exit(1);
+    }
+
+#ifdef _OPENMP
+    if(config.threads > 0){
+        omp_set_num_threads(config.threads);
+    }
+#endif
+    if(config.profile){
+        mProfiler.enable(!config.profileTrace.empty());
+    }
+}
+
+template<class T, int dim>
+FEMSolver<T,dim>::FEMSolver(const SimConfig& config, const TetraMesh<T,dim>& precomputedMesh) : FEMSolver(config) {
+    mTetraMesh = precomputedMesh;
+    mPrecomputed = true;
 }
 
 template<class T, int dim>
 FEMSolver<T,dim>::~FEMSolver(){
+    waitForOutput();
+    delete mScene;
 }
 
 template<class T, int dim>
 void FEMSolver<T,dim>::initializeMesh() {
-    mTetraMesh.generateTetras();
+    // a cached mesh carries its precomputed constants, a miss precomputes and fills the cache
+    std::string cachePath = "";
+    uint64_t cacheKey = 0;
+    if(!mConfig.meshCacheDir.empty()){
+        std::vector<std::string> files;
+        std::string parameters;
+        meshSource(files, parameters);
+        cacheKey = PrecomputeCache<T,dim>::key(files, parameters);
+        if(cacheKey != 0 && FileHelper::makeDirectory(mConfig.meshCacheDir)){
+            cachePath = PrecomputeCache<T,dim>::path(mConfig.meshCacheDir, cacheKey);
+            if(PrecomputeCache<T,dim>::read(cachePath, cacheKey, mTetraMesh)){
+                mPrecomputed = true;
+                std::cout << "loaded precomputed mesh " << cachePath << std::endl;
+                return;
+            }
+        }
+    }
+
+    if(mConfig.meshGenerator == "box"){
+        const Eigen::Vector3i cells(mConfig.boxCells[0], mConfig.boxCells[1], mConfig.boxCells[2]);
+        Eigen::Matrix<T,dim,1> minCorner, maxCorner;
+        for(int i = 0; i < dim; ++i){
+            minCorner[i] = mConfig.boxMin[i];
+            maxCorner[i] = mConfig.boxMax[i];
+        }
+        mTetraMesh.generateBox(cells, minCorner, maxCorner, mConfig.boxSplit, T(mConfig.boxJitter), mConfig.boxSeed);
+    }
+    else{
+        mTetraMesh.generateTetras();
+    }
+
+    if(!cachePath.empty()){
+        precomputeMesh();
+        PrecomputeCache<T,dim>::write(cachePath, cacheKey, mTetraMesh);
+    }
 }
 
 template<class T, int dim>
-void FEMSolver<T,dim>::cookMyJello() {
-
-    // Create a basic ground plane
-    DefaultScene<T, dim> scene = DefaultScene<T, dim>();
+void FEMSolver<T,dim>::meshSource(std::vector<std::string>& files, std::string& parameters) const {
+    parameters = mConfig.meshGenerator;
+    if(mConfig.meshGenerator == "box"){
+        for(int i = 0; i < 3; ++i){
+            parameters += " " + std::to_string(mConfig.boxCells[i]) + " " + std::to_string(mConfig.boxMin[i])
+                          + " " + std::to_string(mConfig.boxMax[i]);
+        }
+        parameters += " " + std::to_string(mConfig.boxSplit) + " " + std::to_string(mConfig.boxJitter)
+                      + " " + std::to_string(mConfig.boxSeed);
+    }
+    else{
+        files.push_back(mConfig.meshPath + ".node");
+        files.push_back(mConfig.meshPath + ".ele");
+    }
+}
 
-    // Create plinko scene
-    //PlinkoScene<T, dim> scene = PlinkoScene<T, dim>();
+template<class T, int dim>
+void FEMSolver<T,dim>::analyzeMesh() {
+    if(!mConfig.qualityReport && mConfig.qualityMassScaleStep <= 0){
+        return;
+    }
+    MeshQuality<T,dim> quality;
+    quality.analyze(mTetraMesh, T(mu), T(lambda), T(mConfig.qualityCourant));
+    if(mConfig.qualityReport){
+        quality.report();
+    }
+    // a resumed run already carries the scaled masses and has nothing below the step
+    const T target = mConfig.qualityMassScaleStep;
+    if(target > 0 && quality.stableStep() < target){
+        const T before = quality.stableStep();
+        const T added = quality.addedMass(target);
+        const int scaled = quality.massScale(mTetraMesh, target);
+        quality.analyze(mTetraMesh, T(mu), T(lambda), T(mConfig.qualityCourant));
+        std::cout << "mass scaled " << scaled << " tetrahedra, " << 100 * added << "% more mass, stable step "
+                  << before << " -> " << quality.stableStep() << " s (" << quality.stableStep() / before
+                  << "x)" << std::endl;
+    }
+}
 
-    // Create a sphere collision scene
-    //BulldozeScene<T, dim> scene = BulldozeScene<T, dim>();
+template<class T, int dim>
+std::string FEMSolver<T,dim>::massScaleKey() const {
+    if(mConfig.qualityMassScaleStep <= 0){
+        return "";
+    }
+    // to_string keeps six decimals, which cannot tell apart steps of a few 1e-5 s
+    std::ostringstream key;
+    key << " mass_scale " << std::setprecision(17) << mConfig.qualityMassScaleStep;
+    return key.str();
+}
 
-    // calculate deformation constants
-    calculateMaterialConstants();
-    std::cout << mu << std::endl;
-    std::cout << lambda << std::endl;
+template<class T, int dim>
+void FEMSolver<T,dim>::precomputeMesh() {
+    // topology only, copies of the mesh share it like the tetrahedra
+    if(!mTetraMesh.mAdjacency){
+        mTetraMesh.buildAdjacency();
+    }
+    // a fresh mesh is at rest, a resumed one brings its rest positions from the checkpoint
+    if(!mTetraMesh.mRest){
+        mTetraMesh.mRest = std::make_shared<const std::vector<Eigen::Matrix<T,dim,1>>>(mTetraMesh.mParticles.positions);
+    }
+    if(mPrecomputed){
+        return;
+    }
     // precompute Dm matrices
     computeDm();
     // precompute tetrahedron constant values
     precomputeTetraConstants();
     // distribute mass to tetrahedra particles
     distributeMass();
+    mPrecomputed = true;
+}
+
+template<class T, int dim>
+const TetraMesh<T,dim>& FEMSolver<T,dim>::mesh() const {
+    return mTetraMesh;
+}
+
+template<class T, int dim>
+bool FEMSolver<T,dim>::resumeFromCheckpoint(const std::string& path) {
+    if(!Checkpoint<T,dim>::read(path, mStartFrame, mTetraMesh, *mScene)){
+        return false;
+    }
+    mPrecomputed = true;
+    std::cout << "resuming from frame " << mStartFrame << std::endl;
+    return true;
+}
+
+template<class T, int dim>
+void FEMSolver<T,dim>::writeCheckpoint(int frame) {
+    PROFILE_SCOPE(mProfiler, PROFILE_CHECKPOINT);
+    if(!FileHelper::makeDirectory(mConfig.checkpointDir)){
+        return;
+    }
+    std::string f = std::to_string(frame);
+    std::string checkpointFile = "checkpoint" + std::string(f.length() < 4 ? 4 - f.length() : 0, '0') + f + ".bin";
+    Checkpoint<T,dim>::write(mConfig.checkpointDir + "/" + checkpointFile, frame, mTetraMesh, *mScene);
+}
+
+template<class T, int dim>
+void FEMSolver<T,dim>::writeFrame(int frame, TetraMesh<T,dim>& mesh) {
+    PROFILE_SCOPE(mProfiler, PROFILE_OUTPUT);
+    if(mFrameStream.isOpen()){
+        mFrameStream.write(frame, mesh.mParticles);
+    }
+    else if(mConfig.outputFormat == "surface"){
+        mSurface.update(mesh.mParticles);
+        mSurface.outputFrame(frame, mConfig.outputDir);
+    }
+    else if(mConfig.outputFormat == "bgeo"){
+        mesh.outputFrame(frame, mConfig.outputDir);
+    }
+    // the render mesh is written in addition to the selected format
+    if(mRenderMesh.numVertices() > 0){
+        mRenderMesh.update(mesh.mParticles);
+        mRenderMesh.outputFrame(frame, mConfig.outputDir);
+    }
+}
+
+template<class T, int dim>
+void FEMSolver<T,dim>::waitForOutput() {
+    if(mPendingOutput.valid()){
+        mPendingOutput.get();
+    }
+}
+
+template<class T, int dim>
+void FEMSolver<T,dim>::buildTaskGraph() {
+    const std::vector<Tetrahedron<T,dim>>& tetras = *mTetraMesh.mTetras;
+    const int numTets = tetras.size();
+    const int numParticles = mTetraMesh.mParticles.positions.size();
+    const int chunk = mConfig.taskChunk;
+
+    mCornerForces.resize((dim + 1) * numTets);
+
+    // a particle chunk waits for every tetrahedron chunk scattering into it
+    mTaskGraph.clear();
+    mTetChunks = (numTets + chunk - 1) / chunk;
+    const int particleChunks = (numParticles + chunk - 1) / chunk;
+    for(int c = 0; c < mTetChunks + particleChunks; ++c){
+        mTaskGraph.addNode();
+    }
+    for(int n = 0; n < numTets; ++n){
+        for(int k = 0; k < dim + 1; ++k){
+            mTaskGraph.addEdge(n / chunk, mTetChunks + tetras[n].mPIndices[k] / chunk);
+        }
+    }
+    mTaskGraph.finalize();
+}
+
+template<class T, int dim>
+void FEMSolver<T,dim>::stepTasks(bool sleeping, bool integrate) {
+    const std::vector<Tetrahedron<T,dim>>& tetras = *mTetraMesh.mTetras;
+    Particles<T,dim>& particles = mTetraMesh.mParticles;
+    const int numTets = tetras.size();
+    const int numParticles = particles.positions.size();
+    const int chunk = mConfig.taskChunk;
+    const TetAdjacency<T,dim>& adjacency = *mTetraMesh.mAdjacency;
+
+    mTaskGraph.execute([&](int node){
+        if(node < mTetChunks){
+            PROFILE_SCOPE(mProfiler, PROFILE_FORCES);
+            Eigen::Matrix<T,dim,dim> G, F, R, S, JFinvT;
+            for(int n = node * chunk; n < std::min(numTets, (node + 1) * chunk); ++n){
+                if(sleeping && !mIslands.tetAwake(n)){
+                    continue;
+                }
+                computeElementForce(G, F, R, S, JFinvT, tetras[n], n);
+                if(!integrate){
+                    mDeformations[n] = {F, R, S, JFinvT};
+                }
+                else if(mConfig.dampingStiffness > 0){
+                    addElementDamping(G, R, tetras[n]);
+                }
+                Eigen::Matrix<T,dim,1>* corners = &mCornerForces[(dim + 1) * n];
+                for(int j = 0; j < dim; ++j){
+                    corners[j] = G.col(j);
+                }
+                corners[dim] = -1.f * (G.col(0) + G.col(1) + G.col(2));
+            }
+        }
+        else{
+            PROFILE_SCOPE(mProfiler, PROFILE_INTEGRATE);
+            const int first = (node - mTetChunks) * chunk;
+            for(int j = first; j < std::min(numParticles, first + chunk); ++j){
+                // forces are summed in a register and stored once, no zeroing pass;
+                // same summation order as scattering tetrahedra in sequence
+                Eigen::Matrix<T,dim,1> force = Eigen::Matrix<T,dim,1>::Zero();
+                if(!sleeping || mIslands.particleAwake(j)){
+                    for(int k = adjacency.vertexTetStart[j]; k < adjacency.vertexTetStart[j + 1]; ++k){
+                        force += mCornerForces[adjacency.vertexTets[k]];
+                    }
+                    // particle j sees the colliders after j + 1 moves, as in the serial loop
+                    if(integrate){
+                        integrateParticle(j, force, T((j + 1) * mTimeStep));
+                    }
+                }
+                particles.forces[j] = force;
+            }
+        }
+    });
+
+    // colliders advance once per particle, hoisted out of the parallel integration
+    for(int j = 0; j < numParticles && integrate; ++j){
+        mScene->updatePosition(mTimeStep);
+    }
+}
+
+template<class T, int dim>
+void FEMSolver<T,dim>::integrateParticle(int j, const Eigen::Matrix<T,dim,1>& force, T colliderTime) {
+    Particles<T,dim>& particles = mTetraMesh.mParticles;
+    Eigen::Matrix<T, dim, 1> temp_pos = Eigen::Matrix<T,dim,1>::Zero(dim);
+
+    const T mass = particles.masses[j];
+    Eigen::Matrix<T, dim, 1> totalForce = force;
+    totalForce[1] += -gravity * mass;
+    if(mConfig.dampingMass > 0){
+        totalForce -= T(mConfig.dampingMass) * mass * particles.velocities[j];
+    }
+    Eigen::Matrix<T, dim, 1> position = particles.positions[j];
+    Eigen::Matrix<T, dim, 1> velocity = particles.velocities[j];
+    mExplicitIntegrator.integrate(mTimeStep, mass, totalForce, position, velocity);
+
+    //<<<<<< FOR SCENE COLLISIONS TYPE 1
+    // if(scene.checkCollisions(position, temp_pos)){
+    //     velocity = (temp_pos - particles.positions[j]) / mTimeStep;
+    //     position = temp_pos;
+    // }
+    //<<<<<< FOR SCENE COLLISIONS TYPE 2
+    bool collided = false;
+    {
+        PROFILE_SCOPE(mProfiler, PROFILE_COLLISION);
+        collided = mScene->checkCollisions(position, temp_pos, colliderTime);
+    }
+    if(collided){
+        // the particle stays where it was
+        particles.velocities[j].setZero();
+        return;
+    }
+
+    // <<<<<< FOR HANGING TESTS
+    // if(particles.positions[j][0] <= 0.001){
+    //     return;
+    // }
+
+    particles.positions[j] = position;
+    particles.velocities[j] = velocity;
+}
+
+template<class T, int dim>
+void FEMSolver<T,dim>::stepProjective() {
+    const std::vector<Tetrahedron<T,dim>>& tetras = *mTetraMesh.mTetras;
+    Particles<T,dim>& particles = mTetraMesh.mParticles;
+    const int numTets = tetras.size();
+    const int numParticles = particles.positions.size();
+    const T dt = mTimeStep;
+
+    // the iteration starts from the free flight position
+    #pragma omp parallel for
+    for(int j = 0; j < numParticles; ++j){
+        mStepStart[j] = particles.positions[j];
+        mInertial[j] = particles.positions[j] + dt * particles.velocities[j];
+        mInertial[j][1] += -gravity * dt * dt;
+        particles.positions[j] = mInertial[j];
+    }
+
+    for(int iteration = 0; iteration < mConfig.projectiveIterations; ++iteration){
+        {
+            PROFILE_SCOPE(mProfiler, PROFILE_FORCES);
+            #pragma omp parallel
+            {
+                Eigen::Matrix<T,dim,dim> Ds, F, S;
+                #pragma omp for
+                for(int n = 0; n < numTets; ++n){
+                    computeDs(Ds, tetras[n]);
+                    computeF(F, Ds, tetras[n]);
+                    computeRotation(mRotations[n], S, F, n);
+                }
+            }
+        }
+        PROFILE_SCOPE(mProfiler, PROFILE_SOLVE);
+        mProjective.globalStep(mTetraMesh, mInertial, mRotations, particles.positions);
+    }
+
+    finishPositionStep();
+}
+
+template<class T, int dim>
+void FEMSolver<T,dim>::stepMultirate() {
+    const std::vector<Tetrahedron<T,dim>>& tetras = *mTetraMesh.mTetras;
+    Particles<T,dim>& particles = mTetraMesh.mParticles;
+    const int numParticles = particles.positions.size();
+    const TetAdjacency<T,dim>& adjacency = *mTetraMesh.mAdjacency;
+    const std::vector<int>& order = mMultirate.particles();
+    const std::vector<int>& tets = mMultirate.tets();
+    const int finest = mMultirate.numLevels() - 1;
+    const T fine = mMultirate.levelTimeStep(finest);
+
+    for(int k = 1; k <= mMultirate.substeps(); ++k){
+        const int active = mMultirate.activeLevel(k);
+        {
+            PROFILE_SCOPE(mProfiler, PROFILE_FORCES);
+            #pragma omp parallel for schedule(dynamic, 64)
+            for(int e = 0; e < mMultirate.numTets(active); ++e){
+                const int n = tets[e];
+                const Tetrahedron<T,dim>& t = tetras[n];
+                // corners on coarser levels were last updated up to a few substeps ago,
+                // they are predicted along their velocity to the start of this one
+                Eigen::Matrix<T,dim,1> x[dim + 1];
+                for(int c = 0; c < dim + 1; ++c){
+                    const int j = t.mPIndices[c];
+                    const int stride = 1 << (finest - mMultirate.particleLevel(j));
+                    x[c] = particles.positions[j] + T((k - 1) % stride) * fine * particles.velocities[j];
+                }
+                Eigen::Matrix<T,dim,dim> Ds, G, F, R, S, JFinvT;
+                for(int c = 0; c < dim; ++c){
+                    Ds.col(c) = x[c] - x[dim];
+                }
+                computeElementForce(G, F, R, S, JFinvT, Ds, t, n);
+                if(mConfig.dampingStiffness > 0){
+                    addElementDamping(G, R, t);
+                }
+                Eigen::Matrix<T,dim,1>* corners = &mCornerForces[(dim + 1) * n];
+                for(int c = 0; c < dim; ++c){
+                    corners[c] = G.col(c);
+                }
+                corners[dim] = -1.f * (G.col(0) + G.col(1) + G.col(2));
+            }
+        }
+        PROFILE_SCOPE(mProfiler, PROFILE_INTEGRATE);
+        // every tetrahedron around an updated particle was evaluated above
+        #pragma omp parallel for schedule(dynamic, 64)
+        for(int p = 0; p < mMultirate.numParticles(active); ++p){
+            const int j = order[p];
+            Eigen::Matrix<T,dim,1> force = Eigen::Matrix<T,dim,1>::Zero();
+            for(int a = adjacency.vertexTetStart[j]; a < adjacency.vertexTetStart[j + 1]; ++a){
+                force += mCornerForces[adjacency.vertexTets[a]];
+            }
+            particles.forces[j] = force;
+
+            const T mass = particles.masses[j];
+            force[1] += -gravity * mass;
+            if(mConfig.dampingMass > 0){
+                force -= T(mConfig.dampingMass) * mass * particles.velocities[j];
+            }
+            Eigen::Matrix<T,dim,1> position = particles.positions[j];
+            Eigen::Matrix<T,dim,1> velocity = particles.velocities[j];
+            mSymplecticIntegrator.integrate(mMultirate.levelTimeStep(mMultirate.particleLevel(j)), mass, force,
+                                            position, velocity);
+            Eigen::Matrix<T,dim,1> temp_pos;
+            bool collided = false;
+            {
+                PROFILE_SCOPE(mProfiler, PROFILE_COLLISION);
+                // particle j sees the colliders after j + 1 moves, as in the explicit loop
+                collided = mScene->checkCollisions(position, temp_pos, T((j + 1) * mTimeStep));
+            }
+            if(collided){
+                // the particle stays where it was
+                particles.velocities[j].setZero();
+                continue;
+            }
+            particles.positions[j] = position;
+            particles.velocities[j] = velocity;
+        }
+    }
+
+    // colliders advance once per particle and step, hoisted out of the parallel integration
+    for(int j = 0; j < numParticles; ++j){
+        mScene->updatePosition(mTimeStep);
+    }
+}
+
+template<class T, int dim>
+void FEMSolver<T,dim>::stepXPBD() {
+    Particles<T,dim>& particles = mTetraMesh.mParticles;
+    const int numParticles = particles.positions.size();
+    const T dt = mTimeStep;
+
+    #pragma omp parallel for
+    for(int j = 0; j < numParticles; ++j){
+        mStepStart[j] = particles.positions[j];
+        particles.velocities[j][1] += -gravity * dt;
+        particles.positions[j] += dt * particles.velocities[j];
+    }
+    {
+        PROFILE_SCOPE(mProfiler, PROFILE_SOLVE);
+        mXPBD.project(mTetraMesh, particles.positions, dt, mConfig.xpbdIterations);
+    }
+    finishPositionStep();
+}
+
+template<class T, int dim>
+void FEMSolver<T,dim>::finishPositionStep() {
+    Particles<T,dim>& particles = mTetraMesh.mParticles;
+    const int numParticles = particles.positions.size();
+    const T dt = mTimeStep;
+    {
+        PROFILE_SCOPE(mProfiler, PROFILE_INTEGRATE);
+        #pragma omp parallel for
+        for(int j = 0; j < numParticles; ++j){
+            Eigen::Matrix<T,dim,1> temp_pos;
+            bool collided = false;
+            {
+                PROFILE_SCOPE(mProfiler, PROFILE_COLLISION);
+                // particle j sees the colliders after j + 1 moves, as in the explicit loop
+                collided = mScene->checkCollisions(particles.positions[j], temp_pos, T((j + 1) * dt));
+            }
+            if(collided){
+                particles.positions[j] = mStepStart[j];
+                particles.velocities[j].setZero();
+            }
+            else{
+                particles.velocities[j] = (particles.positions[j] - mStepStart[j]) / dt;
+            }
+        }
+    }
+    for(int j = 0; j < numParticles; ++j){
+        mScene->updatePosition(mTimeStep);
+    }
+}
+
+template<class T, int dim>
+bool FEMSolver<T,dim>::prepareModalBasis() {
+    std::vector<std::string> files;
+    std::string parameters;
+    meshSource(files, parameters);
+    parameters += " k " + std::to_string(mConfig.k) + " nu " + std::to_string(mConfig.nu)
+                  + " modes " + std::to_string(mConfig.modalModes) + massScaleKey();
+    const uint64_t key = PrecomputeCache<T,dim>::key(files, parameters);
+    const int numParticles = mTetraMesh.mParticles.positions.size();
+    if(!mConfig.modalBasis.empty() && mModal.read(mConfig.modalBasis, key, numParticles)){
+        std::cout << "loaded modal basis " << mConfig.modalBasis << std::endl;
+        return true;
+    }
+
+    Eigen::SparseMatrix<T> K;
+    {
+        PROFILE_SCOPE(mProfiler, PROFILE_ASSEMBLE);
+        precomputeRestStiffness();
+        assembleRestStiffness(K);
+        // only needed once, the reduced step never touches the tetrahedra
+        std::vector<Eigen::Matrix<T,dim,dim>>().swap(mRestStiffness);
+    }
+    {
+        PROFILE_SCOPE(mProfiler, PROFILE_SOLVE);
+        if(!mModal.compute(K, mTetraMesh.mParticles.masses, mConfig.modalModes)){
+            return false;
+        }
+    }
+    if(!mConfig.modalBasis.empty()){
+        mModal.write(mConfig.modalBasis, key);
+    }
+    return true;
+}
+
+template<class T, int dim>
+void FEMSolver<T,dim>::stepModal() {
+    Eigen::Matrix<T,dim,1> g = Eigen::Matrix<T,dim,1>::Zero();
+    g[1] = -gravity;
+    {
+        PROFILE_SCOPE(mProfiler, PROFILE_INTEGRATE);
+        mModal.advance(T(mTimeStep), g);
+    }
+    finishReducedStep(mModal.body());
+}
+
+template<class T, int dim>
+uint64_t FEMSolver<T,dim>::subspaceKey() const {
+    std::vector<std::string> files;
+    std::string parameters;
+    meshSource(files, parameters);
+    parameters += " k " + std::to_string(mConfig.k) + " nu " + std::to_string(mConfig.nu) + " model "
+                  + mConfig.materialModel + " size " + std::to_string(mConfig.subspaceSize) + " cubature "
+                  + std::to_string(mConfig.subspaceCubature) + massScaleKey();
+    return PrecomputeCache<T,dim>::key(files, parameters);
+}
+
+template<class T, int dim>
+bool FEMSolver<T,dim>::loadSubspace() {
+    if(!mSubspace.read(mConfig.subspaceBasis, subspaceKey(), mTetraMesh.mParticles.positions.size())){
+        std::cout << "error: no subspace for this mesh and material in " << mConfig.subspaceBasis
+                  << ", train one with FEMTrain" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+template<class T, int dim>
+bool FEMSolver<T,dim>::trainSubspace(const std::vector<std::string>& checkpoints) {
+    calculateMaterialConstants();
+    precomputeMesh();
+    analyzeMesh();
+    const Particles<T,dim>& particles = mTetraMesh.mParticles;
+    const int numParticles = particles.positions.size();
+
+    std::vector<std::vector<Eigen::Matrix<T,dim,1>>> snapshots;
+    for(const std::string& path : checkpoints){
+        TetraMesh<T,dim> snapshot("");
+        int frame = 0;
+        if(!Checkpoint<T,dim>::read(path, frame, snapshot, *mScene)){
+            return false;
+        }
+        if(int(snapshot.mParticles.positions.size()) != numParticles){
+            std::cout << "error: " << path << " has " << snapshot.mParticles.positions.size() << " particles, the mesh "
+                      << numParticles << std::endl;
+            return false;
+        }
+        snapshots.push_back(snapshot.mParticles.positions);
+    }
+    if(snapshots.empty()){
+        std::cout << "error: no checkpoints to train from" << std::endl;
+        return false;
+    }
+
+    const T energy = mSubspace.buildBasis(snapshots, particles.positions, particles.masses, mConfig.subspaceSize);
+    std::cout << "subspace " << mSubspace.size() << " vectors from " << snapshots.size() << " snapshots keep "
+              << 100 * energy << "% of the displacement" << std::endl;
+    const std::vector<Tetrahedron<T,dim>>& tetras = *mTetraMesh.mTetras;
+    const T error = mSubspace.buildCubature(snapshots, particles.positions, particles.masses, tetras,
+                                            mConfig.subspaceCubature,
+        [this](int n, const Eigen::Matrix<T,dim,1>* x, Eigen::Matrix<T,dim,dim>& G,
+               Eigen::Matrix<T,Eigen::Dynamic,Eigen::Dynamic>* K){ computeElementForceAt(G, x, n, K); });
+    std::cout << "cubature " << mSubspace.numCubature() << " of " << tetras.size() << " tetrahedra, "
+              << 100 * error << "% reduced force error on the training poses" << std::endl;
+    return mSubspace.write(mConfig.subspaceBasis, subspaceKey());
+}
+
+template<class T, int dim>
+void FEMSolver<T,dim>::stepSubspace() {
+    const std::vector<Tetrahedron<T,dim>>& tetras = *mTetraMesh.mTetras;
+    Eigen::Matrix<T,dim,1> g = Eigen::Matrix<T,dim,1>::Zero();
+    g[1] = -gravity;
+    {
+        PROFILE_SCOPE(mProfiler, PROFILE_FORCES);
+        mSubspace.advance(T(mTimeStep), g, tetras,
+            [this](int n, const Eigen::Matrix<T,dim,1>* x, Eigen::Matrix<T,dim,dim>& G,
+               Eigen::Matrix<T,Eigen::Dynamic,Eigen::Dynamic>* K){ computeElementForceAt(G, x, n, K); });
+    }
+    finishReducedStep(mSubspace.body());
+}
+
+template<class T, int dim>
+void FEMSolver<T,dim>::finishReducedStep(ReducedBody<T,dim>& body) {
+    Particles<T,dim>& particles = mTetraMesh.mParticles;
+    const int numParticles = particles.positions.size();
+    const T dt = mTimeStep;
+
+    {
+        PROFILE_SCOPE(mProfiler, PROFILE_INTEGRATE);
+        body.reconstruct(particles.positions, particles.velocities);
+    }
+
+    // colliding particles push back on the reduced state along the way out of the collider
+    std::vector<char> collided(numParticles, 0);
+    std::vector<Eigen::Matrix<T,dim,1>> outside(numParticles);
+    {
+        PROFILE_SCOPE(mProfiler, PROFILE_COLLISION);
+        #pragma omp parallel for
+        for(int j = 0; j < numParticles; ++j){
+            // particle j sees the colliders after j + 1 moves, as in the explicit loop
+            collided[j] = mScene->checkCollisions(particles.positions[j], outside[j], T((j + 1) * dt));
+        }
+    }
+    std::vector<int> contacts;
+    std::vector<Eigen::Matrix<T,dim,1>> normals;
+    std::vector<T> depths;
+    for(int j = 0; j < numParticles; ++j){
+        const Eigen::Matrix<T,dim,1> out = outside[j] - particles.positions[j];
+        const T depth = out.norm();
+        // a particle within the colliders' tolerance of their surface has no direction out
+        if(collided[j] && depth > 0){
+            contacts.push_back(j);
+            normals.push_back(out / depth);
+            depths.push_back(depth);
+        }
+    }
+    if(!contacts.empty()){
+        PROFILE_SCOPE(mProfiler, PROFILE_INTEGRATE);
+        body.resolveContacts(contacts, normals, depths);
+        body.reconstruct(particles.positions, particles.velocities);
+    }
+    for(int j = 0; j < numParticles; ++j){
+        mScene->updatePosition(mTimeStep);
+    }
+}
+
+template<class T, int dim>
+void FEMSolver<T,dim>::cookMyJello() {
+
+    Scene<T, dim>& scene = *mScene;
+
+    // calculate deformation constants
+    calculateMaterialConstants();
+    mConfig.print();
+    std::cout << mu << std::endl;
+    std::cout << lambda << std::endl;
+    if(!FileHelper::makeDirectory(mConfig.outputDir)){
+        return;
+    }
+    // a resumed checkpoint or shared batch mesh already carries the precomputed tetrahedra and masses
+    precomputeMesh();
+    analyzeMesh();
+    if(mConfig.outputFormat == "stream"){
+        int attributes = 0;
+        if(!FrameStream::parseAttributes(mConfig.outputAttributes, attributes)
+           || !mFrameStream.open(mConfig.outputDir + "/frames.femstream", mTetraMesh.mParticles, attributes,
+                                 mConfig.outputBits, mConfig.keyframeEvery, mStartFrame)){
+            return;
+        }
+    }
+    if(mConfig.outputFormat == "surface"){
+        mSurface.extract(mTetraMesh);
+        std::cout << "surface " << mSurface.numVertices() << " of " << mTetraMesh.mParticles.positions.size()
+                  << " particles, " << mSurface.numFaces() << " triangles" << std::endl;
+    }
+    if(!mConfig.renderPath.empty()){
+        Eigen::Matrix<T,dim,1> offset;
+        for(int i = 0; i < dim; ++i){
+            offset[i] = mConfig.renderOffset[i];
+        }
+        if(!mRenderMesh.load(mConfig.renderPath, T(mConfig.renderScale), offset)){
+            return;
+        }
+        // bound against the rest positions, which a resumed run reads from its checkpoint
+        mRenderMesh.bind(mTetraMesh);
+        std::cout << "render mesh " << mRenderMesh.numVertices() << " vertices, "
+                  << mRenderMesh.numOutside() << " outside the simulation mesh" << std::endl;
+    }
+
+    int size = mTetraMesh.mParticles.positions.size();
+    // islands at rest are skipped by the explicit integrator
+    const bool sleeping = mConfig.sleep && mConfig.integrator == "explicit";
+    if(sleeping){
+        mIslands.build(mTetraMesh);
+        std::cout << mIslands.numIslands() << " islands" << std::endl;
+    }
+    if(mConfig.useImplicit()){
+        mDeformations.resize(mTetraMesh.mTetras->size());
+        if(mConfig.linearSolver == "gauss_seidel" || mConfig.linearSolver == "multigrid"){
+            mSystem.setPattern(*mTetraMesh.mAdjacency);
+            mTetColoring.colorTets(*mTetraMesh.mTetras, *mTetraMesh.mAdjacency);
+        }
+        if(mConfig.linearSolver == "gauss_seidel"){
+            std::cout << "gauss seidel " << mSystem.numColors() << " vertex colors, " << mTetColoring.numColors()
+                      << " tetrahedron colors, " << mConfig.linearIterations << " iterations" << std::endl;
+        }
+        if(mConfig.linearSolver == "multigrid"){
+            // grids around the rest shape, the Galerkin operators follow the deformation
+            mHierarchy.build(mTetraMesh.mParticles.positions, mConfig.multigridLevels, 200);
+            std::cout << "multigrid " << mHierarchy.numLevels() << " levels,";
+            for(int l = 0; l < mHierarchy.numLevels(); ++l){
+                std::cout << " " << mHierarchy.numVertices(l);
+            }
+            std::cout << " vertices" << std::endl;
+        }
+    }
+    const bool projective = mConfig.integrator == "projective";
+    if(projective){
+        PROFILE_SCOPE(mProfiler, PROFILE_ASSEMBLE);
+        if(!mProjective.precompute(mTetraMesh, T(mu), T(mTimeStep))){
+            return;
+        }
+        mRotations.resize(mTetraMesh.mTetras->size());
+        mInertial.resize(size);
+        mStepStart.resize(size);
+        std::cout << "projective dynamics " << mProjective.nonZeros() << " nonzeros, "
+                  << mConfig.projectiveIterations << " iterations" << std::endl;
+    }
+    const bool xpbd = mConfig.integrator == "xpbd";
+    if(xpbd){
+        mXPBD.precompute(mTetraMesh, T(mu), T(lambda));
+        mStepStart.resize(size);
+        std::cout << "xpbd " << mXPBD.numColors() << " tetrahedron colors, " << mConfig.xpbdIterations
+                  << " iterations" << std::endl;
+    }
+    const bool modal = mConfig.integrator == "modal";
+    if(modal){
+        if(!prepareModalBasis()){
+            return;
+        }
+        // the rest shape comes from the tetrahedra, a resumed run may start deformed
+        std::vector<Eigen::Matrix<T,dim,1>> rest;
+        mTetraMesh.restPositions(rest);
+        mModal.body().start(mTetraMesh.mParticles, rest);
+        std::cout << "modal " << mModal.numModes() << " modes" << std::endl;
+    }
+    const bool subspace = mConfig.integrator == "subspace";
+    if(subspace){
+        if(!loadSubspace()){
+            return;
+        }
+        std::vector<Eigen::Matrix<T,dim,1>> rest;
+        mTetraMesh.restPositions(rest);
+        mSubspace.body().start(mTetraMesh.mParticles, rest);
+        std::cout << "subspace " << mSubspace.size() << " vectors, " << mSubspace.numCubature()
+                  << " cubature tetrahedra" << std::endl;
+    }
+    const bool multirate = mConfig.integrator == "multirate";
+    if(multirate){
+        mMultirate.build(*mTetraMesh.mTetras, size, T(mu), T(lambda), T(mTimeStep), T(mConfig.multirateCourant),
+                         mConfig.multirateLevels);
+        mCornerForces.resize((dim + 1) * mTetraMesh.mTetras->size());
+        std::cout << "multirate " << mMultirate.numLevels() << " levels, tetrahedra per level";
+        for(int l = 0; l < mMultirate.numLevels(); ++l){
+            std::cout << " " << mMultirate.numTets(l) - mMultirate.numTets(l + 1);
+        }
+        std::cout << ", finest step " << mMultirate.levelTimeStep(mMultirate.numLevels() - 1) << ", "
+                  << mMultirate.speedup() << "x fewer tetrahedron evaluations than the finest step" << std::endl;
+        if(mMultirate.numUnstable() > 0){
+            std::cout << "warning: " << mMultirate.numUnstable() << " tetrahedra need a step below the finest level, "
+                      << "raise multirate.levels or lower solver.timestep" << std::endl;
+        }
+    }
+    const bool tasks = mConfig.scheduler == "tasks" && !projective && !xpbd && !modal && !subspace && !multirate;
+    // the subspace step linearizes with the warped rest stiffness whatever the material
+    if((mCorotatedLinear && mConfig.useImplicit()) || subspace){
+        precomputeRestStiffness();
+        std::cout << (subspace ? "subspace tangent, " : "corotated linear, ") << mRestStiffness.size() * sizeof(Eigen::Matrix<T,dim,dim>)
+                  << " bytes of rest stiffness" << std::endl;
+    }
+    if(mConfig.rotation == "warm_start"){
+        // rest shape rotations, a resumed run converges or falls back to the SVD on the first step
+        mRotationCache.assign(mTetraMesh.mTetras->size(), Eigen::Quaternion<T>::Identity());
+    }
+    if(tasks){
+        buildTaskGraph();
+        std::cout << "task graph " << mTaskGraph.numNodes() << " chunks, " << mTaskGraph.numEdges()
+                  << " dependencies" << std::endl;
+    }
 
     // deformation gradient matrix
     Eigen::Matrix<T,dim,dim> F = Eigen::Matrix<T,dim,dim>::Zero(dim,dim);
-    // deformed tetrahedron matrix
-    Eigen::Matrix<T,dim,dim> Ds = Eigen::Matrix<T,dim,dim>::Zero(dim,dim);
     // SVD rotation matrix
     Eigen::Matrix<T,dim,dim> R = Eigen::Matrix<T,dim,dim>::Zero(dim,dim);
     // SVD scale matrix
     Eigen::Matrix<T,dim,dim> S = Eigen::Matrix<T,dim,dim>::Zero(dim,dim);
-    // Piola stress tensor
-    Eigen::Matrix<T,dim,dim> P = Eigen::Matrix<T,dim,dim>::Zero(dim,dim);
     // Force matrix
     Eigen::Matrix<T,dim,dim> G = Eigen::Matrix<T,dim,dim>::Zero(dim,dim);
     // det(F) * (F^-1)^T term
     Eigen::Matrix<T,dim,dim> JFinvT = Eigen::Matrix<T,dim,dim>::Zero(dim,dim);
 
-    int size = mTetraMesh.mParticles.positions.size();
     //std::vector<Eigen::Matrix<T, dim, 1>> past_pos(mTetraMesh->mParticles.positions);
     Eigen::Matrix<T, dim, 1> temp_pos = Eigen::Matrix<T,dim,1>::Zero(dim);
 
@@ -171,98 +1063,96 @@ void FEMSolver<T,dim>::cookMyJello() {
     // }
 
     // <<<<< Time Loop BEGIN
-    for(int z = 1; z <= mSteps; ++z){
-        for(int i = 0; i < stepsPerFrame; ++i)
+    for(int z = mStartFrame + 1; z <= mSteps; ++z){
+        int krylovIterations = 0;
+        for(int i = 0; i < mStepsPerFrame; ++i)
         {
-            mTetraMesh.mParticles.zeroForces();
+            PROFILE_SCOPE(mProfiler, PROFILE_SUBSTEP);
+            if(projective){
+                stepProjective();
+                continue;
+            }
+            if(xpbd){
+                stepXPBD();
+                continue;
+            }
+            if(modal){
+                stepModal();
+                continue;
+            }
+            if(subspace){
+                stepSubspace();
+                continue;
+            }
+            if(multirate){
+                stepMultirate();
+                continue;
+            }
+            if(tasks){
+                stepTasks(sleeping, !mConfig.useImplicit());
+            }
             // <<<<< force update BEGIN
-            for(Tetrahedron<T,dim> &t : mTetraMesh.mTetras){
-                computeDs(Ds, t);
-                computeF(F, Ds, t);
-                computeRS(R, S, F);
-                computeJFinvT(JFinvT, F);
-                double J = F.determinant();
-                P = 2.f * mu * (F - R) + lambda * (J - 1.f) * JFinvT;
-                //P = mu * (F - (1.f/J) * JFinvT) + lambda * std::log(J) * (1.f/J) * JFinvT;
-                G = -1 * P * t.mVolDmInvT;
-                epsilonCheckSquareMatrix(G);
+            else{
+                PROFILE_SCOPE(mProfiler, PROFILE_FORCES);
+                mTetraMesh.mParticles.zeroForces();
+                for(unsigned int n = 0; n < mTetraMesh.mTetras->size(); ++n){
+                    if(sleeping && !mIslands.tetAwake(n)){
+                        continue;
+                    }
+                    const Tetrahedron<T,dim> &t = (*mTetraMesh.mTetras)[n];
+                    computeElementForce(G, F, R, S, JFinvT, t, n);
+                    if(mConfig.useImplicit()){
+                        mDeformations[n] = {F, R, S, JFinvT};
+                    }
+                    else if(mConfig.dampingStiffness > 0){
+                        addElementDamping(G, R, t);
+                    }
 
-                for(int j = 0; j < dim; ++j){
-                    mTetraMesh.mParticles.forces[t.mPIndices[j]] += G.col(j);
+                    for(int j = 0; j < dim; ++j){
+                        mTetraMesh.mParticles.forces[t.mPIndices[j]] += G.col(j);
+                    }
+                    mTetraMesh.mParticles.forces[t.mPIndices[3]] += -1.f * (G.col(0) + G.col(1) + G.col(2));
                 }
-                mTetraMesh.mParticles.forces[t.mPIndices[3]] += -1.f * (G.col(0) + G.col(1) + G.col(2));
             }
 
     // <<<<< force update END
     // <<<<< Integration BEGIN
 
-    #ifdef USE_EXPLICIT
-
-            for(int j = 0; j < size; ++j) {
-
-                temp_pos = Eigen::Matrix<T,dim,1>::Zero(dim);
-
-                State<T, dim> currState;
-                State<T, dim> newState;
-
-                currState.mComponents[POS] = mTetraMesh.mParticles.positions[j];
-                currState.mComponents[VEL] = mTetraMesh.mParticles.velocities[j];
-                currState.mMass = mTetraMesh.mParticles.masses[j];
-                currState.mComponents[FOR] = mTetraMesh.mParticles.forces[j];
-                currState.mComponents[FOR][1] += -gravity * mTetraMesh.mParticles.masses[j];
+        if(!mConfig.useImplicit()){
 
-                mExplicitIntegrator.integrate(cTimeStep, 0, currState, newState);
-
-                scene.updatePosition(cTimeStep);
-
-                //<<<<<< FOR SCENE COLLISIONS TYPE 1
-                // if(scene.checkCollisions(newState.mComponents[POS], temp_pos)){
-                //     newState.mComponents[POS] = temp_pos;
-                //     newState.mComponents[VEL] = (temp_pos - currState.mComponents[POS]) / cTimeStep;
-                // }
-                //<<<<<< FOR SCENE COLLISIONS TYPE 2
-                if(scene.checkCollisions(newState.mComponents[POS], temp_pos)){
-                    newState.mComponents[POS] = currState.mComponents[POS];
-                    newState.mComponents[VEL] = Eigen::Matrix<T,dim,1>(0,0,0);
+            // the task graph integrates right after gathering each particle's forces
+            if(!tasks){
+                PROFILE_SCOPE(mProfiler, PROFILE_INTEGRATE);
+                for(int j = 0; j < size; ++j) {
+                    // colliders advance once per integrated particle
+                    scene.updatePosition(mTimeStep);
+                    if(sleeping && !mIslands.particleAwake(j)){
+                        continue;
+                    }
+                    integrateParticle(j, mTetraMesh.mParticles.forces[j], 0);
                 }
-
-                // <<<<<< FOR HANGING TESTS
-                // if(currState.mComponents[POS][0] <= 0.001){
-                //     newState.mComponents[POS] = currState.mComponents[POS];
-                //     newState.mComponents[VEL] = currState.mComponents[VEL];
-                // }
-
-                mTetraMesh.mParticles.positions[j] = newState.mComponents[POS];
-                mTetraMesh.mParticles.velocities[j] = newState.mComponents[VEL];
-
             }
 
-    #endif
+            if(sleeping && (i + 1) % mConfig.sleepCheckEvery == 0){
+                const int awake = mIslands.numAwake();
+                mIslands.check(mTetraMesh, T(mConfig.sleepSpeed), T(mConfig.sleepStrain), mConfig.sleepChecks);
+                // colliders advance once per integrated particle, see above
+                mIslands.wakeNearColliders(mTetraMesh, scene, T(mTimeStep * size * mConfig.sleepCheckEvery));
+                if(mIslands.numAwake() != awake){
+                    std::cout << "frame " << z << ": " << mIslands.numAwake() << " of " << mIslands.numIslands()
+                              << " islands awake" << std::endl;
+                }
+            }
 
-    #ifdef USE_IMPLICIT
+        }
+        else{
 
             const int n = size;
             const int dimen = dim * n;
 
-            // 1. Calculate A Matrix Here
-            Eigen::MatrixXf AMatrix(dimen, dimen);
-            AMatrix.setZero();
-
-            for(int d = 0; d < n; ++d){
-                for(int e = 0; e < dim; ++e){
-                    AMatrix(dim * d + e, dim * d + e) = mTetraMesh.mParticles.masses[d] * (1 / (cTimeStep * cTimeStep));
-                }
-            }
-
-            // 2. Calculate K Matrix here
-            Eigen::MatrixXf KMatrix(dimen, dimen);
-            KMatrix.setZero();
-            computeK(KMatrix, F, JFinvT, R, S);
+            Profiler::Clock::time_point assembleBegin = Profiler::Clock::now();
 
-            // 3. Do A = A - K
-            AMatrix -= KMatrix;
-
-            // 4. Calculate B Matrix
+            // 1. Calculate B Matrix
             Eigen::MatrixXf B1Mat(dimen, 1);
             B1Mat.setZero();
 
@@ -271,20 +1161,102 @@ void FEMSolver<T,dim>::cookMyJello() {
                 // B = Vn * mass/(dt) + f + mg
 
                 for(int e = 0; e < dim; ++e) {
-                    B1Mat(dim * d + e, 0) = mTetraMesh.mParticles.masses[d] * mTetraMesh.mParticles.velocities[d](e) * (1 / cTimeStep) + mTetraMesh.mParticles.forces[d](e);
+                    B1Mat(dim * d + e, 0) = mTetraMesh.mParticles.masses[d] * mTetraMesh.mParticles.velocities[d](e) * (1 / mTimeStep) + mTetraMesh.mParticles.forces[d](e);
                     if(e == 1){
                         B1Mat(dim * d + e, 0) += mTetraMesh.mParticles.masses[d] * -1 * gravity;
                     }
                 }
             }
 
-            // 5. Solve Ax = B
             Eigen::MatrixXf dxMat(dimen, 1);
             dxMat.setZero();
 
-    	    Eigen::MINRES<Eigen::MatrixXf, Eigen::Lower|Eigen::Upper, Eigen::IdentityPreconditioner> minres;
-        	minres.compute(AMatrix);
-        	dxMat = minres.solve(B1Mat);
+            if(mConfig.linearSolver == "gauss_seidel"){
+                // 2. Assemble the sparse A = M / dt^2 - K + D / dt
+                assembleSystem();
+                std::vector<Eigen::Matrix<T,dim,1>> b(n), dx(n);
+                for(int d = 0; d < n; ++d){
+                    b[d] = B1Mat.block<dim,1>(dim * d, 0).template cast<T>();
+                    // the current velocity is the initial guess, dx = v dt
+                    dx[d] = mTimeStep * mTetraMesh.mParticles.velocities[d];
+                }
+                if(mProfiler.enabled()){
+                    mProfiler.add(PROFILE_ASSEMBLE, assembleBegin, Profiler::Clock::now());
+                }
+
+                // 3. A fixed number of colored Gauss-Seidel sweeps on Ax = B
+                {
+                    PROFILE_SCOPE(mProfiler, PROFILE_SOLVE);
+                    mSystem.solve(b, dx, mConfig.linearIterations);
+                }
+                for(int d = 0; d < n; ++d){
+                    dxMat.block<dim,1>(dim * d, 0) = dx[d].template cast<float>();
+                }
+            }
+            else if(mConfig.linearSolver == "multigrid"){
+                // 2. Assemble the sparse A = M / dt^2 - K + D / dt
+                assembleSystem();
+                Eigen::SparseMatrix<T, Eigen::RowMajor> AMatrix;
+                mSystem.toSparse(AMatrix);
+                Eigen::Matrix<T,Eigen::Dynamic,1> b = B1Mat.col(0).template cast<T>();
+                Eigen::Matrix<T,Eigen::Dynamic,1> dx(dimen);
+                for(int d = 0; d < n; ++d){
+                    // the current velocity is the initial guess, dx = v dt
+                    dx.template segment<dim>(dim * d) = mTimeStep * mTetraMesh.mParticles.velocities[d];
+                }
+                if(mProfiler.enabled()){
+                    mProfiler.add(PROFILE_ASSEMBLE, assembleBegin, Profiler::Clock::now());
+                }
+
+                // 3. CG on Ax = B with one multigrid V-cycle as the preconditioner
+                {
+                    PROFILE_SCOPE(mProfiler, PROFILE_SOLVE);
+                    Eigen::ConjugateGradient<Eigen::SparseMatrix<T, Eigen::RowMajor>, Eigen::Lower|Eigen::Upper,
+                                             MultigridPreconditioner<T,dim>> cg;
+                    cg.setTolerance(mConfig.linearTolerance);
+                    cg.preconditioner().setHierarchy(&mHierarchy);
+                    cg.compute(AMatrix);
+                    dx = cg.solveWithGuess(b, dx);
+                    krylovIterations += cg.iterations();
+                }
+                dxMat = dx.template cast<float>();
+            }
+            else{
+                // 2. Calculate A Matrix Here
+                Eigen::MatrixXf AMatrix(dimen, dimen);
+                AMatrix.setZero();
+
+                // with Rayleigh damping D = alpha M - beta K taken at the end of the step,
+                // A = M / dt^2 - K + D / dt
+                for(int d = 0; d < n; ++d){
+                    for(int e = 0; e < dim; ++e){
+                        AMatrix(dim * d + e, dim * d + e) = mTetraMesh.mParticles.masses[d] * (1 / (mTimeStep * mTimeStep))
+                                                            * (1 + mConfig.dampingMass * mTimeStep);
+                    }
+                }
+
+                // 3. Calculate K Matrix here
+                Eigen::MatrixXf KMatrix(dimen, dimen);
+                KMatrix.setZero();
+                computeK(KMatrix);
+
+                // 4. Do A = A - K
+                AMatrix -= (1 + mConfig.dampingStiffness / mTimeStep) * KMatrix;
+
+                if(mProfiler.enabled()){
+                    mProfiler.add(PROFILE_ASSEMBLE, assembleBegin, Profiler::Clock::now());
+                }
+
+                // 5. Solve Ax = B
+                {
+                    PROFILE_SCOPE(mProfiler, PROFILE_SOLVE);
+                    Eigen::MINRES<Eigen::MatrixXf, Eigen::Lower|Eigen::Upper, Eigen::IdentityPreconditioner> minres;
+                    minres.compute(AMatrix);
+                    dxMat = minres.solve(B1Mat);
+                }
+            }
+
+            PROFILE_SCOPE(mProfiler, PROFILE_INTEGRATE);
 
             // 6. Update velocities and position with dx
             Eigen::Matrix<T, dim, 1> newPos;
@@ -299,13 +1271,18 @@ void FEMSolver<T,dim>::cookMyJello() {
                     deltaX(e, 0) = dxMat(d * dim + e, 0);
                 }
                 // v(n + 1) = dx/dt;
-                newVel = deltaX / cTimeStep;
+                newVel = deltaX / mTimeStep;
 
                 // x(n + 1) = x(n) + dx;
                 newPos = mTetraMesh.mParticles.positions[d] + deltaX;
 
                 // collision tests here
-                if(scene.checkCollisions(newPos, temp_pos)){
+                bool collided = false;
+                {
+                    PROFILE_SCOPE(mProfiler, PROFILE_COLLISION);
+                    collided = scene.checkCollisions(newPos, temp_pos);
+                }
+                if(collided){
                     newPos = mTetraMesh.mParticles.positions[d];
                     newVel.setZero();
                 }
@@ -313,24 +1290,55 @@ void FEMSolver<T,dim>::cookMyJello() {
                 mTetraMesh.mParticles.positions[d] = newPos;
                 mTetraMesh.mParticles.velocities[d] = newVel;
             }
-    #endif
+        }
             // <<<<< Integration END
         }
-        mTetraMesh.outputFrame(z);
-        scene.outputFrame(z);
+        if(z % mConfig.outputEvery == 0){
+            if(mConfig.outputAsync){
+                // the previous frame is still being written from its own snapshot
+                waitForOutput();
+                mOutputMesh.mParticles = mTetraMesh.mParticles;
+                mPendingOutput = std::async(std::launch::async, [this, z](){ writeFrame(z, mOutputMesh); });
+            }
+            else{
+                writeFrame(z, mTetraMesh);
+            }
+            scene.outputFrame(z, mConfig.colliderDir);
+        }
+        if(mConfig.useImplicit() && mConfig.linearSolver == "multigrid"){
+            std::cout << "frame " << z << ": " << krylovIterations << " cg iterations in " << mStepsPerFrame
+                      << " steps" << std::endl;
+        }
+        if(mConfig.checkpointEvery > 0 && z % mConfig.checkpointEvery == 0){
+            writeCheckpoint(z);
+        }
+        mProfiler.endFrame(z);
     }
     // <<<<< Time Loop END
+    waitForOutput();
+    mFrameStream.close();
+
+    if(mProfiler.enabled()){
+        mProfiler.writeSummary(mConfig.profileSummary);
+        if(!mConfig.profileTrace.empty()){
+            mProfiler.writeTrace(mConfig.profileTrace);
+        }
+    }
 }
 
 template<class T, int dim>
 void FEMSolver<T,dim>::calculateMaterialConstants(){
-    mu = TetraMesh<T,dim>::k / (2.f * (1.f + TetraMesh<T,dim>::nu));
-    lambda = (TetraMesh<T,dim>::k * TetraMesh<T,dim>::nu) / ((1.f + TetraMesh<T,dim>::nu)*(1.f - 2.f*TetraMesh<T,dim>::nu));
+    const double k = mConfig.k;
+    const double nu = mConfig.nu;
+    mu = k / (2.f * (1.f + nu));
+    lambda = (k * nu) / ((1.f + nu)*(1.f - 2.f*nu));
 }
 
 template<class T, int dim>
 void FEMSolver<T,dim>::computeDm(){
-    for(Tetrahedron<T,dim> &t : mTetraMesh.mTetras){
+    #pragma omp parallel for
+    for(unsigned int n = 0; n < mTetraMesh.mTetras->size(); ++n){
+        Tetrahedron<T,dim> &t = (*mTetraMesh.mTetras)[n];
         Eigen::Matrix<T,dim,dim> Dm = Eigen::Matrix<T,dim,dim>::Zero(dim,dim);
         for(int i = 0; i < dim; ++i){
             for(int j = 0; j < dim; ++j){
@@ -343,8 +1351,9 @@ void FEMSolver<T,dim>::computeDm(){
 
 template<class T, int dim>
 void FEMSolver<T,dim>::precomputeTetraConstants(){
-    for(Tetrahedron<T,dim> &t : mTetraMesh.mTetras){
-        t.precompute();
+    #pragma omp parallel for
+    for(unsigned int n = 0; n < mTetraMesh.mTetras->size(); ++n){
+        (*mTetraMesh.mTetras)[n].precompute();
     }
 }
 
@@ -369,6 +1378,7 @@ template<class T, int dim>
 void FEMSolver<T,dim>::computeRS(Eigen::Matrix<T,dim,dim>& R,
                     Eigen::Matrix<T,dim,dim>& S,
                     const Eigen::Matrix<T,dim,dim>& F){
+    PROFILE_SCOPE(mProfiler, PROFILE_SVD);
     Eigen::JacobiSVD<Eigen::Matrix<T,dim,dim>> svd(F, Eigen::ComputeFullU | Eigen::ComputeFullV);
     Eigen::Matrix<T,dim,dim> U = svd.matrixU();
     Eigen::Matrix<T,dim,dim> V = svd.matrixV();
@@ -390,6 +1400,61 @@ void FEMSolver<T,dim>::computeRS(Eigen::Matrix<T,dim,dim>& R,
     S = V * sigma * V.transpose();
 }
 
+template<class T, int dim>
+bool FEMSolver<T,dim>::warmStartRotation(Eigen::Quaternion<T>& q, Eigen::Matrix<T,dim,dim>& R,
+                    const Eigen::Matrix<T,dim,dim>& F){
+    // Newton steps on tr(R^T F) over R exp(theta): with M = R^T F the gradient is
+    // the axial vector of M - M^T and the Hessian tr(sym M) I - sym M
+    for(int i = 0; i < mConfig.rotationIterations; ++i){
+        R = q.toRotationMatrix();
+        const Eigen::Matrix<T,dim,dim> M = R.transpose() * F;
+        const Eigen::Matrix<T,dim,1> gradient(M(2,1) - M(1,2), M(0,2) - M(2,0), M(1,0) - M(0,1));
+        const Eigen::Matrix<T,dim,dim> symmetric = T(0.5) * (M + M.transpose());
+        const Eigen::Matrix<T,dim,dim> hessian = symmetric.trace() * Eigen::Matrix<T,dim,dim>::Identity() - symmetric;
+        const Eigen::Matrix<T,dim,1> theta = hessian.inverse() * gradient;
+        const T angle = theta.norm();
+        if(!(angle < 1)){
+            // far from the polar rotation or an indefinite Hessian
+            return false;
+        }
+        if(angle > 0){
+            q = q * Eigen::Quaternion<T>(Eigen::AngleAxis<T>(angle, theta / angle));
+            q.normalize();
+        }
+        // convergence is quadratic, the step just taken leaves an error of order angle^2
+        if(angle < 1e-7){
+            R = q.toRotationMatrix();
+            return true;
+        }
+    }
+    R = q.toRotationMatrix();
+    return false;
+}
+
+template<class T, int dim>
+void FEMSolver<T,dim>::computeRotation(Eigen::Matrix<T,dim,dim>& R,
+                    Eigen::Matrix<T,dim,dim>& S,
+                    const Eigen::Matrix<T,dim,dim>& F, int n){
+    if(mRotationCache.empty() || n < 0){
+        computeRS(R, S, F);
+        return;
+    }
+    // the iteration finds a rotation for any F, inverted or flat elements take
+    // computeRS's sign convention instead
+    Eigen::Quaternion<T>& q = mRotationCache[n];
+    bool converged = false;
+    {
+        PROFILE_SCOPE(mProfiler, PROFILE_SVD);
+        converged = F.determinant() >= 1e-2 && warmStartRotation(q, R, F);
+    }
+    if(!converged){
+        computeRS(R, S, F);
+        q = Eigen::Quaternion<T>(R);
+        return;
+    }
+    S = R.transpose() * F;
+}
+
 template<class T, int dim>
 void FEMSolver<T,dim>::computeJFinvT(Eigen::Matrix<T,dim,dim>& JFinvT, const Eigen::Matrix<T,dim,dim>& F){
     switch(dim){
@@ -415,9 +1480,80 @@ void FEMSolver<T,dim>::computeJFinvT(Eigen::Matrix<T,dim,dim>& JFinvT, const Eig
     // transpose is hard-coded!!
 }
 
+template<class T, int dim>
+void FEMSolver<T,dim>::computeElementForce(Eigen::Matrix<T,dim,dim>& G,
+                    Eigen::Matrix<T,dim,dim>& F,
+                    Eigen::Matrix<T,dim,dim>& R,
+                    Eigen::Matrix<T,dim,dim>& S,
+                    Eigen::Matrix<T,dim,dim>& JFinvT,
+                    const Tetrahedron<T,dim>& t, int n){
+    // deformed tetrahedron matrix
+    Eigen::Matrix<T,dim,dim> Ds;
+    computeDs(Ds, t);
+    computeElementForce(G, F, R, S, JFinvT, Ds, t, n);
+}
+
+template<class T, int dim>
+void FEMSolver<T,dim>::computeElementForce(Eigen::Matrix<T,dim,dim>& G,
+                    Eigen::Matrix<T,dim,dim>& F,
+                    Eigen::Matrix<T,dim,dim>& R,
+                    Eigen::Matrix<T,dim,dim>& S,
+                    Eigen::Matrix<T,dim,dim>& JFinvT,
+                    const Eigen::Matrix<T,dim,dim>& Ds,
+                    const Tetrahedron<T,dim>& t, int n){
+    computeF(F, Ds, t);
+    computeRotation(R, S, F, n);
+    computeJFinvT(JFinvT, F);
+    if(mCorotatedLinear){
+        // corotated linear: f = R K0 (R^T x - X). K0 (R^T x - X) is the linear stress of the
+        // displacement gradient H = R^T F - I, which is cheaper than the stored blocks
+        const Eigen::Matrix<T,dim,dim> H = R.transpose() * F - Eigen::Matrix<T,dim,dim>::Identity();
+        const Eigen::Matrix<T,dim,dim> P = mu * (H + H.transpose()) + lambda * H.trace() * Eigen::Matrix<T,dim,dim>::Identity();
+        G = -1 * R * P * t.mVolDmInvT;
+        epsilonCheckSquareMatrix(G);
+        return;
+    }
+    double J = F.determinant();
+    // Piola stress tensor
+    Eigen::Matrix<T,dim,dim> P = 2.f * mu * (F - R) + lambda * (J - 1.f) * JFinvT;
+    //P = mu * (F - (1.f/J) * JFinvT) + lambda * std::log(J) * (1.f/J) * JFinvT;
+    G = -1 * P * t.mVolDmInvT;
+    epsilonCheckSquareMatrix(G);
+}
+
+template<class T, int dim>
+void FEMSolver<T,dim>::computeElementForceAt(Eigen::Matrix<T,dim,dim>& G, const Eigen::Matrix<T,dim,1>* x, int n,
+                    Eigen::Matrix<T,Eigen::Dynamic,Eigen::Dynamic>* K){
+    Eigen::Matrix<T,dim,dim> Ds, F, R, S, JFinvT;
+    for(int i = 0; i < dim; ++i){
+        Ds.col(i) = x[i] - x[dim];
+    }
+    computeElementForce(G, F, R, S, JFinvT, Ds, (*mTetraMesh.mTetras)[n], -1);
+    if(K != nullptr){
+        Eigen::MatrixXf warped;
+        computeWarpedK(warped, n, R);
+        *K = warped.template cast<T>();
+    }
+}
+
+template<class T, int dim>
+void FEMSolver<T,dim>::addElementDamping(Eigen::Matrix<T,dim,dim>& G, const Eigen::Matrix<T,dim,dim>& R,
+                    const Tetrahedron<T,dim>& t){
+    // R K0 R^T v is the linear stress of the rotated velocity gradient, as for corotated linear
+    // forces; the rigid rotation of an undeformed element has a skew velocity gradient and is not damped
+    const std::vector<Eigen::Matrix<T,dim,1>>& velocities = mTetraMesh.mParticles.velocities;
+    Eigen::Matrix<T,dim,dim> Dv;
+    for(int i = 0; i < dim; ++i){
+        Dv.col(i) = velocities[t.mPIndices[i]] - velocities[t.mPIndices[dim]];
+    }
+    const Eigen::Matrix<T,dim,dim> H = R.transpose() * Dv * t.mDmInv;
+    const Eigen::Matrix<T,dim,dim> P = mu * (H + H.transpose()) + lambda * H.trace() * Eigen::Matrix<T,dim,dim>::Identity();
+    G -= T(mConfig.dampingStiffness) * R * P * t.mVolDmInvT;
+}
+
 template<class T, int dim>
 void FEMSolver<T,dim>::distributeMass(){
-    for(Tetrahedron<T,dim> &t : mTetraMesh.mTetras){
+    for(Tetrahedron<T,dim> &t : *mTetraMesh.mTetras){
         for(int i = 0; i < dim + 1; ++i){
             // distribute 1/4 of mass to each tetrahedron point
             mTetraMesh.mParticles.masses[t.mPIndices[i]] += 0.25f * t.mass;
@@ -429,24 +1565,183 @@ void FEMSolver<T,dim>::distributeMass(){
 //////// K MATRIX COMPUTATION //////////
 
 template<class T, int dim>
-void FEMSolver<T,dim>::computeK(Eigen::MatrixXf& KMatrix,
+void FEMSolver<T,dim>::computeK(Eigen::MatrixXf& KMatrix)
+{
+    PROFILE_SCOPE(mProfiler, PROFILE_STIFFNESS);
+    const std::vector<Tetrahedron<T,dim>>& tetras = *mTetraMesh.mTetras;
+    Eigen::MatrixXf K(4*dim, 4*dim);
+    for(unsigned int e = 0; e < tetras.size(); ++e){
+        const Tetrahedron<T,dim> &t = tetras[e];
+        const ElementDeformation& d = mDeformations[e];
+        if(mCorotatedLinear){
+            computeWarpedK(K, e, d.R);
+        }
+        else{
+            computeElementK(K, t, d.F, d.JFinvT, d.R, d.S);
+        }
+        for(int i = 0; i < dim + 1; ++i){
+            for(int j = 0; j < dim + 1; ++j){
+                for(int m = 0; m < dim; ++m){
+                    for(int n = 0; n < dim; ++n){
+                        KMatrix(3 * t.mPIndices[i] + m, 3 * t.mPIndices[j] + n) += K(3*i + m, 3*j + n);
+                    }
+                }
+            }
+        }
+    }
+}
+
+template<class T, int dim>
+void FEMSolver<T,dim>::assembleSystem()
+{
+    PROFILE_SCOPE(mProfiler, PROFILE_STIFFNESS);
+    const std::vector<Tetrahedron<T,dim>>& tetras = *mTetraMesh.mTetras;
+    const Particles<T,dim>& particles = mTetraMesh.mParticles;
+    // Rayleigh damping D = alpha M - beta K adds D / dt
+    const T massScale = T(1 + mConfig.dampingMass * mTimeStep);
+    const T stiffnessScale = T(1 + mConfig.dampingStiffness / mTimeStep);
+    mSystem.setZero();
+    #pragma omp parallel for
+    for(int d = 0; d < int(particles.masses.size()); ++d){
+        mSystem.diagonal(d) = Eigen::Matrix<T,dim,dim>::Identity() * (particles.masses[d] * (1 / (mTimeStep * mTimeStep)) * massScale);
+    }
+    // tetrahedra of one color share no vertex and subtract their blocks without locks
+    for(int c = 0; c < mTetColoring.numColors(); ++c){
+        const int* members = mTetColoring.begin(c);
+        #pragma omp parallel
+        {
+            Eigen::MatrixXf K(4*dim, 4*dim);
+            #pragma omp for schedule(dynamic, 16)
+            for(int k = 0; k < mTetColoring.size(c); ++k){
+                const Tetrahedron<T,dim> &t = tetras[members[k]];
+                const ElementDeformation& d = mDeformations[members[k]];
+                if(mCorotatedLinear){
+                    computeWarpedK(K, members[k], d.R);
+                }
+                else{
+                    computeElementK(K, t, d.F, d.JFinvT, d.R, d.S);
+                }
+                for(int i = 0; i < dim + 1; ++i){
+                    for(int j = 0; j < dim + 1; ++j){
+                        mSystem.block(t.mPIndices[i], t.mPIndices[j])
+                            -= stiffnessScale * K.block<dim,dim>(dim * i, dim * j).template cast<T>();
+                    }
+                }
+            }
+        }
+    }
+}
+
+template<class T, int dim>
+void FEMSolver<T,dim>::precomputeRestStiffness()
+{
+    // linearized fixed corotated at F = I, P = mu (H + H^T) + lambda tr(H) I for a displacement
+    // gradient H, so with g_a = dF / dx_a: K0_ab = -V (mu (g_a . g_b) I + mu g_b g_a^T + lambda g_a g_b^T)
+    const std::vector<Tetrahedron<T,dim>>& tetras = *mTetraMesh.mTetras;
+    const int blocks = dim * (dim + 1) / 2;
+    mRestStiffness.resize(blocks * tetras.size());
+    #pragma omp parallel for
+    for(int n = 0; n < int(tetras.size()); ++n){
+        const Tetrahedron<T,dim>& t = tetras[n];
+        Eigen::Matrix<T,dim,dim>* K0 = &mRestStiffness[blocks * n];
+        for(int a = 0; a < dim; ++a){
+            const Eigen::Matrix<T,dim,1> ga = t.mDmInv.row(a).transpose();
+            for(int b = a; b < dim; ++b){
+                const Eigen::Matrix<T,dim,1> gb = t.mDmInv.row(b).transpose();
+                *K0++ = -t.volume * (T(mu) * ga.dot(gb) * Eigen::Matrix<T,dim,dim>::Identity()
+                                     + T(mu) * gb * ga.transpose() + T(lambda) * ga * gb.transpose());
+            }
+        }
+    }
+}
+
+template<class T, int dim>
+void FEMSolver<T,dim>::assembleRestStiffness(Eigen::SparseMatrix<T>& K)
+{
+    const std::vector<Tetrahedron<T,dim>>& tetras = *mTetraMesh.mTetras;
+    const int size = dim * mTetraMesh.mParticles.positions.size();
+    std::vector<Eigen::Triplet<T>> entries;
+    entries.reserve(size_t(tetras.size()) * (dim + 1) * (dim + 1) * dim * dim);
+    Eigen::Matrix<T,dim,dim> K0;
+    for(unsigned int n = 0; n < tetras.size(); ++n){
+        const Tetrahedron<T,dim>& t = tetras[n];
+        for(int a = 0; a < dim + 1; ++a){
+            for(int b = 0; b < dim + 1; ++b){
+                restStiffnessBlock(K0, n, a, b);
+                for(int r = 0; r < dim; ++r){
+                    for(int c = 0; c < dim; ++c){
+                        entries.push_back(Eigen::Triplet<T>(dim * t.mPIndices[a] + r, dim * t.mPIndices[b] + c, -K0(r, c)));
+                    }
+                }
+            }
+        }
+    }
+    // duplicate entries are summed
+    K.resize(size, size);
+    K.setFromTriplets(entries.begin(), entries.end());
+}
+
+template<class T, int dim>
+void FEMSolver<T,dim>::restStiffnessBlock(Eigen::Matrix<T,dim,dim>& K0, int n, int a, int b)
+{
+    const Eigen::Matrix<T,dim,dim>* blocks = &mRestStiffness[dim * (dim + 1) / 2 * n];
+    if(a < dim && b < dim){
+        // K0 is symmetric, K0_ba = K0_ab^T
+        const int i = std::min(a, b);
+        const int j = std::max(a, b);
+        const Eigen::Matrix<T,dim,dim>& block = blocks[i * dim - i * (i - 1) / 2 + j - i];
+        K0 = a <= b ? block : block.transpose();
+        return;
+    }
+    // rows and columns sum to zero, corner dim takes minus the sum of the others
+    Eigen::Matrix<T,dim,dim> sum = Eigen::Matrix<T,dim,dim>::Zero();
+    Eigen::Matrix<T,dim,dim> block;
+    for(int c = 0; c < dim; ++c){
+        if(a == dim && b == dim){
+            for(int d = 0; d < dim; ++d){
+                restStiffnessBlock(block, n, c, d);
+                sum += block;
+            }
+        }
+        else{
+            restStiffnessBlock(block, n, a == dim ? c : a, b == dim ? c : b);
+            sum -= block;
+        }
+    }
+    K0 = sum;
+}
+
+template<class T, int dim>
+void FEMSolver<T,dim>::computeWarpedK(Eigen::MatrixXf& K, int n, const Eigen::Matrix<T,dim,dim>& R)
+{
+    K.setZero(4*dim, 4*dim);
+    Eigen::Matrix<T,dim,dim> K0;
+    for(int p = 0; p < dim + 1; ++p){
+        for(int q = 0; q < dim + 1; ++q){
+            restStiffnessBlock(K0, n, p, q);
+            K.block<dim,dim>(dim * p, dim * q) = (R * K0 * R.transpose()).template cast<float>();
+        }
+    }
+}
+
+template<class T, int dim>
+void FEMSolver<T,dim>::computeElementK(Eigen::MatrixXf& K,
+                const Tetrahedron<T,dim>& t,
                 const Eigen::Matrix<T,dim,dim>& F,
                 const Eigen::Matrix<T,dim,dim>& JFinvT,
                 const Eigen::Matrix<T,dim,dim>& R,
                 const Eigen::Matrix<T,dim,dim>& S)
 {
-    for(Tetrahedron<T,dim> t : mTetraMesh.mTetras){
-        Eigen::MatrixXf K(4*dim, 4*dim);
-        for(int p = 0; p < dim + 1; ++p){
-            for(int q = 0; q < dim + 1; ++q){
-                for(int i = 0; i < dim; ++i){
-                    for(int r = 0; r < dim; ++r){
-                        for(int m = 0; m < dim; ++m){
-                            for(int n = 0; n < dim; ++n){
-                                for(int j = 0; j < dim; ++j){
-                                    for(int k = 0; k < dim; ++k){
-                                        K(3 * p + i, 3 * q + r) += -1 * t.volume * DsqPsiDsqF(j, k, m, n, F, JFinvT, R, S) * DFDx(m, n, q, r, t) * DFDx(j, k, p, i, t);
-                                    }
+    K.setZero(4*dim, 4*dim);
+    for(int p = 0; p < dim + 1; ++p){
+        for(int q = 0; q < dim + 1; ++q){
+            for(int i = 0; i < dim; ++i){
+                for(int r = 0; r < dim; ++r){
+                    for(int m = 0; m < dim; ++m){
+                        for(int n = 0; n < dim; ++n){
+                            for(int j = 0; j < dim; ++j){
+                                for(int k = 0; k < dim; ++k){
+                                    K(3 * p + i, 3 * q + r) += -1 * t.volume * DsqPsiDsqF(j, k, m, n, F, JFinvT, R, S) * DFDx(m, n, q, r, t) * DFDx(j, k, p, i, t);
                                 }
                             }
                         }
@@ -454,15 +1749,6 @@ void FEMSolver<T,dim>::computeK(Eigen::MatrixXf& KMatrix,
                 }
             }
         }
-        for(int i = 0; i < dim + 1; ++i){
-            for(int j = 0; j < dim + 1; ++j){
-                for(int m = 0; m < dim; ++m){
-                    for(int n = 0; n < dim; ++n){
-                        KMatrix(3 * t.mPIndices[i] + m, 3 * t.mPIndices[j] + n) += K(3*i + m, 3*j + n);
-                    }
-                }
-            }
-        }
     }
 }
 
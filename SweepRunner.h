@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "FEMSolver.h"
+#include "utility/FileHelper.h"
+#include "utility/SweepSpec.h"
+
+// Runs every configuration of a SweepSpec on one mesh that is loaded and
+// precomputed once. Each run gets its own particles and scene but shares the
+// read-only tetrahedra, and writes to spec.directory/run_NNN.
+template<class T, int dim>
+class SweepRunner {
+public:
+    SweepRunner(const SweepSpec& spec);
+    ~SweepRunner();
+
+    bool run();
+
+private:
+    const SweepSpec& mSpec;
+
+    void runOne(int run, const TetraMesh<T,dim>& mesh);
+};
+
+template<class T, int dim>
+SweepRunner<T,dim>::SweepRunner(const SweepSpec& spec) : mSpec(spec) {}
+
+template<class T, int dim>
+SweepRunner<T,dim>::~SweepRunner() {}
+
+template<class T, int dim>
+bool SweepRunner<T,dim>::run() {
+    const int numRuns = mSpec.numRuns();
+
+    // validate every run before spending time on the mesh
+    for(int i = 0; i < numRuns; ++i){
+        SimConfig config;
+        if(!mSpec.runConfig(i, config)){
+            std::cout << "error: invalid configuration for " << mSpec.runName(i) << std::endl;
+            return false;
+        }
+    }
+    if(!FileHelper::makeDirectory(mSpec.directory) || !mSpec.writeIndex()){
+        return false;
+    }
+
+    SimConfig meshConfig;
+    mSpec.runConfig(0, meshConfig);
+    FEMSolver<T,dim> setup(meshConfig);
+    setup.initializeMesh();
+    setup.precomputeMesh();
+    const TetraMesh<T,dim>& mesh = setup.mesh();
+
+    const int jobs = std::min(mSpec.jobs, numRuns);
+    std::cout << numRuns << " runs, " << jobs << " at a time" << std::endl;
+
+    std::atomic<int> next(0);
+    auto worker = [&]() {
+        for(int i = next++; i < numRuns; i = next++){
+            runOne(i, mesh);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for(int j = 1; j < jobs; ++j){
+        threads.push_back(std::thread(worker));
+    }
+    worker();
+    for(std::thread& t : threads){
+        t.join();
+    }
+    return true;
+}
+
+template<class T, int dim>
+void SweepRunner<T,dim>::runOne(int run, const TetraMesh<T,dim>& mesh) {
+    SimConfig config;
+    mSpec.runConfig(run, config);
+    if(!FileHelper::makeDirectory(mSpec.runDirectory(run))){
+        return;
+    }
+    config.save(mSpec.runDirectory(run) + "/run.ini");
+
+    FEMSolver<T,dim> solver(config, mesh);
+    solver.cookMyJello();
+    std::cout << mSpec.runName(run) << " done" << std::endl;
+}
@@ -0,0 +1,366 @@
+// Microbenchmarks for the hot kernels of the solver.
+//
+// Mesh-sized benchmarks take the target tetrahedron count as their argument
+// (1k to 1M) and run on a deformed structured box from bench/SyntheticMesh.h.
+// Run with --benchmark_filter=<regex> to select kernels, e.g.
+//   FEMBench --benchmark_filter=ElementForces/100000
+
+#include <benchmark/benchmark.h>
+
+#include <cstdlib>
+#include <map>
+#include <memory>
+
+#include "../FEMSolver.h"
+#include "SyntheticMesh.h"
+
+typedef double BenchT;
+const int benchDim = 3;
+typedef Eigen::Matrix<BenchT,benchDim,benchDim> Mat;
+typedef Eigen::Matrix<BenchT,benchDim,1> Vec;
+
+// the kernels are private to FEMSolver, this is the friend that reaches them
+struct FEMBenchmarkAccess {
+    template<class T, int dim>
+    static TetraMesh<T,dim>& mesh(FEMSolver<T,dim>& solver) { return solver.mTetraMesh; }
+
+    template<class T, int dim>
+    static Scene<T,dim>& scene(FEMSolver<T,dim>& solver) { return *solver.mScene; }
+
+    template<class T, int dim>
+    static void calculateMaterialConstants(FEMSolver<T,dim>& solver) { solver.calculateMaterialConstants(); }
+
+    template<class T, int dim>
+    static void computeRS(FEMSolver<T,dim>& solver, Eigen::Matrix<T,dim,dim>& R, Eigen::Matrix<T,dim,dim>& S,
+                          const Eigen::Matrix<T,dim,dim>& F) { solver.computeRS(R, S, F); }
+
+    template<class T, int dim>
+    static bool warmStartRotation(FEMSolver<T,dim>& solver, Eigen::Quaternion<T>& q, Eigen::Matrix<T,dim,dim>& R,
+                                  const Eigen::Matrix<T,dim,dim>& F) { return solver.warmStartRotation(q, R, F); }
+
+    template<class T, int dim>
+    static void computeJFinvT(FEMSolver<T,dim>& solver, Eigen::Matrix<T,dim,dim>& JFinvT,
+                              const Eigen::Matrix<T,dim,dim>& F) { solver.computeJFinvT(JFinvT, F); }
+
+    template<class T, int dim>
+    static void computeF(FEMSolver<T,dim>& solver, Eigen::Matrix<T,dim,dim>& F, const Tetrahedron<T,dim>& t) {
+        Eigen::Matrix<T,dim,dim> Ds;
+        solver.computeDs(Ds, t);
+        solver.computeF(F, Ds, t);
+    }
+
+    template<class T, int dim>
+    static void computeElementForce(FEMSolver<T,dim>& solver, Eigen::Matrix<T,dim,dim>& G, Eigen::Matrix<T,dim,dim>& F,
+                                    Eigen::Matrix<T,dim,dim>& R, Eigen::Matrix<T,dim,dim>& S,
+                                    Eigen::Matrix<T,dim,dim>& JFinvT, const Tetrahedron<T,dim>& t) {
+        solver.computeElementForce(G, F, R, S, JFinvT, t, -1);
+    }
+
+    template<class T, int dim>
+    static void computeElementK(FEMSolver<T,dim>& solver, Eigen::MatrixXf& K, const Tetrahedron<T,dim>& t,
+                                const Eigen::Matrix<T,dim,dim>& F, const Eigen::Matrix<T,dim,dim>& JFinvT,
+                                const Eigen::Matrix<T,dim,dim>& R, const Eigen::Matrix<T,dim,dim>& S) {
+        solver.computeElementK(K, t, F, JFinvT, R, S);
+    }
+};
+
+typedef FEMBenchmarkAccess Access;
+
+namespace {
+
+std::string scratchDirectory() {
+    const char* tmp = std::getenv("TMPDIR");
+    std::string dir = std::string(tmp ? tmp : "/tmp") + "/fem_bench_scratch";
+    FileHelper::makeDirectory(dir);
+    return dir;
+}
+
+// solvers with a precomputed, deformed box mesh, built once per size and scene
+FEMSolver<BenchT,benchDim>& solverFor(int tets, const std::string& scene = "default") {
+    static std::map<std::pair<int, std::string>, std::unique_ptr<FEMSolver<BenchT,benchDim>>> solvers;
+    std::unique_ptr<FEMSolver<BenchT,benchDim>>& solver = solvers[std::make_pair(tets, scene)];
+    if(!solver){
+        SimConfig config;
+        config.scene = scene;
+        config.finalize();
+        solver.reset(new FEMSolver<BenchT,benchDim>(config));
+        buildBoxMesh(Access::mesh(*solver), boxCellsForTets(tets));
+        solver->precomputeMesh();
+        Access::calculateMaterialConstants(*solver);
+        deformMesh(Access::mesh(*solver), BenchT(0.2) / boxCellsForTets(tets), 7);
+    }
+    return *solver;
+}
+
+// deformation gradients of the first count tetrahedra of a deformed mesh
+const std::vector<Mat>& sampleGradients(int count) {
+    static std::vector<Mat> gradients;
+    if(int(gradients.size()) != count){
+        FEMSolver<BenchT,benchDim>& solver = solverFor(10000);
+        const std::vector<Tetrahedron<BenchT,benchDim>>& tetras = *Access::mesh(solver).mTetras;
+        gradients.resize(count);
+        for(int i = 0; i < count; ++i){
+            Access::computeF(solver, gradients[i], tetras[i % tetras.size()]);
+        }
+    }
+    return gradients;
+}
+
+void meshSizes(benchmark::internal::Benchmark* b) {
+    b->Arg(1000)->Arg(10000)->Arg(100000)->Arg(1000000)->Unit(benchmark::kMillisecond);
+}
+
+}
+
+static void BM_ComputeRS(benchmark::State& state) {
+    FEMSolver<BenchT,benchDim>& solver = solverFor(10000);
+    const std::vector<Mat>& gradients = sampleGradients(4096);
+    Mat R, S;
+    for(auto _ : state){
+        for(const Mat& F : gradients){
+            Access::computeRS(solver, R, S, F);
+            benchmark::DoNotOptimize(R);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * gradients.size());
+}
+BENCHMARK(BM_ComputeRS);
+
+// polar iterations from the rotation of the previous substep, F turned by 1e-4 rad
+static void BM_WarmStartRotation(benchmark::State& state) {
+    FEMSolver<BenchT,benchDim>& solver = solverFor(10000);
+    const std::vector<Mat>& gradients = sampleGradients(4096);
+    const Mat turn = Eigen::AngleAxis<BenchT>(BenchT(1e-4), Vec(1, 2, 3).normalized()).toRotationMatrix();
+    std::vector<Eigen::Quaternion<BenchT>> previous(gradients.size());
+    std::vector<Mat> next(gradients.size());
+    Mat R, S;
+    for(unsigned int i = 0; i < gradients.size(); ++i){
+        Access::computeRS(solver, R, S, gradients[i]);
+        previous[i] = Eigen::Quaternion<BenchT>(R);
+        next[i] = turn * gradients[i];
+    }
+    std::vector<Eigen::Quaternion<BenchT>> cache(previous);
+    int fallbacks = 0;
+    for(auto _ : state){
+        std::copy(previous.begin(), previous.end(), cache.begin());
+        for(unsigned int i = 0; i < next.size(); ++i){
+            fallbacks += !Access::warmStartRotation(solver, cache[i], R, next[i]);
+            benchmark::DoNotOptimize(R);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * gradients.size());
+    state.counters["fallbacks"] = benchmark::Counter(fallbacks, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_WarmStartRotation);
+
+static void BM_ComputeJFinvT(benchmark::State& state) {
+    FEMSolver<BenchT,benchDim>& solver = solverFor(10000);
+    const std::vector<Mat>& gradients = sampleGradients(4096);
+    Mat JFinvT;
+    for(auto _ : state){
+        for(const Mat& F : gradients){
+            Access::computeJFinvT(solver, JFinvT, F);
+            benchmark::DoNotOptimize(JFinvT);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * gradients.size());
+}
+BENCHMARK(BM_ComputeJFinvT);
+
+// one substep of elastic forces: zero, evaluate every element, scatter
+static void BM_ElementForces(benchmark::State& state) {
+    FEMSolver<BenchT,benchDim>& solver = solverFor(state.range(0));
+    TetraMesh<BenchT,benchDim>& mesh = Access::mesh(solver);
+    Mat G, F, R, S, JFinvT;
+    for(auto _ : state){
+        mesh.mParticles.zeroForces();
+        for(const Tetrahedron<BenchT,benchDim>& t : *mesh.mTetras){
+            Access::computeElementForce(solver, G, F, R, S, JFinvT, t);
+            for(int j = 0; j < benchDim; ++j){
+                mesh.mParticles.forces[t.mPIndices[j]] += G.col(j);
+            }
+            mesh.mParticles.forces[t.mPIndices[3]] -= G.col(0) + G.col(1) + G.col(2);
+        }
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * mesh.mTetras->size());
+    state.counters["tets"] = mesh.mTetras->size();
+}
+BENCHMARK(BM_ElementForces)->Apply(meshSizes);
+
+static void BM_ElementStiffness(benchmark::State& state) {
+    FEMSolver<BenchT,benchDim>& solver = solverFor(1000);
+    const std::vector<Tetrahedron<BenchT,benchDim>>& tetras = *Access::mesh(solver).mTetras;
+    const int count = 4;
+    Eigen::MatrixXf K(4 * benchDim, 4 * benchDim);
+    Mat G;
+    std::vector<Mat> F(count), R(count), S(count), JFinvT(count);
+    for(int i = 0; i < count; ++i){
+        Access::computeElementForce(solver, G, F[i], R[i], S[i], JFinvT[i], tetras[i]);
+    }
+    for(auto _ : state){
+        for(int i = 0; i < count; ++i){
+            Access::computeElementK(solver, K, tetras[i], F[i], JFinvT[i], R[i], S[i]);
+            benchmark::DoNotOptimize(K.data());
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_ElementStiffness)->Unit(benchmark::kMicrosecond);
+
+static void BM_ZeroForces(benchmark::State& state) {
+    Particles<BenchT,benchDim>& particles = Access::mesh(solverFor(state.range(0))).mParticles;
+    for(auto _ : state){
+        particles.zeroForces();
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * particles.forces.size());
+    state.SetBytesProcessed(state.iterations() * particles.forces.size() * sizeof(Vec));
+}
+BENCHMARK(BM_ZeroForces)->Apply(meshSizes);
+
+// the explicit integration loop of cookMyJello without collisions
+static void BM_ForwardEulerIntegrate(benchmark::State& state) {
+    Particles<BenchT,benchDim> particles = Access::mesh(solverFor(state.range(0))).mParticles;
+    ForwardEuler<BenchT,benchDim> integrator("explicit");
+    const int size = particles.positions.size();
+    for(auto _ : state){
+        for(int j = 0; j < size; ++j){
+            State<BenchT,benchDim> currState;
+            State<BenchT,benchDim> newState;
+            currState.mComponents[POS] = particles.positions[j];
+            currState.mComponents[VEL] = particles.velocities[j];
+            currState.mMass = particles.masses[j];
+            currState.mComponents[FOR] = particles.forces[j];
+            currState.mComponents[FOR][1] += -gravity * particles.masses[j];
+            integrator.integrate(1e-5, 0, currState, newState);
+            particles.positions[j] = newState.mComponents[POS];
+            particles.velocities[j] = newState.mComponents[VEL];
+        }
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * size);
+}
+BENCHMARK(BM_ForwardEulerIntegrate)->Apply(meshSizes);
+
+// Memory traffic of one explicit substep with the element forces already
+// evaluated, so the SVDs do not hide it. The scatter variant is the serial
+// loop: zero the forces, add every corner into them, integrate through State
+// copies. The gather variant is the task graph's: corner forces are summed
+// per particle in registers, integrated in place and stored once. bytes is
+// the modeled particle and corner array traffic of a substep.
+static void BM_SubstepMemory(benchmark::State& state, bool gather) {
+    FEMSolver<BenchT,benchDim>& solver = solverFor(state.range(0));
+    const std::vector<Tetrahedron<BenchT,benchDim>>& tetras = *Access::mesh(solver).mTetras;
+    const std::vector<int>& incidentStart = Access::mesh(solver).mAdjacency->vertexTetStart;
+    const std::vector<int>& incident = Access::mesh(solver).mAdjacency->vertexTets;
+    Particles<BenchT,benchDim> particles = Access::mesh(solver).mParticles;
+    const int size = particles.positions.size();
+    const int tets = tetras.size();
+    const int corners = benchDim + 1;
+    ForwardEuler<BenchT,benchDim> integrator("explicit");
+    const BenchT dt = 1e-9;
+
+    std::vector<Vec> cornerForces(corners * tets);
+    Mat G, F, R, S, JFinvT;
+    for(int n = 0; n < tets; ++n){
+        Access::computeElementForce(solver, G, F, R, S, JFinvT, tetras[n]);
+        for(int j = 0; j < benchDim; ++j){
+            cornerForces[corners * n + j] = G.col(j);
+        }
+        cornerForces[corners * n + benchDim] = -1.f * (G.col(0) + G.col(1) + G.col(2));
+    }
+
+    for(auto _ : state){
+        if(gather){
+            for(int j = 0; j < size; ++j){
+                Vec force = Vec::Zero();
+                for(int k = incidentStart[j]; k < incidentStart[j + 1]; ++k){
+                    force += cornerForces[incident[k]];
+                }
+                particles.forces[j] = force;
+                force[1] += -gravity * particles.masses[j];
+                integrator.integrate(dt, particles.masses[j], force, particles.positions[j], particles.velocities[j]);
+            }
+        }
+        else{
+            particles.zeroForces();
+            for(int n = 0; n < tets; ++n){
+                for(int k = 0; k < corners; ++k){
+                    particles.forces[tetras[n].mPIndices[k]] += cornerForces[corners * n + k];
+                }
+            }
+            for(int j = 0; j < size; ++j){
+                State<BenchT,benchDim> currState;
+                State<BenchT,benchDim> newState;
+                currState.mComponents[POS] = particles.positions[j];
+                currState.mComponents[VEL] = particles.velocities[j];
+                currState.mMass = particles.masses[j];
+                currState.mComponents[FOR] = particles.forces[j];
+                currState.mComponents[FOR][1] += -gravity * particles.masses[j];
+                integrator.integrate(dt, 0, currState, newState);
+                particles.positions[j] = newState.mComponents[POS];
+                particles.velocities[j] = newState.mComponents[VEL];
+            }
+        }
+        benchmark::ClobberMemory();
+    }
+
+    // particle arrays: x, v, f and m read, x, v and f written, plus the corner pass
+    const double vec = sizeof(Vec);
+    double bytes = 0;
+    if(gather){
+        bytes = size * (3 * vec + sizeof(BenchT) + 3 * vec) + corners * double(tets) * (vec + sizeof(int));
+    }
+    else{
+        bytes = size * vec + corners * double(tets) * (3 * vec + sizeof(int))
+                + size * (3 * vec + sizeof(BenchT) + 2 * vec);
+    }
+    state.SetItemsProcessed(state.iterations() * size);
+    state.SetBytesProcessed(state.iterations() * bytes);
+    state.counters["bytes"] = bytes;
+}
+BENCHMARK_CAPTURE(BM_SubstepMemory, scatter, false)->Apply(meshSizes);
+BENCHMARK_CAPTURE(BM_SubstepMemory, gather, true)->Apply(meshSizes);
+
+static void BM_CheckCollisions(benchmark::State& state, const std::string& sceneName) {
+    FEMSolver<BenchT,benchDim>& solver = solverFor(state.range(0), sceneName);
+    const Scene<BenchT,benchDim>& scene = Access::scene(solver);
+    const std::vector<Vec>& positions = Access::mesh(solver).mParticles.positions;
+    Vec out;
+    for(auto _ : state){
+        int hits = 0;
+        for(const Vec& x : positions){
+            hits += scene.checkCollisions(x, out);
+        }
+        benchmark::DoNotOptimize(hits);
+    }
+    state.SetItemsProcessed(state.iterations() * positions.size());
+}
+BENCHMARK_CAPTURE(BM_CheckCollisions, default, std::string("default"))->Apply(meshSizes);
+BENCHMARK_CAPTURE(BM_CheckCollisions, plinko, std::string("plinko"))->Apply(meshSizes);
+
+static void BM_TetgenLoad(benchmark::State& state) {
+    const std::string basename = scratchDirectory() + "/box" + std::to_string(state.range(0));
+    writeTetgen(Access::mesh(solverFor(state.range(0))), basename);
+    int tets = 0;
+    for(auto _ : state){
+        TetraMesh<BenchT,benchDim> mesh(basename);
+        mesh.generateTetras();
+        tets = mesh.mTetras->size();
+    }
+    state.SetItemsProcessed(state.iterations() * tets);
+}
+BENCHMARK(BM_TetgenLoad)->Apply(meshSizes);
+
+static void BM_OutputFrame(benchmark::State& state) {
+    TetraMesh<BenchT,benchDim>& mesh = Access::mesh(solverFor(state.range(0)));
+    const std::string directory = scratchDirectory();
+    for(auto _ : state){
+        mesh.outputFrame(1, directory);
+    }
+    state.SetItemsProcessed(state.iterations() * mesh.mParticles.positions.size());
+}
+BENCHMARK(BM_OutputFrame)->Apply(meshSizes);
+
+BENCHMARK_MAIN();
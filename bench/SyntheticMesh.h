@@ -0,0 +1,87 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../mesh/TetraMesh.h"
+
+// Structured box meshes for benchmarking: an n x n x n grid of cells over
+// [-1,1]^3 from TetraMesh::generateBox, each cell split into 5 tetrahedra.
+
+// number of cells per side giving roughly the requested tetrahedron count
+inline int boxCellsForTets(int tets) {
+    return std::max(1, int(std::round(std::cbrt(tets / 5.0))));
+}
+
+template<class T, int dim>
+void buildBoxMesh(TetraMesh<T,dim>& mesh, int n) {
+    mesh.generateBox(Eigen::Vector3i(n, n, n), Eigen::Matrix<T,dim,1>::Constant(-1), Eigen::Matrix<T,dim,1>::Constant(1), 5, 0, 1);
+}
+
+// applies a fixed stretch and shear plus per-vertex noise so deformation gradients are not the identity
+template<class T, int dim>
+void deformMesh(TetraMesh<T,dim>& mesh, T noise, unsigned int seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<T> uniform(-noise, noise);
+    Eigen::Matrix<T,dim,dim> A;
+    A << 1.1, 0.05, 0.0,
+         -0.03, 0.9, 0.02,
+         0.0, 0.04, 1.05;
+    for(Eigen::Matrix<T,dim,1>& x : mesh.mParticles.positions){
+        x = A * x + Eigen::Matrix<T,dim,1>(uniform(rng), uniform(rng), uniform(rng));
+    }
+}
+
+// writes basename.node/.ele/.face in the layout TetraMesh::generateTetras reads
+template<class T, int dim>
+bool writeTetgen(const TetraMesh<T,dim>& mesh, const std::string& basename) {
+    std::ofstream node(basename + ".node");
+    std::ofstream ele(basename + ".ele");
+    std::ofstream face(basename + ".face");
+    if(!node || !ele || !face){
+        return false;
+    }
+
+    const std::vector<Eigen::Matrix<T,dim,1>>& x = mesh.mParticles.positions;
+    node << x.size() << "  3  0  0\n";
+    for(unsigned int i = 0; i < x.size(); ++i){
+        // tetgen is left-handed, the reader negates z
+        node << i + 1 << " " << x[i][0] << " " << x[i][1] << " " << -x[i][2] << "\n";
+    }
+
+    // boundary faces are the ones referenced by a single tetrahedron
+    std::vector<std::array<int,4>> faces;
+    faces.reserve(4 * mesh.mTetras->size());
+    ele << mesh.mTetras->size() << "  4  0\n";
+    for(unsigned int n = 0; n < mesh.mTetras->size(); ++n){
+        const std::vector<int>& p = (*mesh.mTetras)[n].mPIndices;
+        ele << n + 1 << " " << p[0] + 1 << " " << p[1] + 1 << " " << p[2] + 1 << " " << p[3] + 1 << "\n";
+        for(int f = 0; f < 4; ++f){
+            std::array<int,4> key = {{p[(f + 1) % 4], p[(f + 2) % 4], p[(f + 3) % 4], 0}};
+            std::sort(key.begin(), key.begin() + 3);
+            faces.push_back(key);
+        }
+    }
+    std::sort(faces.begin(), faces.end());
+    std::vector<std::array<int,4>> boundary;
+    for(unsigned int i = 0; i < faces.size(); ){
+        unsigned int j = i + 1;
+        while(j < faces.size() && faces[j] == faces[i]){
+            ++j;
+        }
+        if(j - i == 1){
+            boundary.push_back(faces[i]);
+        }
+        i = j;
+    }
+    face << boundary.size() << "  1\n";
+    for(unsigned int i = 0; i < boundary.size(); ++i){
+        face << i + 1 << " " << boundary[i][0] + 1 << " " << boundary[i][1] + 1 << " " << boundary[i][2] + 1 << " 1\n";
+    }
+    return true;
+}
@@ -12,6 +12,10 @@ public:
 
     virtual void integrate(T timeStep, int params, const State<T, dim> &currentState, State<T, dim> &newState);
 
+    // same update in place on one particle, without building States
+    void integrate(T timeStep, T mass, const Eigen::Matrix<T, dim, 1> &force,
+                   Eigen::Matrix<T, dim, 1> &position, Eigen::Matrix<T, dim, 1> &velocity) const;
+
 };
 
 
@@ -40,3 +44,12 @@ void ForwardEuler<T, dim>::integrate(T timeStep, int params, const State<T, dim>
 
     newState.mMass = currentState.mMass;
 }
+
+template<class T, int dim>
+void ForwardEuler<T, dim>::integrate(T timeStep, T mass, const Eigen::Matrix<T, dim, 1> &force,
+                                     Eigen::Matrix<T, dim, 1> &position, Eigen::Matrix<T, dim, 1> &velocity) const {
+
+    const Eigen::Matrix<T, dim, 1> acceleration = force * (1.f / mass);
+    position = position + velocity * timeStep;
+    velocity = velocity + acceleration * timeStep;
+}
@@ -0,0 +1,192 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+#include <Eigen/SparseCholesky>
+
+#include "ReducedBody.h"
+#include "../utility/FileHelper.h"
+
+// Linear modal reduction about the rest shape. The basis U of a ReducedBody
+// holds the lowest modes of the generalized eigenproblem K u = omega^2 M u for
+// the rest stiffness K and the lumped masses M, mass normalized so that
+// U^T M U = I. The rigid modes are dropped; the body's rigid motion is the
+// translation of its center of mass, and every q_i is an undamped oscillator
+// advanced exactly, so a step is stable for any dt and costs one dense multiply
+// by U. Rotation is not represented, the body wobbles and translates but does
+// not tumble.
+//
+// Basis file layout (native endianness):
+//   header    FileHelper::Header, counts numParticles, numModes
+//   scalars   frequencies, basis (dim numParticles x numModes, column major)
+template<class T, int dim>
+class ModalReduction {
+public:
+    typedef Eigen::Matrix<T,dim,1> Vec;
+    typedef Eigen::Matrix<T,Eigen::Dynamic,1> Vector;
+    typedef Eigen::Matrix<T,Eigen::Dynamic,Eigen::Dynamic> Matrix;
+
+    static const int VERSION = 2;
+
+    ModalReduction();
+
+    // the lowest elastic modes of the stiffness (positive semidefinite, dim n x dim n) and the
+    // lumped masses by shift-invert subspace iteration, false if the iteration breaks down
+    bool compute(const Eigen::SparseMatrix<T>& stiffness, const std::vector<T>& masses, int modes);
+    // false on a missing file or one written for another key or particle count
+    bool read(const std::string& path, uint64_t key, int numParticles);
+    // writes through FileHelper::writeAtomic
+    bool write(const std::string& path, uint64_t key) const;
+
+    // free flight of the center of mass and timeStep of every oscillator
+    void advance(T timeStep, const Vec& gravity);
+
+    ReducedBody<T,dim>& body() { return mBody; }
+    int numModes() const { return mFrequencies.size(); }
+    T frequency(int i) const { return mFrequencies[i]; }      // omega in rad/s
+
+private:
+    static const char* magic() { return "FEMMODES"; }
+
+    ReducedBody<T,dim> mBody;       // the modes are its basis
+    Vector mFrequencies;
+};
+
+template<class T, int dim>
+ModalReduction<T,dim>::ModalReduction() {}
+
+template<class T, int dim>
+bool ModalReduction<T,dim>::compute(const Eigen::SparseMatrix<T>& stiffness, const std::vector<T>& masses, int modes) {
+    const int size = stiffness.rows();
+    Vector mass(size);
+    for(int i = 0; i < size; ++i){
+        mass[i] = masses[i / dim];
+    }
+    // a free body has dim (dim + 1) / 2 rigid modes at zero, the subspace carries a few spare columns
+    const int wanted = std::min(size, modes + dim * (dim + 1) / 2);
+    const int columns = std::min(size, wanted + std::max(wanted, 8));
+
+    // shifted below zero so that K + sigma M is positive definite despite the rigid modes
+    const T scale = stiffness.diagonal().sum() / mass.sum();
+    const T sigma = T(1e-6) * scale;
+    Eigen::SparseMatrix<T> shifted = stiffness;
+    for(int i = 0; i < size; ++i){
+        shifted.coeffRef(i, i) += sigma * mass[i];
+    }
+    Eigen::SimplicialLDLT<Eigen::SparseMatrix<T>> solver(shifted);
+    if(solver.info() != Eigen::Success){
+        std::cout << "error: modal analysis cannot factor the rest stiffness" << std::endl;
+        return false;
+    }
+
+    Matrix X = Matrix::Random(size, columns);
+    Vector eigenvalues = Vector::Zero(columns);
+    int iteration = 0;
+    for(bool converged = false; !converged && iteration < 100; ++iteration){
+        // one inverse iteration on every column, then Rayleigh-Ritz in their span
+        Matrix Y = solver.solve(mass.asDiagonal() * X);
+        Matrix KY = stiffness * Y;
+        Matrix reducedK = Y.transpose() * KY;
+        Matrix reducedM = Y.transpose() * mass.asDiagonal() * Y;
+        reducedK = T(0.5) * (reducedK + reducedK.transpose()).eval();
+        reducedM = T(0.5) * (reducedM + reducedM.transpose()).eval();
+        Eigen::GeneralizedSelfAdjointEigenSolver<Matrix> ritz(reducedK, reducedM);
+        if(ritz.info() != Eigen::Success){
+            std::cout << "error: modal analysis lost the rank of its subspace" << std::endl;
+            return false;
+        }
+        X = Y * ritz.eigenvectors();
+        const Vector& values = ritz.eigenvalues();
+        T change = (values.head(wanted) - eigenvalues.head(wanted)).cwiseAbs().maxCoeff();
+        converged = change <= T(1e-10) * values[wanted - 1];
+        eigenvalues = values;
+    }
+
+    // the rigid modes are numerically zero next to the elastic ones
+    std::vector<int> elastic;
+    for(int k = 0; k < wanted && int(elastic.size()) < modes; ++k){
+        if(eigenvalues[k] > T(1e-6) * eigenvalues[wanted - 1]){
+            elastic.push_back(k);
+        }
+    }
+    if(int(elastic.size()) < modes){
+        std::cout << "modal analysis found " << elastic.size() << " of " << modes
+                  << " elastic modes, the mesh has more than one rigid body" << std::endl;
+    }
+    Matrix& basis = mBody.basis();
+    basis.resize(size, elastic.size());
+    mFrequencies.resize(elastic.size());
+    for(unsigned int k = 0; k < elastic.size(); ++k){
+        basis.col(k) = X.col(elastic[k]);
+        mFrequencies[k] = std::sqrt(eigenvalues[elastic[k]]);
+    }
+    std::cout << "modal analysis " << iteration << " iterations, " << numModes() << " modes";
+    if(numModes() > 0){
+        std::cout << " from " << mFrequencies[0] / (2 * M_PI) << " to "
+                  << mFrequencies[numModes() - 1] / (2 * M_PI) << " Hz";
+    }
+    std::cout << std::endl;
+    return true;
+}
+
+template<class T, int dim>
+bool ModalReduction<T,dim>::read(const std::string& path, uint64_t key, int numParticles) {
+    std::ifstream in(path, std::ios::binary);
+    if(!in){
+        return false;
+    }
+    FileHelper::Header header;
+    if(!FileHelper::readHeader(in, header) || !FileHelper::matchHeader(header, FileHelper::makeHeader(magic(), VERSION, sizeof(T), dim, key))
+       || header.counts[0] != numParticles || header.counts[1] < 0){
+        std::cout << "ignoring stale modal basis " << path << std::endl;
+        return false;
+    }
+    mFrequencies.resize(header.counts[1]);
+    mBody.basis().resize(dim * numParticles, header.counts[1]);
+    in.read(reinterpret_cast<char*>(mFrequencies.data()), sizeof(T) * mFrequencies.size());
+    in.read(reinterpret_cast<char*>(mBody.basis().data()), sizeof(T) * mBody.basis().size());
+    if(!in){
+        std::cout << "error: truncated modal basis " << path << std::endl;
+        mFrequencies.resize(0);
+        mBody.basis().resize(0, 0);
+        return false;
+    }
+    return true;
+}
+
+template<class T, int dim>
+bool ModalReduction<T,dim>::write(const std::string& path, uint64_t key) const {
+    FileHelper::Header header = FileHelper::makeHeader(magic(), VERSION, sizeof(T), dim, key);
+    header.counts[0] = mBody.basis().rows() / dim;
+    header.counts[1] = mBody.basis().cols();
+    return FileHelper::writeAtomic(path, "modal basis", [&](std::ofstream& out){
+        FileHelper::writeHeader(out, header);
+        out.write(reinterpret_cast<const char*>(mFrequencies.data()), sizeof(T) * mFrequencies.size());
+        out.write(reinterpret_cast<const char*>(mBody.basis().data()), sizeof(T) * mBody.basis().size());
+    });
+}
+
+template<class T, int dim>
+void ModalReduction<T,dim>::advance(T timeStep, const Vec& gravity) {
+    // the modes are mass orthogonal to translations, gravity only moves the center
+    mBody.translate(timeStep, gravity);
+    Vector& amplitudes = mBody.coordinates();
+    Vector& rates = mBody.rates();
+    for(int k = 0; k < numModes(); ++k){
+        const T omega = mFrequencies[k];
+        const T c = std::cos(omega * timeStep);
+        const T s = std::sin(omega * timeStep);
+        const T q = amplitudes[k];
+        amplitudes[k] = c * q + s / omega * rates[k];
+        rates[k] = c * rates[k] - omega * s * q;
+    }
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "../mesh/Tetrahedron.h"
+
+// Power of two time levels for multirate explicit integration. A tetrahedron is
+// on the coarsest level l that satisfies timeStep / 2^l <= courant *
+// stableTimeStep, up to maxLevels - 1; a particle is on the finest level of its
+// tetrahedra, and a tetrahedron is evaluated whenever one of its corners is
+// updated. A step of timeStep runs substeps() fine substeps, and after substep k
+// (1 based) the particles on level activeLevel(k) and finer are updated by
+// timeStep / 2^level. Particles and tetrahedra are sorted finest level first, so
+// those updated after a substep are a prefix of particles() and tets().
+template<class T, int dim>
+class Multirate {
+public:
+    Multirate();
+
+    void build(const std::vector<Tetrahedron<T,dim>>& tetras, int numParticles, T mu, T lambda, T timeStep,
+               T courant, int maxLevels);
+
+    int numLevels() const { return mParticleCount.size() - 1; }
+    int substeps() const { return 1 << (numLevels() - 1); }
+    // coarsest level updated after substep k, 0 after the last one
+    int activeLevel(int k) const;
+    int particleLevel(int j) const { return mParticleLevel[j]; }
+    T levelTimeStep(int level) const { return mTimeStep / (1 << level); }
+
+    const std::vector<int>& particles() const { return mParticles; }
+    const std::vector<int>& tets() const { return mTets; }
+    // particles and tetrahedra updated with level and finer
+    int numParticles(int level) const { return mParticleCount[level]; }
+    int numTets(int level) const { return mTetCount[level]; }
+    // tetrahedra whose stable step is below the finest level's
+    int numUnstable() const { return mUnstable; }
+
+    // tetrahedron evaluations of a step relative to evaluating all of them every fine substep
+    T speedup() const;
+
+private:
+    T mTimeStep;
+    std::vector<int> mParticleLevel;
+    std::vector<int> mParticles;
+    std::vector<int> mTets;
+    std::vector<int> mParticleCount;        // numLevels + 1 entries, counts of level >= l, then 0
+    std::vector<int> mTetCount;
+    int mUnstable;
+};
+
+template<class T, int dim>
+Multirate<T,dim>::Multirate() : mTimeStep(0), mParticleCount(2, 0), mTetCount(2, 0), mUnstable(0) {}
+
+template<class T, int dim>
+void Multirate<T,dim>::build(const std::vector<Tetrahedron<T,dim>>& tetras, int numParticles, T mu, T lambda,
+                             T timeStep, T courant, int maxLevels) {
+    const int numTets = tetras.size();
+    mTimeStep = timeStep;
+    mUnstable = 0;
+
+    std::vector<int> tetLevel(numTets, 0);
+    for(int n = 0; n < numTets; ++n){
+        // within rounding, a mass scaled tetrahedron sits exactly at its target step
+        const T stable = courant * tetras[n].stableTimeStep(mu, lambda) * T(1 + 1e-9);
+        int level = 0;
+        while(level < maxLevels - 1 && levelTimeStep(level) > stable){
+            ++level;
+        }
+        if(levelTimeStep(level) > stable){
+            ++mUnstable;
+        }
+        tetLevel[n] = level;
+    }
+
+    // particles take the finest level around them, tetrahedra are evaluated at their finest corner's
+    mParticleLevel.assign(numParticles, 0);
+    for(int n = 0; n < numTets; ++n){
+        for(int k = 0; k < dim + 1; ++k){
+            int& level = mParticleLevel[tetras[n].mPIndices[k]];
+            level = std::max(level, tetLevel[n]);
+        }
+    }
+    int levels = 1;
+    for(int n = 0; n < numTets; ++n){
+        for(int k = 0; k < dim + 1; ++k){
+            tetLevel[n] = std::max(tetLevel[n], mParticleLevel[tetras[n].mPIndices[k]]);
+        }
+        levels = std::max(levels, tetLevel[n] + 1);
+    }
+
+    // finest first, by index within a level
+    mParticles.resize(numParticles);
+    mTets.resize(numTets);
+    for(int j = 0; j < numParticles; ++j){
+        mParticles[j] = j;
+    }
+    for(int n = 0; n < numTets; ++n){
+        mTets[n] = n;
+    }
+    std::stable_sort(mParticles.begin(), mParticles.end(),
+                     [this](int a, int b){ return mParticleLevel[a] > mParticleLevel[b]; });
+    std::stable_sort(mTets.begin(), mTets.end(), [&tetLevel](int a, int b){ return tetLevel[a] > tetLevel[b]; });
+
+    mParticleCount.assign(levels + 1, 0);
+    mTetCount.assign(levels + 1, 0);
+    for(int j = 0; j < numParticles; ++j){
+        for(int l = 0; l <= mParticleLevel[j]; ++l){
+            ++mParticleCount[l];
+        }
+    }
+    for(int n = 0; n < numTets; ++n){
+        for(int l = 0; l <= tetLevel[n]; ++l){
+            ++mTetCount[l];
+        }
+    }
+}
+
+template<class T, int dim>
+int Multirate<T,dim>::activeLevel(int k) const {
+    // a level l particle is updated every 2^(numLevels - 1 - l) substeps
+    int level = numLevels() - 1;
+    while(level > 0 && k % 2 == 0){
+        k /= 2;
+        --level;
+    }
+    return level;
+}
+
+template<class T, int dim>
+T Multirate<T,dim>::speedup() const {
+    double evaluations = 0;
+    for(int k = 1; k <= substeps(); ++k){
+        evaluations += numTets(activeLevel(k));
+    }
+    return evaluations > 0 ? T(double(numTets(0)) * substeps() / evaluations) : T(1);
+}
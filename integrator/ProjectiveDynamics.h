@@ -0,0 +1,118 @@
+#pragma once
+
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+#include <Eigen/SparseCholesky>
+
+#include "../mesh/TetraMesh.h"
+
+// Projective Dynamics for the corotated term mu |F - R|^2 of each tetrahedron.
+// With A the linear map from a tetrahedron's vertices to F = Ds DmInv and
+// w = 2 mu volume, the global matrix M / dt^2 + sum w A^T A acts the same on
+// every coordinate and depends only on the rest shape, so it is one scalar
+// matrix per particle pair, assembled and factored once with a sparse Cholesky.
+// An iteration is a local step, the rotation R of each F from computeRS, and a
+// global step, one back-substitution per coordinate with sum w A^T R on the
+// right-hand side. The volume term lambda (J - 1)^2 has no such projection and
+// is not part of the energy.
+template<class T, int dim>
+class ProjectiveDynamics {
+public:
+    typedef Eigen::Matrix<T,dim,1> Vec;
+    typedef Eigen::Matrix<T,dim,dim> Mat;
+
+    ProjectiveDynamics();
+
+    // builds and factors the system for the mesh's rest shape, false if the factorization fails
+    bool precompute(const TetraMesh<T,dim>& mesh, T mu, T timeStep);
+
+    // x minimizing |M^1/2 (x - inertial)|^2 / dt^2 + sum w |F(x) - R|^2 for fixed rotations,
+    // inertial is the free flight position x + dt v + dt^2 g
+    void globalStep(const TetraMesh<T,dim>& mesh, const std::vector<Vec>& inertial,
+                    const std::vector<Mat>& rotations, std::vector<Vec>& x);
+
+    int nonZeros() const { return mNonZeros; }
+
+private:
+    std::vector<T> mWeights;                    // 2 mu volume per tetrahedron
+    std::vector<T> mInertia;                    // mass / dt^2 per particle
+    int mNonZeros;
+    Eigen::SimplicialLDLT<Eigen::SparseMatrix<T>> mSolver;
+    Eigen::Matrix<T,Eigen::Dynamic,dim> mRhs;   // one column per coordinate
+    Eigen::Matrix<T,Eigen::Dynamic,dim> mSolution;
+};
+
+template<class T, int dim>
+ProjectiveDynamics<T,dim>::ProjectiveDynamics() : mNonZeros(0) {}
+
+template<class T, int dim>
+bool ProjectiveDynamics<T,dim>::precompute(const TetraMesh<T,dim>& mesh, T mu, T timeStep) {
+    const std::vector<Tetrahedron<T,dim>>& tetras = *mesh.mTetras;
+    const Particles<T,dim>& particles = mesh.mParticles;
+    const int numParticles = particles.positions.size();
+    const int numTets = tetras.size();
+
+    mInertia.resize(numParticles);
+    std::vector<Eigen::Triplet<T>> entries;
+    entries.reserve(numParticles + (dim + 1) * (dim + 1) * numTets);
+    for(int i = 0; i < numParticles; ++i){
+        mInertia[i] = particles.masses[i] / (timeStep * timeStep);
+        entries.push_back(Eigen::Triplet<T>(i, i, mInertia[i]));
+    }
+    mWeights.resize(numTets);
+    for(int n = 0; n < numTets; ++n){
+        const Tetrahedron<T,dim>& t = tetras[n];
+        mWeights[n] = 2 * mu * t.volume;
+        Vec c[dim + 1];
+        for(int k = 0; k < dim + 1; ++k){
+            c[k] = t.corner(k);
+        }
+        for(int a = 0; a < dim + 1; ++a){
+            for(int b = 0; b < dim + 1; ++b){
+                entries.push_back(Eigen::Triplet<T>(t.mPIndices[a], t.mPIndices[b], mWeights[n] * c[a].dot(c[b])));
+            }
+        }
+    }
+
+    // duplicate entries are summed
+    Eigen::SparseMatrix<T> system(numParticles, numParticles);
+    system.setFromTriplets(entries.begin(), entries.end());
+    mNonZeros = system.nonZeros();
+    mSolver.compute(system);
+    if(mSolver.info() != Eigen::Success){
+        std::cout << "error: projective dynamics system is not positive definite" << std::endl;
+        return false;
+    }
+    mRhs.resize(numParticles, dim);
+    mSolution.resize(numParticles, dim);
+    return true;
+}
+
+template<class T, int dim>
+void ProjectiveDynamics<T,dim>::globalStep(const TetraMesh<T,dim>& mesh, const std::vector<Vec>& inertial,
+                                           const std::vector<Mat>& rotations, std::vector<Vec>& x) {
+    const std::vector<Tetrahedron<T,dim>>& tetras = *mesh.mTetras;
+    const TetAdjacency<T,dim>& adjacency = *mesh.mAdjacency;
+    const int numParticles = x.size();
+
+    // rhs = M / dt^2 inertial + sum w A^T R, gathered per particle
+    #pragma omp parallel for
+    for(int i = 0; i < numParticles; ++i){
+        Vec b = mInertia[i] * inertial[i];
+        for(int k = adjacency.vertexTetStart[i]; k < adjacency.vertexTetStart[i + 1]; ++k){
+            const int n = adjacency.vertexTets[k] / (dim + 1);
+            b += mWeights[n] * (rotations[n] * tetras[n].corner(adjacency.vertexTets[k] % (dim + 1)));
+        }
+        mRhs.row(i) = b.transpose();
+    }
+
+    mSolution = mSolver.solve(mRhs);
+
+    #pragma omp parallel for
+    for(int i = 0; i < numParticles; ++i){
+        x[i] = mSolution.row(i).transpose();
+    }
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/Dense>
+
+#include "../mesh/Particles.h"
+
+// A body whose particles move as x_i = center + rest_i + U_i q: the translation
+// of the center of mass and coordinates q in a basis U that is mass orthonormal
+// (U^T M U = I) and mass orthogonal to translations, so that gravity and the
+// center of mass only act on the center. Shared by the reduced integrators,
+// which advance q; collisions and output go through the full particles.
+template<class T, int dim>
+class ReducedBody {
+public:
+    typedef Eigen::Matrix<T,dim,1> Vec;
+    typedef Eigen::Matrix<T,Eigen::Dynamic,1> Vector;
+    typedef Eigen::Matrix<T,Eigen::Dynamic,Eigen::Dynamic> Matrix;
+
+    ReducedBody();
+
+    Matrix& basis() { return mBasis; }                  // dim n x r
+    const Matrix& basis() const { return mBasis; }
+    int size() const { return mBasis.cols(); }
+
+    // the state of the particles relative to the rest shape, projected on the basis: q = U^T M (x - center - rest),
+    // so a run started from a checkpoint keeps its deformation, and dq/dt = U^T M (v - center velocity)
+    void start(const Particles<T,dim>& particles, const std::vector<Vec>& rest);
+    // free flight of the center of mass
+    void translate(T timeStep, const Vec& gravity);
+    // positions and velocities of every particle, rest + center + U q and center velocity + U dq/dt
+    void reconstruct(std::vector<Vec>& positions, std::vector<Vec>& velocities) const;
+    // contacts of the given vertices along their unit normals, out of the colliders, as reduced
+    // impulses: a vertex impulse n p changes the center velocity by n p / total mass and dq/dt by
+    // U_i^T n p. Sequential impulse sweeps stop the vertices from moving into the colliders, then
+    // sweeps of the same form on the state move them out by their depths without changing the rates
+    void resolveContacts(const std::vector<int>& vertices, const std::vector<Vec>& normals,
+                         const std::vector<T>& depths);
+
+    Vector& coordinates() { return mCoordinates; }      // q
+    Vector& rates() { return mRates; }                  // dq/dt
+    // rest position of particle i relative to the rest center of mass
+    Vec rest(int i) const { return mRest.template segment<dim>(dim * i); }
+
+private:
+    static const int CONTACT_SWEEPS = 20;
+
+    Matrix mBasis;
+    std::vector<T> mMasses;
+    T mTotalMass;
+    Vector mRest;
+    Vec mCenter;
+    Vec mCenterVelocity;
+    Vector mCoordinates;
+    Vector mRates;
+};
+
+template<class T, int dim>
+ReducedBody<T,dim>::ReducedBody() : mTotalMass(0), mCenter(Vec::Zero()), mCenterVelocity(Vec::Zero()) {}
+
+template<class T, int dim>
+void ReducedBody<T,dim>::start(const Particles<T,dim>& particles, const std::vector<Vec>& rest) {
+    const int numParticles = particles.positions.size();
+    mMasses = particles.masses;
+    mTotalMass = 0;
+    mCenter.setZero();
+    mCenterVelocity.setZero();
+    Vec restCenter = Vec::Zero();
+    for(int i = 0; i < numParticles; ++i){
+        mTotalMass += mMasses[i];
+        mCenter += mMasses[i] * particles.positions[i];
+        mCenterVelocity += mMasses[i] * particles.velocities[i];
+        restCenter += mMasses[i] * rest[i];
+    }
+    mCenter /= mTotalMass;
+    mCenterVelocity /= mTotalMass;
+    restCenter /= mTotalMass;
+
+    // the basis is mass orthonormal, so U^T M projects displacements and velocities on it
+    mRest.resize(dim * numParticles);
+    Vector displacements(dim * numParticles);
+    Vector velocities(dim * numParticles);
+    for(int i = 0; i < numParticles; ++i){
+        mRest.template segment<dim>(dim * i) = rest[i] - restCenter;
+        displacements.template segment<dim>(dim * i) = mMasses[i] * (particles.positions[i] - mCenter - (rest[i] - restCenter));
+        velocities.template segment<dim>(dim * i) = mMasses[i] * (particles.velocities[i] - mCenterVelocity);
+    }
+    mCoordinates = mBasis.transpose() * displacements;
+    mRates = mBasis.transpose() * velocities;
+}
+
+template<class T, int dim>
+void ReducedBody<T,dim>::translate(T timeStep, const Vec& gravity) {
+    mCenterVelocity += timeStep * gravity;
+    mCenter += timeStep * mCenterVelocity;
+}
+
+template<class T, int dim>
+void ReducedBody<T,dim>::reconstruct(std::vector<Vec>& positions, std::vector<Vec>& velocities) const {
+    const Vector displacements = mBasis * mCoordinates;
+    const Vector rates = mBasis * mRates;
+    #pragma omp parallel for
+    for(int i = 0; i < int(positions.size()); ++i){
+        positions[i] = mCenter + mRest.template segment<dim>(dim * i) + displacements.template segment<dim>(dim * i);
+        velocities[i] = mCenterVelocity + rates.template segment<dim>(dim * i);
+    }
+}
+
+template<class T, int dim>
+void ReducedBody<T,dim>::resolveContacts(const std::vector<int>& vertices, const std::vector<Vec>& normals,
+                                         const std::vector<T>& depths) {
+    // a contact only stops the vertices it touches, the rest of the body keeps moving and the
+    // difference goes into the modes; impulses only push, so they never add kinetic energy
+    const int contacts = vertices.size();
+    Matrix directions(size(), contacts);                    // U_i^T n of every contact
+    std::vector<T> compliance(contacts);                    // normal velocity change per unit impulse
+    for(int k = 0; k < contacts; ++k){
+        directions.col(k) = mBasis.middleRows(dim * vertices[k], dim).transpose() * normals[k];
+        compliance[k] = 1 / mTotalMass + directions.col(k).squaredNorm();
+    }
+
+    std::vector<T> impulses(contacts, 0);
+    for(int sweep = 0; sweep < CONTACT_SWEEPS; ++sweep){
+        for(int k = 0; k < contacts; ++k){
+            const T approach = normals[k].dot(mCenterVelocity) + directions.col(k).dot(mRates);
+            const T impulse = std::max(T(0), impulses[k] - approach / compliance[k]);
+            const T change = impulse - impulses[k];
+            impulses[k] = impulse;
+            mCenterVelocity += (change / mTotalMass) * normals[k];
+            mRates += change * directions.col(k);
+        }
+    }
+
+    // the same sweeps on positions, separate from the rates so that resolving a penetration adds no velocity
+    Vec center = Vec::Zero();
+    Vector coordinates = Vector::Zero(size());
+    std::fill(impulses.begin(), impulses.end(), T(0));
+    for(int sweep = 0; sweep < CONTACT_SWEEPS; ++sweep){
+        for(int k = 0; k < contacts; ++k){
+            const T moved = normals[k].dot(center) + directions.col(k).dot(coordinates);
+            const T impulse = std::max(T(0), impulses[k] + (depths[k] - moved) / compliance[k]);
+            const T change = impulse - impulses[k];
+            impulses[k] = impulse;
+            center += (change / mTotalMass) * normals[k];
+            coordinates += change * directions.col(k);
+        }
+    }
+    mCenter += center;
+    mCoordinates += coordinates;
+}
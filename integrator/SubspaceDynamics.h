@@ -0,0 +1,442 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/Dense>
+
+#include "../mesh/Tetrahedron.h"
+#include "ReducedBody.h"
+#include "../utility/FileHelper.h"
+
+// Nonlinear reduced simulation in a basis trained from simulation snapshots,
+// after An, Kim and James, "Optimizing Cubature for Efficient Integration of
+// Subspace Deformations". The basis holds the mass weighted principal components
+// of the snapshots' displacements from rest with their center of mass
+// translation removed, so it is a ReducedBody basis. The reduced force U^T f(x)
+// is approximated by a few cubature tetrahedra, sum w_e U_e^T f_e(x_e), with
+// weights fit by nonnegative least squares to the exact reduced forces of the
+// training poses. A step is linearly implicit backward Euler on q with the
+// reduced tangent sum w_e U_e^T K_e U_e of the same tetrahedra, so it costs one
+// cubature pass and an r x r solve however large the mesh is.
+//
+// File layout (native endianness):
+//   header    FileHelper::Header, counts numParticles, size, numCubature
+//   scalars   basis (dim numParticles x size, column major), cubature weights
+//   integers  cubature tetrahedra
+template<class T, int dim>
+class SubspaceDynamics {
+public:
+    typedef Eigen::Matrix<T,dim,1> Vec;
+    typedef Eigen::Matrix<T,dim,dim> Mat;
+    typedef Eigen::Matrix<T,Eigen::Dynamic,1> Vector;
+    typedef Eigen::Matrix<T,Eigen::Dynamic,Eigen::Dynamic> Matrix;
+
+    static const int VERSION = 2;
+
+    SubspaceDynamics();
+
+    // the size principal components of the snapshots' displacements from rest,
+    // returns the fraction of the displacements' mass weighted energy they keep
+    T buildBasis(const std::vector<std::vector<Vec>>& snapshots, const std::vector<Vec>& rest,
+                 const std::vector<T>& masses, int size);
+    // greedy cubature of at most count tetrahedra for the reduced forces of the snapshots projected
+    // into the basis, returns the relative error of the fit. elementForce(n, x, G, K) is the force
+    // matrix G of tetrahedron n with its corners at x[0..dim], column j the force on corner j
+    // and minus their sum the force on corner dim, and unless K is null the force Jacobian K
+    // (dim (dim + 1) square, corner major) the step linearizes with
+    template<class ElementForce>
+    T buildCubature(const std::vector<std::vector<Vec>>& snapshots, const std::vector<Vec>& rest,
+                    const std::vector<T>& masses, const std::vector<Tetrahedron<T,dim>>& tetras, int count,
+                    ElementForce elementForce);
+
+    // false on a missing file or one written for another key or particle count
+    bool read(const std::string& path, uint64_t key, int numParticles);
+    // writes through FileHelper::writeAtomic
+    bool write(const std::string& path, uint64_t key) const;
+
+    // free flight of the center of mass and one linearly implicit step of q
+    template<class ElementForce>
+    void advance(T timeStep, const Vec& gravity, const std::vector<Tetrahedron<T,dim>>& tetras,
+                 ElementForce elementForce);
+
+    ReducedBody<T,dim>& body() { return mBody; }
+    int size() const { return mBody.size(); }
+    int numCubature() const { return mCubature.size(); }
+
+private:
+    static const char* magic() { return "FEMSUBSP"; }
+
+    // U_e^T f_e of tetrahedron n with corners at rest + U q times weight, added to force, and
+    // unless stiffness is null U_e^T K_e U_e times weight, added to stiffness
+    template<class ElementForce>
+    void addElementForce(int n, const Tetrahedron<T,dim>& t, const std::vector<Vec>& rest, const Vector& q,
+                         ElementForce& elementForce, T weight, Vector& force, Matrix* stiffness = nullptr) const;
+    // min |A w - b| subject to w >= 0 by the active set method of Lawson and Hanson on the normal
+    // equations G = A^T A, c = A^T b, starting from the nonnegative w
+    static void nonnegativeLeastSquares(const Matrix& G, const Vector& c, Vector& w);
+
+    ReducedBody<T,dim> mBody;
+    std::vector<int> mCubature;             // tetrahedra
+    Vector mWeights;
+    std::vector<Vec> mRest;                 // rest positions the element corners are built from
+};
+
+template<class T, int dim>
+SubspaceDynamics<T,dim>::SubspaceDynamics() {}
+
+template<class T, int dim>
+T SubspaceDynamics<T,dim>::buildBasis(const std::vector<std::vector<Vec>>& snapshots, const std::vector<Vec>& rest,
+                                      const std::vector<T>& masses, int size) {
+    const int numParticles = rest.size();
+    const int numSnapshots = snapshots.size();
+    T totalMass = 0;
+    for(int i = 0; i < numParticles; ++i){
+        totalMass += masses[i];
+    }
+
+    // columns M^1/2 d_s of the displacements without their center of mass translation
+    Matrix D(dim * numParticles, numSnapshots);
+    for(int s = 0; s < numSnapshots; ++s){
+        Vec mean = Vec::Zero();
+        for(int i = 0; i < numParticles; ++i){
+            mean += masses[i] * (snapshots[s][i] - rest[i]);
+        }
+        mean /= totalMass;
+        for(int i = 0; i < numParticles; ++i){
+            D.col(s).template segment<dim>(dim * i) = std::sqrt(masses[i]) * (snapshots[s][i] - rest[i] - mean);
+        }
+    }
+
+    // method of snapshots: the eigenvectors of D^T D give the left singular vectors of D
+    Eigen::SelfAdjointEigenSolver<Matrix> gram(D.transpose() * D);
+    const Vector& energies = gram.eigenvalues();
+    const T total = energies.sum();
+    const T threshold = T(1e-12) * std::max(energies.maxCoeff(), T(0));
+    std::vector<int> kept;
+    for(int k = numSnapshots - 1; k >= 0 && int(kept.size()) < size; --k){
+        if(energies[k] > threshold){
+            kept.push_back(k);
+        }
+    }
+
+    Matrix& basis = mBody.basis();
+    basis.resize(dim * numParticles, kept.size());
+    T energy = 0;
+    for(unsigned int k = 0; k < kept.size(); ++k){
+        energy += energies[kept[k]];
+        basis.col(k) = D * gram.eigenvectors().col(kept[k]) / std::sqrt(energies[kept[k]]);
+        for(int i = 0; i < numParticles; ++i){
+            basis.col(k).template segment<dim>(dim * i) /= std::sqrt(masses[i]);
+        }
+    }
+    return total > 0 ? energy / total : T(1);
+}
+
+template<class T, int dim>
+template<class ElementForce>
+void SubspaceDynamics<T,dim>::addElementForce(int n, const Tetrahedron<T,dim>& t, const std::vector<Vec>& rest,
+                                              const Vector& q, ElementForce& elementForce, T weight,
+                                              Vector& force, Matrix* stiffness) const {
+    const Matrix& basis = mBody.basis();
+    // U_e, the basis rows of the corners
+    Matrix rows(dim * (dim + 1), basis.cols());
+    Vec x[dim + 1];
+    for(int k = 0; k < dim + 1; ++k){
+        rows.middleRows(dim * k, dim) = basis.middleRows(dim * t.mPIndices[k], dim);
+        x[k] = rest[t.mPIndices[k]] + rows.middleRows(dim * k, dim) * q;
+    }
+    Mat G;
+    Matrix K;
+    elementForce(n, x, G, stiffness == nullptr ? nullptr : &K);
+    Vector f(dim * (dim + 1));
+    f.template tail<dim>().setZero();
+    for(int k = 0; k < dim; ++k){
+        f.template segment<dim>(dim * k) = G.col(k);
+        f.template tail<dim>() -= G.col(k);
+    }
+    force.noalias() += weight * rows.transpose() * f;
+    if(stiffness != nullptr){
+        const Matrix KU = K * rows;
+        stiffness->noalias() += weight * rows.transpose() * KU;
+    }
+}
+
+template<class T, int dim>
+template<class ElementForce>
+T SubspaceDynamics<T,dim>::buildCubature(const std::vector<std::vector<Vec>>& snapshots, const std::vector<Vec>& rest,
+                                         const std::vector<T>& masses, const std::vector<Tetrahedron<T,dim>>& tetras,
+                                         int count, ElementForce elementForce) {
+    const Matrix& basis = mBody.basis();
+    const int r = size();
+    const int numParticles = rest.size();
+    const int numTets = tetras.size();
+
+    // training poses are the snapshots projected into the basis, q = U^T M (x - rest)
+    std::vector<Vector> poses;
+    for(const std::vector<Vec>& snapshot : snapshots){
+        Vector d(dim * numParticles);
+        for(int i = 0; i < numParticles; ++i){
+            d.template segment<dim>(dim * i) = masses[i] * (snapshot[i] - rest[i]);
+        }
+        poses.push_back(basis.transpose() * d);
+    }
+    const int numPoses = poses.size();
+
+    // the exact reduced forces, each pose scaled to unit norm so that all of them count
+    Vector b = Vector::Zero(numPoses * r);
+    #pragma omp parallel for
+    for(int s = 0; s < numPoses; ++s){
+        Vector force = Vector::Zero(r);
+        for(int n = 0; n < numTets; ++n){
+            addElementForce(n, tetras[n], rest, poses[s], elementForce, T(1), force);
+        }
+        b.segment(s * r, r) = force;
+    }
+    Vector scale = Vector::Ones(numPoses);
+    for(int s = 0; s < numPoses; ++s){
+        const T norm = b.segment(s * r, r).norm();
+        if(norm > 0){
+            scale[s] = 1 / norm;
+            b.segment(s * r, r) *= scale[s];
+        }
+    }
+    const T bNorm = b.norm();
+    if(bNorm == 0){
+        std::cout << "error: the training poses carry no elastic force" << std::endl;
+        return T(1);
+    }
+
+    // greedy: the candidate best aligned with the residual joins, then the weights are refit
+    const int candidates = std::min(numTets, 1024);
+    std::mt19937 random(1);
+    std::vector<char> selected(numTets, 0);
+    std::vector<int> order(numTets);
+    for(int n = 0; n < numTets; ++n){
+        order[n] = n;
+    }
+    Matrix A(numPoses * r, 0);
+    Matrix G(0, 0);
+    Vector c(0);
+    Vector residual = b;
+    Vector weights(0);
+    mCubature.clear();
+    while(int(mCubature.size()) < std::min(count, numTets) && residual.norm() > T(1e-4) * bNorm){
+        std::shuffle(order.begin(), order.end(), random);
+        int best = -1;
+        T bestScore = 0;
+        Vector bestColumn;
+        #pragma omp parallel for
+        for(int c = 0; c < candidates; ++c){
+            const int n = order[c];
+            if(selected[n]){
+                continue;
+            }
+            Vector column(numPoses * r);
+            for(int s = 0; s < numPoses; ++s){
+                Vector force = Vector::Zero(r);
+                addElementForce(n, tetras[n], rest, poses[s], elementForce, scale[s], force);
+                column.segment(s * r, r) = force;
+            }
+            const T norm = column.norm();
+            const T score = norm > 0 ? column.dot(residual) / norm : T(0);
+            #pragma omp critical
+            {
+                if(score > bestScore || (score == bestScore && best >= 0 && n < best)){
+                    best = n;
+                    bestScore = score;
+                    bestColumn = column;
+                }
+            }
+        }
+        if(best < 0){
+            break;
+        }
+        selected[best] = 1;
+        mCubature.push_back(best);
+        // the normal equations grow by one row and column, the last weights start the next fit
+        const int k = A.cols();
+        A.conservativeResize(Eigen::NoChange, k + 1);
+        A.col(k) = bestColumn;
+        G.conservativeResize(k + 1, k + 1);
+        G.row(k) = bestColumn.transpose() * A;
+        G.col(k) = G.row(k).transpose();
+        c.conservativeResize(k + 1);
+        c[k] = bestColumn.dot(b);
+        weights.conservativeResize(k + 1);
+        weights[k] = 0;
+        nonnegativeLeastSquares(G, c, weights);
+        residual = b - A * weights;
+    }
+
+    // tetrahedra the fit gave no weight are dropped
+    std::vector<int> cubature;
+    std::vector<T> kept;
+    for(unsigned int k = 0; k < mCubature.size(); ++k){
+        if(weights[k] > 0){
+            cubature.push_back(mCubature[k]);
+            kept.push_back(weights[k]);
+        }
+    }
+    mCubature = cubature;
+    mWeights = Eigen::Map<Vector>(kept.data(), kept.size());
+    return residual.norm() / bNorm;
+}
+
+template<class T, int dim>
+void SubspaceDynamics<T,dim>::nonnegativeLeastSquares(const Matrix& G, const Vector& c, Vector& w) {
+    const int n = G.cols();
+    std::vector<char> passive(n, 0);
+    for(int k = 0; k < n; ++k){
+        passive[k] = w[k] > 0;
+    }
+    const T tolerance = T(1e-12) * std::max(c.cwiseAbs().maxCoeff(), T(1e-300));
+    for(int iteration = 0; iteration < 3 * n; ++iteration){
+        const Vector gradient = c - G * w;
+        int j = -1;
+        for(int k = 0; k < n; ++k){
+            if(!passive[k] && gradient[k] > tolerance && (j < 0 || gradient[k] > gradient[j])){
+                j = k;
+            }
+        }
+        if(j < 0){
+            break;
+        }
+        passive[j] = 1;
+
+        for(;;){
+            // unconstrained least squares on the passive set
+            std::vector<int> set;
+            for(int k = 0; k < n; ++k){
+                if(passive[k]){
+                    set.push_back(k);
+                }
+            }
+            Matrix GP(set.size(), set.size());
+            Vector cP(set.size());
+            for(unsigned int a = 0; a < set.size(); ++a){
+                cP[a] = c[set[a]];
+                for(unsigned int b = 0; b < set.size(); ++b){
+                    GP(a, b) = G(set[a], set[b]);
+                }
+            }
+            const Vector zP = GP.ldlt().solve(cP);
+            Vector z = Vector::Zero(n);
+            for(unsigned int a = 0; a < set.size(); ++a){
+                z[set[a]] = zP[a];
+            }
+            if(zP.minCoeff() > 0){
+                w = z;
+                break;
+            }
+            // step towards z until the first passive weight reaches zero, which leaves the set
+            T alpha = 1;
+            for(int k : set){
+                if(z[k] <= 0){
+                    alpha = std::min(alpha, w[k] / (w[k] - z[k]));
+                }
+            }
+            w += alpha * (z - w);
+            for(int k : set){
+                if(w[k] <= 0){
+                    w[k] = 0;
+                    passive[k] = 0;
+                }
+            }
+        }
+    }
+}
+
+template<class T, int dim>
+bool SubspaceDynamics<T,dim>::read(const std::string& path, uint64_t key, int numParticles) {
+    std::ifstream in(path, std::ios::binary);
+    if(!in){
+        return false;
+    }
+    FileHelper::Header header;
+    if(!FileHelper::readHeader(in, header) || !FileHelper::matchHeader(header, FileHelper::makeHeader(magic(), VERSION, sizeof(T), dim, key))
+       || header.counts[0] != numParticles || header.counts[1] < 0 || header.counts[2] < 0){
+        std::cout << "ignoring stale subspace " << path << std::endl;
+        return false;
+    }
+    Matrix& basis = mBody.basis();
+    basis.resize(dim * numParticles, header.counts[1]);
+    mWeights.resize(header.counts[2]);
+    mCubature.resize(header.counts[2]);
+    in.read(reinterpret_cast<char*>(basis.data()), sizeof(T) * basis.size());
+    in.read(reinterpret_cast<char*>(mWeights.data()), sizeof(T) * mWeights.size());
+    in.read(reinterpret_cast<char*>(mCubature.data()), sizeof(int) * mCubature.size());
+    if(!in){
+        std::cout << "error: truncated subspace " << path << std::endl;
+        basis.resize(0, 0);
+        mCubature.clear();
+        return false;
+    }
+    return true;
+}
+
+template<class T, int dim>
+bool SubspaceDynamics<T,dim>::write(const std::string& path, uint64_t key) const {
+    const Matrix& basis = mBody.basis();
+    FileHelper::Header header = FileHelper::makeHeader(magic(), VERSION, sizeof(T), dim, key);
+    header.counts[0] = basis.rows() / dim;
+    header.counts[1] = basis.cols();
+    header.counts[2] = mCubature.size();
+    return FileHelper::writeAtomic(path, "subspace", [&](std::ofstream& out){
+        FileHelper::writeHeader(out, header);
+        out.write(reinterpret_cast<const char*>(basis.data()), sizeof(T) * basis.size());
+        out.write(reinterpret_cast<const char*>(mWeights.data()), sizeof(T) * mWeights.size());
+        out.write(reinterpret_cast<const char*>(mCubature.data()), sizeof(int) * mCubature.size());
+    });
+}
+
+template<class T, int dim>
+template<class ElementForce>
+void SubspaceDynamics<T,dim>::advance(T timeStep, const Vec& gravity, const std::vector<Tetrahedron<T,dim>>& tetras,
+                                      ElementForce elementForce) {
+    // the basis is mass orthogonal to translations, gravity only moves the center
+    mBody.translate(timeStep, gravity);
+    const int r = size();
+    const int numParticles = mBody.basis().rows() / dim;
+    if(int(mRest.size()) != numParticles){
+        mRest.resize(numParticles);
+        for(int i = 0; i < numParticles; ++i){
+            mRest[i] = mBody.rest(i);
+        }
+    }
+    Vector& q = mBody.coordinates();
+    Vector& rates = mBody.rates();
+
+    // cubature force and tangent at q, summed per chunk in a fixed order so that the result does not
+    // depend on the number of threads
+    const int numCubature = mCubature.size();
+    const int chunks = std::min(numCubature, 16);
+    std::vector<Vector> forces(chunks, Vector::Zero(r));
+    std::vector<Matrix> stiffnesses(chunks, Matrix::Zero(r, r));
+    #pragma omp parallel for schedule(dynamic)
+    for(int k = 0; k < chunks; ++k){
+        for(int c = k * numCubature / chunks; c < (k + 1) * numCubature / chunks; ++c){
+            addElementForce(mCubature[c], tetras[mCubature[c]], mRest, q, elementForce, mWeights[c], forces[k],
+                            &stiffnesses[k]);
+        }
+    }
+    Vector force = Vector::Zero(r);
+    Matrix K = Matrix::Zero(r, r);
+    for(int k = 0; k < chunks; ++k){
+        force += forces[k];
+        K += stiffnesses[k];
+    }
+
+    // v' = v + dt f(q + dt v') linearized at q: (I - dt^2 K) v' = v + dt f(q)
+    const Matrix A = Matrix::Identity(r, r) - timeStep * timeStep * K;
+    // K is symmetric negative semidefinite, the warped stiffness of every cubature tetrahedron
+    rates = A.ldlt().solve(rates + timeStep * force);
+    q += timeStep * rates;
+}
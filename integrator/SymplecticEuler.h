@@ -0,0 +1,56 @@
+#pragma once
+
+#include "BaseIntegrator.h"
+
+// Semi-implicit Euler: the velocity is updated first and moves the position. Unlike
+// ForwardEuler it does not gain energy, it is stable for an element below about the
+// time a pressure wave takes to cross it (Tetrahedron::stableTimeStep).
+template<class T, int dim>
+class SymplecticEuler : public BaseIntegrator<T, dim> {
+
+public:
+    SymplecticEuler(std::string name);
+
+    ~SymplecticEuler();
+
+    virtual void integrate(T timeStep, int params, const State<T, dim> &currentState, State<T, dim> &newState);
+
+    // same update in place on one particle, without building States
+    void integrate(T timeStep, T mass, const Eigen::Matrix<T, dim, 1> &force,
+                   Eigen::Matrix<T, dim, 1> &position, Eigen::Matrix<T, dim, 1> &velocity) const;
+
+};
+
+
+template<class T, int dim>
+SymplecticEuler<T, dim>::SymplecticEuler(std::string name) : BaseIntegrator<T, dim>(name) {}
+
+template<class T, int dim>
+SymplecticEuler<T, dim>::~SymplecticEuler() {}
+
+template<class T, int dim>
+void SymplecticEuler<T, dim>::integrate(T timeStep, int params, const State<T, dim> &currentState, State<T, dim> &newState) {
+
+    if(currentState.mComponents.size() == 0) {
+        return;
+    }
+
+    // Derivative of velocity is = F/m (from Newtons second law)
+    newState.mComponentDot[VEL] = currentState.mComponents[FOR] * (1.f / currentState.mMass);
+    newState.mComponents[VEL] = currentState.mComponents[VEL] + newState.mComponentDot[VEL] * timeStep;
+
+    // Derivative of position is the new velocity of particle
+    newState.mComponentDot[POS] = newState.mComponents[VEL];
+    newState.mComponents[POS] = currentState.mComponents[POS] + newState.mComponentDot[POS] * timeStep;
+
+    newState.mMass = currentState.mMass;
+}
+
+template<class T, int dim>
+void SymplecticEuler<T, dim>::integrate(T timeStep, T mass, const Eigen::Matrix<T, dim, 1> &force,
+                                        Eigen::Matrix<T, dim, 1> &position, Eigen::Matrix<T, dim, 1> &velocity) const {
+
+    const Eigen::Matrix<T, dim, 1> acceleration = force * (1.f / mass);
+    velocity = velocity + acceleration * timeStep;
+    position = position + velocity * timeStep;
+}
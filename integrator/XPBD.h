@@ -0,0 +1,136 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/Dense>
+
+#include "../mesh/GraphColoring.h"
+#include "../mesh/TetraMesh.h"
+
+// Extended position based dynamics with the stable Neo-Hookean constraints of
+// Macklin and Mueller: per tetrahedron a deviatoric constraint |F| with
+// compliance 1 / (mu V) and a hydrostatic constraint det F - (1 + mu / lambda)
+// with compliance 1 / (lambda V). A projection is a number of Gauss-Seidel
+// sweeps over the tetrahedra; tetrahedra of one color share no vertex and are
+// projected in parallel. The Lagrange multipliers restart at zero every
+// substep, so few iterations on many substeps converge to the same result as
+// many iterations on one.
+template<class T, int dim>
+class XPBD {
+public:
+    typedef Eigen::Matrix<T,dim,1> Vec;
+    typedef Eigen::Matrix<T,dim,dim> Mat;
+
+    XPBD();
+
+    // colors the tetrahedra and stores the compliances
+    void precompute(const TetraMesh<T,dim>& mesh, T mu, T lambda);
+
+    // moves x towards satisfying every constraint within timeStep
+    void project(const TetraMesh<T,dim>& mesh, std::vector<Vec>& x, T timeStep, int iterations);
+
+    int numColors() const { return mColoring.numColors(); }
+
+private:
+    // one constraint C with gradient dC/dF on tetrahedron t
+    void solveConstraint(const Tetrahedron<T,dim>& t, std::vector<Vec>& x, T C, const Mat& dCdF,
+                         T alpha, T& multiplier);
+
+    GraphColoring<T,dim> mColoring;
+    std::vector<T> mInverseMasses;
+    std::vector<T> mDeviatoricCompliance;       // 1 / (mu V) per tetrahedron
+    std::vector<T> mHydrostaticCompliance;      // 1 / (lambda V) per tetrahedron
+    std::vector<T> mDeviatoricMultipliers;
+    std::vector<T> mHydrostaticMultipliers;
+    T mRestVolume;                              // det F at which the hydrostatic constraint is satisfied
+};
+
+template<class T, int dim>
+XPBD<T,dim>::XPBD() : mRestVolume(1) {}
+
+template<class T, int dim>
+void XPBD<T,dim>::precompute(const TetraMesh<T,dim>& mesh, T mu, T lambda) {
+    const std::vector<Tetrahedron<T,dim>>& tetras = *mesh.mTetras;
+    const Particles<T,dim>& particles = mesh.mParticles;
+    mColoring.colorTets(tetras, *mesh.mAdjacency);
+
+    mInverseMasses.resize(particles.masses.size());
+    for(unsigned int i = 0; i < particles.masses.size(); ++i){
+        mInverseMasses[i] = particles.masses[i] > 0 ? 1 / particles.masses[i] : 0;
+    }
+    mDeviatoricCompliance.resize(tetras.size());
+    mHydrostaticCompliance.resize(tetras.size());
+    for(unsigned int n = 0; n < tetras.size(); ++n){
+        mDeviatoricCompliance[n] = 1 / (mu * tetras[n].volume);
+        mHydrostaticCompliance[n] = 1 / (lambda * tetras[n].volume);
+    }
+    mDeviatoricMultipliers.resize(tetras.size());
+    mHydrostaticMultipliers.resize(tetras.size());
+    // the deviatoric term pulls |F| to zero, the hydrostatic rest volume compensates
+    mRestVolume = 1 + mu / lambda;
+}
+
+template<class T, int dim>
+void XPBD<T,dim>::solveConstraint(const Tetrahedron<T,dim>& t, std::vector<Vec>& x, T C, const Mat& dCdF,
+                                  T alpha, T& multiplier) {
+    Vec gradients[dim + 1];
+    T denominator = alpha;
+    for(int k = 0; k < dim + 1; ++k){
+        gradients[k] = dCdF * t.corner(k);
+        denominator += mInverseMasses[t.mPIndices[k]] * gradients[k].squaredNorm();
+    }
+    if(denominator <= 0){
+        return;
+    }
+    const T delta = (-C - alpha * multiplier) / denominator;
+    multiplier += delta;
+    for(int k = 0; k < dim + 1; ++k){
+        x[t.mPIndices[k]] += (mInverseMasses[t.mPIndices[k]] * delta) * gradients[k];
+    }
+}
+
+template<class T, int dim>
+void XPBD<T,dim>::project(const TetraMesh<T,dim>& mesh, std::vector<Vec>& x, T timeStep, int iterations) {
+    const std::vector<Tetrahedron<T,dim>>& tetras = *mesh.mTetras;
+    const T inverseStep2 = 1 / (timeStep * timeStep);
+    std::fill(mDeviatoricMultipliers.begin(), mDeviatoricMultipliers.end(), T(0));
+    std::fill(mHydrostaticMultipliers.begin(), mHydrostaticMultipliers.end(), T(0));
+
+    for(int iteration = 0; iteration < iterations; ++iteration){
+        for(int c = 0; c < mColoring.numColors(); ++c){
+            const int* members = mColoring.begin(c);
+            #pragma omp parallel for
+            for(int m = 0; m < mColoring.size(c); ++m){
+                const int n = members[m];
+                const Tetrahedron<T,dim>& t = tetras[n];
+                Mat Ds;
+                for(int i = 0; i < dim; ++i){
+                    Ds.col(i) = x[t.mPIndices[i]] - x[t.mPIndices[dim]];
+                }
+                Mat F = Ds * t.mDmInv;
+
+                // hydrostatic, dC/dF is the cofactor matrix det(F) F^-T
+                Mat cofactor;
+                cofactor.col(0) = F.col(1).cross(F.col(2));
+                cofactor.col(1) = F.col(2).cross(F.col(0));
+                cofactor.col(2) = F.col(0).cross(F.col(1));
+                solveConstraint(t, x, F.determinant() - mRestVolume, cofactor,
+                                mHydrostaticCompliance[n] * inverseStep2, mHydrostaticMultipliers[n]);
+
+                // deviatoric on the updated positions, dC/dF = F / |F|
+                for(int i = 0; i < dim; ++i){
+                    Ds.col(i) = x[t.mPIndices[i]] - x[t.mPIndices[dim]];
+                }
+                F = Ds * t.mDmInv;
+                const T norm = F.norm();
+                if(norm > 0){
+                    solveConstraint(t, x, norm, F / norm,
+                                    mDeviatoricCompliance[n] * inverseStep2, mDeviatoricMultipliers[n]);
+                }
+            }
+        }
+    }
+}
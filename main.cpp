@@ -1,13 +1,70 @@
 #include "FEMSolver.h"
+#include "SweepRunner.h"
 #include "globalincludes.h"
 
+#include <string>
 
-int main()
+void printUsage(const char* program)
 {
+    std::cout << "usage: " << program << " [config.ini] [--set section.key=value]... [--resume checkpoint.bin | --sweep sweep.ini]" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    SimConfig config;
+    std::string resumePath = "";
+    std::string sweepPath = "";
+
+    for(int i = 1; i < argc; ++i){
+        std::string arg = argv[i];
+        if(arg == "--resume" && i + 1 < argc){
+            resumePath = argv[++i];
+        }
+        else if(arg == "--sweep" && i + 1 < argc){
+            sweepPath = argv[++i];
+        }
+        else if(arg == "--set" && i + 1 < argc){
+            std::string assignment = argv[++i];
+            size_t equals = assignment.find('=');
+            if(equals == std::string::npos || !config.set(assignment.substr(0, equals), assignment.substr(equals + 1))){
+                printUsage(argv[0]);
+                return 1;
+            }
+        }
+        else if(arg[0] != '-'){
+            if(!config.load(arg)){
+                return 1;
+            }
+        }
+        else{
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if(!sweepPath.empty()){
+        SweepSpec spec;
+        spec.base = config;
+        if(!spec.load(sweepPath)){
+            return 1;
+        }
+        SweepRunner<double,3> runner(spec);
+        return runner.run() ? 0 : 1;
+    }
+
+    if(!config.finalize()){
+        return 1;
+    }
+
     // Cook My Jello!
 
-    FEMSolver<double,3> solver(240);
-    solver.initializeMesh();
+    FEMSolver<double,3> solver(config);
+    if(resumePath.empty()){
+        solver.initializeMesh();
+    }
+    else if(!solver.resumeFromCheckpoint(resumePath)){
+        return 1;
+    }
     solver.cookMyJello();
 
 }
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "TetAdjacency.h"
+
+// Greedy colorings of a tetrahedral mesh for lock-free parallel loops. Vertices
+// of one color share no edge, so a Gauss-Seidel sweep can update a whole color
+// at once; tetrahedra of one color share no vertex, so they can scatter into
+// per-vertex data at once. Members of color c are members[colorStart[c]] to
+// members[colorStart[c + 1] - 1], in increasing order.
+template<class T, int dim>
+class GraphColoring {
+public:
+    GraphColoring();
+
+    void colorVertices(const TetAdjacency<T,dim>& adjacency);
+    void colorTets(const std::vector<Tetrahedron<T,dim>>& tetras, const TetAdjacency<T,dim>& adjacency);
+
+    int numColors() const { return int(colorStart.size()) - 1; }
+    int size(int color) const { return colorStart[color + 1] - colorStart[color]; }
+    const int* begin(int color) const { return members.data() + colorStart[color]; }
+
+    std::vector<int> color;         // color of each vertex or tetrahedron
+    std::vector<int> colorStart;
+    std::vector<int> members;
+
+private:
+    // smallest color not marked with stamp in used
+    static int firstFree(std::vector<int>& used, int stamp);
+    void group(int numColors);
+};
+
+template<class T, int dim>
+GraphColoring<T,dim>::GraphColoring() {}
+
+template<class T, int dim>
+int GraphColoring<T,dim>::firstFree(std::vector<int>& used, int stamp) {
+    int c = 0;
+    while(c < int(used.size()) && used[c] == stamp){
+        ++c;
+    }
+    if(c == int(used.size())){
+        used.push_back(-1);
+    }
+    return c;
+}
+
+template<class T, int dim>
+void GraphColoring<T,dim>::colorVertices(const TetAdjacency<T,dim>& adjacency) {
+    const int numVertices = adjacency.numParticles();
+    color.assign(numVertices, -1);
+    std::vector<int> used;
+    int numColors = 0;
+    for(int i = 0; i < numVertices; ++i){
+        for(int k = adjacency.vertexVertexStart[i]; k < adjacency.vertexVertexStart[i + 1]; ++k){
+            const int c = color[adjacency.vertexVertices[k]];
+            if(c >= 0){
+                used[c] = i;
+            }
+        }
+        color[i] = firstFree(used, i);
+        numColors = std::max(numColors, color[i] + 1);
+    }
+    group(numColors);
+}
+
+template<class T, int dim>
+void GraphColoring<T,dim>::colorTets(const std::vector<Tetrahedron<T,dim>>& tetras, const TetAdjacency<T,dim>& adjacency) {
+    const int numTets = tetras.size();
+    color.assign(numTets, -1);
+    std::vector<int> used;
+    int numColors = 0;
+    for(int n = 0; n < numTets; ++n){
+        for(int v : tetras[n].mPIndices){
+            for(int k = adjacency.vertexTetStart[v]; k < adjacency.vertexTetStart[v + 1]; ++k){
+                const int c = color[adjacency.vertexTets[k] / (dim + 1)];
+                if(c >= 0){
+                    used[c] = n;
+                }
+            }
+        }
+        color[n] = firstFree(used, n);
+        numColors = std::max(numColors, color[n] + 1);
+    }
+    group(numColors);
+}
+
+template<class T, int dim>
+void GraphColoring<T,dim>::group(int numColors) {
+    colorStart.assign(numColors + 1, 0);
+    for(int c : color){
+        ++colorStart[c + 1];
+    }
+    for(int c = 0; c < numColors; ++c){
+        colorStart[c + 1] += colorStart[c];
+    }
+    members.resize(color.size());
+    std::vector<int> fill(colorStart.begin(), colorStart.end() - 1);
+    for(unsigned int i = 0; i < color.size(); ++i){
+        members[fill[color[i]]++] = i;
+    }
+}
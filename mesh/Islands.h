@@ -0,0 +1,210 @@
+#pragma once
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+#include "TetraMesh.h"
+#include "../scene/scene.h"
+
+// Connected components of a tetrahedral mesh, found over its vertex adjacency,
+// with sleep state. An island falls asleep after several consecutive checks in
+// which its mean speed and the change of every element's deformation gradient
+// since the previous check stay below thresholds. Sleeping islands keep their positions, have
+// zero velocity and are skipped by force evaluation and integration until a
+// moving collider is about to reach them.
+template<class T, int dim>
+class Islands {
+public:
+    Islands();
+
+    void build(const TetraMesh<T,dim>& mesh);
+
+    int numIslands() const { return mAwake.size(); }
+    int numAwake() const { return std::count(mAwake.begin(), mAwake.end(), char(1)); }
+    bool tetAwake(int tet) const { return mAwake[mTetIsland[tet]]; }
+    bool particleAwake(int particle) const { return mAwake[mParticleIsland[particle]]; }
+
+    // sleep test for awake islands, returns true if any island changed state
+    bool check(TetraMesh<T,dim>& mesh, T speed, T strain, int calmChecks);
+    // wakes sleeping islands whose box overlaps the box a moving collider sweeps in the next lookahead seconds
+    bool wakeNearColliders(const TetraMesh<T,dim>& mesh, const Scene<T,dim>& scene, T lookahead);
+    void wakeAll();
+
+private:
+    void wake(int island);
+
+    std::vector<int> mParticleIsland;
+    std::vector<int> mTetIsland;
+    // particles and tetrahedra of each island
+    std::vector<int> mParticleStart;
+    std::vector<int> mParticles;
+    std::vector<int> mTetStart;
+    std::vector<int> mTets;
+
+    std::vector<char> mAwake;
+    std::vector<int> mCalm;                         // consecutive calm checks
+    std::vector<char> mHasReference;                // mReferenceF holds the previous check
+    std::vector<Eigen::Matrix<T,dim,dim>> mReferenceF;
+};
+
+template<class T, int dim>
+Islands<T,dim>::Islands() {}
+
+template<class T, int dim>
+void Islands<T,dim>::build(const TetraMesh<T,dim>& mesh) {
+    const int numParticles = mesh.mParticles.positions.size();
+    const std::vector<Tetrahedron<T,dim>>& tetras = *mesh.mTetras;
+    const TetAdjacency<T,dim>& adjacency = *mesh.mAdjacency;
+
+    // breadth first over the vertex adjacency, islands numbered by their lowest particle
+    int numIslands = 0;
+    mParticleIsland.assign(numParticles, -1);
+    std::vector<int> queue;
+    for(int i = 0; i < numParticles; ++i){
+        if(mParticleIsland[i] >= 0){
+            continue;
+        }
+        mParticleIsland[i] = numIslands;
+        queue.assign(1, i);
+        for(unsigned int q = 0; q < queue.size(); ++q){
+            const int v = queue[q];
+            for(int k = adjacency.vertexVertexStart[v]; k < adjacency.vertexVertexStart[v + 1]; ++k){
+                const int w = adjacency.vertexVertices[k];
+                if(mParticleIsland[w] < 0){
+                    mParticleIsland[w] = numIslands;
+                    queue.push_back(w);
+                }
+            }
+        }
+        ++numIslands;
+    }
+    mTetIsland.resize(tetras.size());
+    for(unsigned int n = 0; n < tetras.size(); ++n){
+        mTetIsland[n] = mParticleIsland[tetras[n].mPIndices[0]];
+    }
+
+    auto group = [numIslands](const std::vector<int>& island, std::vector<int>& start, std::vector<int>& members){
+        start.assign(numIslands + 1, 0);
+        for(int i : island){
+            ++start[i + 1];
+        }
+        std::partial_sum(start.begin(), start.end(), start.begin());
+        members.resize(island.size());
+        std::vector<int> fill(start.begin(), start.end() - 1);
+        for(unsigned int i = 0; i < island.size(); ++i){
+            members[fill[island[i]]++] = i;
+        }
+    };
+    group(mParticleIsland, mParticleStart, mParticles);
+    group(mTetIsland, mTetStart, mTets);
+
+    mAwake.assign(numIslands, 1);
+    mCalm.assign(numIslands, 0);
+    mHasReference.assign(numIslands, 0);
+    mReferenceF.resize(tetras.size());
+}
+
+template<class T, int dim>
+void Islands<T,dim>::wake(int island) {
+    mAwake[island] = 1;
+    mCalm[island] = 0;
+    mHasReference[island] = 0;
+}
+
+template<class T, int dim>
+void Islands<T,dim>::wakeAll() {
+    for(int i = 0; i < numIslands(); ++i){
+        wake(i);
+    }
+}
+
+template<class T, int dim>
+bool Islands<T,dim>::check(TetraMesh<T,dim>& mesh, T speed, T strain, int calmChecks) {
+    Particles<T,dim>& particles = mesh.mParticles;
+    const std::vector<Tetrahedron<T,dim>>& tetras = *mesh.mTetras;
+    std::vector<char> fellAsleep(numIslands(), 0);
+
+    #pragma omp parallel for schedule(dynamic)
+    for(int island = 0; island < numIslands(); ++island){
+        if(!mAwake[island]){
+            continue;
+        }
+        // mean squared speed, twice the kinetic energy over the mass
+        T energy = 0;
+        T mass = 0;
+        for(int k = mParticleStart[island]; k < mParticleStart[island + 1]; ++k){
+            const int i = mParticles[k];
+            energy += particles.masses[i] * particles.velocities[i].squaredNorm();
+            mass += particles.masses[i];
+        }
+        bool calm = mass > 0 && energy < speed * speed * mass;
+
+        // largest change of a deformation gradient since the previous check
+        T change = 0;
+        for(int k = mTetStart[island]; k < mTetStart[island + 1]; ++k){
+            const Tetrahedron<T,dim>& t = tetras[mTets[k]];
+            Eigen::Matrix<T,dim,dim> Ds;
+            for(int i = 0; i < dim; ++i){
+                Ds.col(i) = particles.positions[t.mPIndices[i]] - particles.positions[t.mPIndices[dim]];
+            }
+            const Eigen::Matrix<T,dim,dim> F = Ds * t.mDmInv;
+            if(mHasReference[island]){
+                change = std::max(change, (F - mReferenceF[mTets[k]]).norm());
+            }
+            mReferenceF[mTets[k]] = F;
+        }
+        calm = calm && mHasReference[island] && change < strain;
+        mHasReference[island] = 1;
+
+        mCalm[island] = calm ? mCalm[island] + 1 : 0;
+        if(mCalm[island] >= calmChecks){
+            mAwake[island] = 0;
+            fellAsleep[island] = 1;
+            for(int k = mParticleStart[island]; k < mParticleStart[island + 1]; ++k){
+                particles.velocities[mParticles[k]].setZero();
+            }
+        }
+    }
+    return std::find(fellAsleep.begin(), fellAsleep.end(), char(1)) != fellAsleep.end();
+}
+
+template<class T, int dim>
+bool Islands<T,dim>::wakeNearColliders(const TetraMesh<T,dim>& mesh, const Scene<T,dim>& scene, T lookahead) {
+    const std::vector<Eigen::Matrix<T,dim,1>>& x = mesh.mParticles.positions;
+
+    // the box a collider covers from where it is to where it will be, so a fast collider passing
+    // through an island within lookahead wakes it even if it has left it again by then
+    std::vector<Eigen::Matrix<T,dim,1>> sweptMin, sweptMax;
+    for(const Shape<T,dim>* shape : scene.shapes){
+        const Eigen::Matrix<T,dim,1> displacement = lookahead * shape->getVelocity();
+        if(displacement.isZero()){
+            continue;
+        }
+        Eigen::Matrix<T,dim,1> lo, hi;
+        shape->bounds(lo, hi);
+        sweptMin.push_back(lo.cwiseMin(lo + displacement));
+        sweptMax.push_back(hi.cwiseMax(hi + displacement));
+    }
+
+    bool changed = false;
+    for(int island = 0; island < numIslands() && !sweptMin.empty(); ++island){
+        if(mAwake[island]){
+            continue;
+        }
+        Eigen::Matrix<T,dim,1> lo = x[mParticles[mParticleStart[island]]];
+        Eigen::Matrix<T,dim,1> hi = lo;
+        for(int k = mParticleStart[island] + 1; k < mParticleStart[island + 1]; ++k){
+            lo = lo.cwiseMin(x[mParticles[k]]);
+            hi = hi.cwiseMax(x[mParticles[k]]);
+        }
+        for(size_t s = 0; s < sweptMin.size(); ++s){
+            if((lo.array() <= sweptMax[s].array()).all() && (sweptMin[s].array() <= hi.array()).all()){
+                wake(island);
+                changed = true;
+                break;
+            }
+        }
+    }
+    return changed;
+}
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "TetraMesh.h"
+
+// Load time analysis of a precomputed mesh: every tetrahedron's stable explicit
+// step (a Courant number times Tetrahedron::stableTimeStep) and shape quality,
+// the ratio of its smallest height to its longest edge normalized to 1 for the
+// regular tetrahedron and going to 0 for slivers. The global stable step is
+// the smallest one; massScale repairs the worst elements by raising their
+// density until they allow a target step, which trades a little inertia
+// there for a larger step everywhere.
+template<class T, int dim>
+class MeshQuality {
+public:
+    MeshQuality();
+
+    void analyze(const TetraMesh<T,dim>& mesh, T mu, T lambda, T courant);
+    // step and quality histograms, the worst tetrahedra and the predicted gain of mass scaling the worst percent
+    void report() const;
+
+    int numTets() const { return mSteps.size(); }
+    int numDegenerate() const { return mDegenerate; }
+    T stableStep() const { return mMinStep; }      // infinite for a mesh of degenerate tetrahedra only
+    T quality(int n) const { return mQualities[n]; }
+    // mass that scaling every tetrahedron below target would add, relative to the mesh's mass
+    T addedMass(T target) const;
+    // scales the density of every tetrahedron below target so that it allows target, adding the mass to its
+    // corners; the tetrahedra are copied first if another mesh shares them. Returns the number scaled,
+    // analyze again for the new steps
+    int massScale(TetraMesh<T,dim>& mesh, T target) const;
+
+private:
+    std::vector<T> mSteps;
+    std::vector<T> mQualities;
+    std::vector<T> mMasses;
+    T mTotalMass;
+    T mMinStep;
+    int mDegenerate;
+};
+
+template<class T, int dim>
+MeshQuality<T,dim>::MeshQuality() : mTotalMass(0), mMinStep(std::numeric_limits<T>::infinity()), mDegenerate(0) {}
+
+template<class T, int dim>
+void MeshQuality<T,dim>::analyze(const TetraMesh<T,dim>& mesh, T mu, T lambda, T courant) {
+    const std::vector<Tetrahedron<T,dim>>& tetras = *mesh.mTetras;
+    const int numTets = tetras.size();
+    // smallest height over longest edge of the regular simplex
+    const T regular = dim == 3 ? std::sqrt(T(2) / 3) : std::sqrt(T(3)) / 2;
+    mSteps.resize(numTets);
+    mQualities.resize(numTets);
+    mMasses.resize(numTets);
+    mTotalMass = 0;
+    mMinStep = std::numeric_limits<T>::infinity();
+    mDegenerate = 0;
+    for(int n = 0; n < numTets; ++n){
+        const Tetrahedron<T,dim>& t = tetras[n];
+        T longest = 0;
+        for(int i = 0; i < dim; ++i){
+            longest = std::max(longest, t.mDm.col(i).norm());
+            for(int j = i + 1; j < dim; ++j){
+                longest = std::max(longest, (t.mDm.col(j) - t.mDm.col(i)).norm());
+            }
+        }
+        mSteps[n] = courant * t.stableTimeStep(mu, lambda);
+        mQualities[n] = longest > 0 ? t.minHeight() / (regular * longest) : T(0);
+        mMasses[n] = t.mass;
+        mTotalMass += t.mass;
+        mMinStep = std::min(mMinStep, mSteps[n]);
+        if(t.volume == 0){
+            ++mDegenerate;
+        }
+    }
+}
+
+template<class T, int dim>
+T MeshQuality<T,dim>::addedMass(T target) const {
+    T added = 0;
+    for(int n = 0; n < numTets(); ++n){
+        if(mSteps[n] < target){
+            added += mMasses[n] * ((target / mSteps[n]) * (target / mSteps[n]) - 1);
+        }
+    }
+    return mTotalMass > 0 ? added / mTotalMass : T(0);
+}
+
+template<class T, int dim>
+int MeshQuality<T,dim>::massScale(TetraMesh<T,dim>& mesh, T target) const {
+    if(mesh.mTetras.use_count() > 1){
+        mesh.mTetras = std::make_shared<std::vector<Tetrahedron<T,dim>>>(*mesh.mTetras);
+    }
+    std::vector<Tetrahedron<T,dim>>& tetras = *mesh.mTetras;
+    std::vector<T>& masses = mesh.mParticles.masses;
+    int scaled = 0;
+    for(int n = 0; n < numTets(); ++n){
+        if(!(mSteps[n] < target)){
+            continue;
+        }
+        // the step grows with the square root of the density
+        Tetrahedron<T,dim>& t = tetras[n];
+        const T added = t.mass * ((target / mSteps[n]) * (target / mSteps[n]) - 1);
+        t.mass += added;
+        for(int k = 0; k < dim + 1; ++k){
+            masses[t.mPIndices[k]] += added / (dim + 1);
+        }
+        ++scaled;
+    }
+    return scaled;
+}
+
+template<class T, int dim>
+void MeshQuality<T,dim>::report() const {
+    std::cout << "mesh quality: " << numTets() << " tetrahedra, " << mDegenerate << " degenerate" << std::endl;
+    std::vector<T> steps;
+    for(T step : mSteps){
+        if(std::isfinite(step)){
+            steps.push_back(step);
+        }
+    }
+    if(steps.empty()){
+        return;
+    }
+    std::sort(steps.begin(), steps.end());
+    std::cout << "  stable step " << mMinStep << " s, median " << steps[steps.size() / 2] << ", largest "
+              << steps.back() << std::endl;
+
+    // steps in powers of two above the smallest, the last bin open
+    const int stepBins = 8;
+    std::vector<int> stepCounts(stepBins, 0);
+    for(T step : steps){
+        const int bin = std::min(stepBins - 1, int(std::floor(std::log2(step / mMinStep))));
+        ++stepCounts[std::max(bin, 0)];
+    }
+    std::cout << "  stable step / smallest:";
+    for(int b = 0; b < stepBins; ++b){
+        std::cout << " [" << (1 << b) << (b + 1 < stepBins ? ", " + std::to_string(1 << (b + 1)) + ") " : ", inf) ")
+                  << stepCounts[b];
+    }
+    std::cout << std::endl;
+
+    const int qualityBins = 10;
+    std::vector<int> qualityCounts(qualityBins, 0);
+    for(T q : mQualities){
+        ++qualityCounts[std::min(qualityBins - 1, std::max(0, int(q * qualityBins)))];
+    }
+    std::cout << "  height / longest edge, 1 regular:";
+    for(int b = 0; b < qualityBins; ++b){
+        std::cout << " [" << T(b) / qualityBins << ", " << T(b + 1) / qualityBins << ") " << qualityCounts[b];
+    }
+    std::cout << std::endl;
+
+    std::vector<int> worst(numTets());
+    for(int n = 0; n < numTets(); ++n){
+        worst[n] = n;
+    }
+    const int shown = std::min<int>(5, steps.size());
+    std::partial_sort(worst.begin(), worst.begin() + shown, worst.end(),
+                      [this](int a, int b){ return mSteps[a] < mSteps[b]; });
+    std::cout << "  worst:";
+    for(int k = 0; k < shown; ++k){
+        std::cout << " tet " << worst[k] << " (" << mSteps[worst[k]] << " s, quality " << mQualities[worst[k]] << ")";
+    }
+    std::cout << std::endl;
+
+    // mass scaling up to the first percentile's step
+    const T target = steps[steps.size() / 100];
+    if(target > mMinStep){
+        std::cout << "  mass scaling the worst 1% to " << target << " s would allow a " << target / mMinStep
+                  << "x larger step for " << 100 * addedMass(target) << "% more mass" << std::endl;
+    }
+}
@@ -16,7 +16,6 @@ public:
 	std::vector<Eigen::Matrix<T, dim, 1>> positions;
 	std::vector<Eigen::Matrix<T, dim, 1>> velocities;
 	std::vector<Eigen::Matrix<T, dim, 1>> forces;
-	std::vector<Eigen::Matrix<T, dim, 1>> drags;
 	std::vector<T> masses;
     std::vector<int> tets;
 
@@ -25,12 +24,13 @@ public:
 
     void zeroForces();
     void addParticle(Eigen::Matrix<T, dim, 1> pos);
+    void resize(int n);     // resizes every attribute, new particles are zeroed
 
 
 };
 
 template<class T, int dim>
-Particles<T,dim>::Particles() : positions(), velocities(), forces(), drags(), masses() {}
+Particles<T,dim>::Particles() : positions(), velocities(), forces(), masses() {}
 
 template<class T, int dim>
 Particles<T,dim>::~Particles() {}
@@ -42,11 +42,20 @@ void Particles<T,dim>::zeroForces(){
     }
 }
 
+template<class T, int dim>
+void Particles<T,dim>::resize(int n) {
+    positions.resize(n, Eigen::Matrix<T,dim,1>::Zero());
+    velocities.resize(n, Eigen::Matrix<T,dim,1>::Zero());
+    forces.resize(n, Eigen::Matrix<T,dim,1>::Zero());
+    masses.resize(n, 0);
+    tets.resize(n, 0);
+}
+
 template<class T, int dim>
 void Particles<T,dim>::addParticle(Eigen::Matrix<T, dim, 1> pos) {
     positions.push_back(Eigen::Matrix<T,dim,1>(pos));
     velocities.push_back(Eigen::Matrix<T,dim,1>(0.0,0.0,0.0));
     masses.push_back(0.0);
     forces.push_back(Eigen::Matrix<T,dim,1>(0.0,0.0,0.0));
-    drags.push_back(Eigen::Matrix<T,dim,1>(0.0,0.0,0.0));
+    tets.push_back(0);
 }
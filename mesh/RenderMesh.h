@@ -0,0 +1,99 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "TetraMesh.h"
+#include "TetBVH.h"
+#include "TriangleMesh.h"
+
+// High resolution triangle mesh embedded in the simulation mesh. Each render
+// vertex is bound once to the tetrahedron containing it with barycentric
+// weights; every frame its position is the weighted sum of the four particles.
+template<class T, int dim>
+class RenderMesh {
+public:
+    RenderMesh();
+
+    // reads a .ply or .stl, vertices are scaled and then offset into the simulation mesh
+    bool load(const std::string& path, T scale, const Eigen::Matrix<T,dim,1>& offset);
+    // binds against the mesh's rest positions, or the current ones if it has none
+    void bind(const TetraMesh<T,dim>& mesh);
+    void update(const Particles<T,dim>& particles);
+    void outputFrame(int frame, const std::string& directory) const;      // directory/renderNNNN.ply
+
+    int numVertices() const { return mTriangles.positions.size(); }
+    int numOutside() const { return mOutside; }
+
+    TriangleMesh<T,dim> mTriangles;
+    std::vector<int> mCorners;          // dim + 1 particle indices per vertex
+    std::vector<T> mWeights;            // dim + 1 weights per vertex
+
+private:
+    int mOutside;                       // vertices outside the simulation mesh, their weights extrapolate
+};
+
+template<class T, int dim>
+RenderMesh<T,dim>::RenderMesh() : mOutside(0) {}
+
+template<class T, int dim>
+bool RenderMesh<T,dim>::load(const std::string& path, T scale, const Eigen::Matrix<T,dim,1>& offset) {
+    if(!mTriangles.read(path)){
+        return false;
+    }
+    for(Eigen::Matrix<T,dim,1>& x : mTriangles.positions){
+        x = scale * x + offset;
+    }
+    return true;
+}
+
+template<class T, int dim>
+void RenderMesh<T,dim>::bind(const TetraMesh<T,dim>& mesh) {
+    const int corners = dim + 1;
+    const int numVertices = mTriangles.positions.size();
+    TetBVH<T,dim> bvh;
+    // a resumed mesh is deformed and has moved, the render vertices are placed around the rest shape
+    bvh.build(mesh.mRest ? *mesh.mRest : mesh.mParticles.positions, *mesh.mTetras);
+
+    mCorners.resize(corners * numVertices);
+    mWeights.resize(corners * numVertices);
+    int outside = 0;
+    #pragma omp parallel for reduction(+:outside)
+    for(int i = 0; i < numVertices; ++i){
+        int tet;
+        typename TetBVH<T,dim>::Weights weights;
+        if(!bvh.locate(mTriangles.positions[i], tet, weights)){
+            ++outside;
+        }
+        for(int k = 0; k < corners; ++k){
+            mCorners[corners * i + k] = tet >= 0 ? (*mesh.mTetras)[tet].mPIndices[k] : 0;
+            mWeights[corners * i + k] = tet >= 0 ? weights[k] : 0;
+        }
+    }
+    mOutside = outside;
+}
+
+template<class T, int dim>
+void RenderMesh<T,dim>::update(const Particles<T,dim>& particles) {
+    const int corners = dim + 1;
+    const int numVertices = mTriangles.positions.size();
+    const Eigen::Matrix<T,dim,1>* x = particles.positions.data();
+    #pragma omp parallel for
+    for(int i = 0; i < numVertices; ++i){
+        const int* c = &mCorners[corners * i];
+        const T* w = &mWeights[corners * i];
+        Eigen::Matrix<T,dim,1> p = w[0] * x[c[0]];
+        for(int k = 1; k < corners; ++k){
+            p += w[k] * x[c[k]];
+        }
+        mTriangles.positions[i] = p;
+    }
+    mTriangles.computeNormals();
+}
+
+template<class T, int dim>
+void RenderMesh<T,dim>::outputFrame(int frame, const std::string& directory) const {
+    std::string f = std::to_string(frame);
+    mTriangles.writePLY(directory + "/render" + std::string(f.length() < 4 ? 4 - f.length() : 0, '0') + f + ".ply");
+}
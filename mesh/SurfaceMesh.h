@@ -0,0 +1,100 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "TetraMesh.h"
+#include "TriangleMesh.h"
+
+// Boundary triangles of a tetrahedral mesh over a compacted vertex set.
+// Faces are extracted once and oriented outwards in the rest configuration;
+// each frame gathers the surface positions, computes area weighted vertex
+// normals and writes a binary PLY.
+template<class T, int dim>
+class SurfaceMesh {
+public:
+    SurfaceMesh();
+
+    // boundary faces are the ones without a neighbor in the mesh adjacency
+    void extract(const TetraMesh<T,dim>& mesh);
+    void update(const Particles<T,dim>& particles);     // positions and normals of the surface vertices
+    void outputFrame(int frame, const std::string& directory) const;      // directory/surfaceNNNN.ply
+
+    int numVertices() const { return mVertices.size(); }
+    int numFaces() const { return mTriangles.faces.size(); }
+
+    std::vector<int> mVertices;                     // particle index of each surface vertex
+    TriangleMesh<T,dim> mTriangles;                 // over the surface vertices
+};
+
+template<class T, int dim>
+SurfaceMesh<T,dim>::SurfaceMesh() {}
+
+template<class T, int dim>
+void SurfaceMesh<T,dim>::extract(const TetraMesh<T,dim>& mesh) {
+    const std::vector<Tetrahedron<T,dim>>& tetras = *mesh.mTetras;
+    const std::vector<int>& neighbors = mesh.mAdjacency->tetNeighbors;
+    // a resumed mesh may be deformed or inverted, the rest shape orients every face the same way
+    std::vector<Eigen::Matrix<T,dim,1>> x;
+    mesh.restPositions(x);
+
+    // faces without a neighboring tetrahedron, in tetrahedron order
+    mTriangles.faces.clear();
+    for(int n = 0; n < int(tetras.size()); ++n){
+        const std::vector<int>& p = tetras[n].mPIndices;
+        for(int f = 0; f < 4; ++f){
+            if(neighbors[4 * n + f] >= 0){
+                continue;
+            }
+            std::array<int,3> face = {{p[(f + 1) % 4], p[(f + 2) % 4], p[(f + 3) % 4]}};
+            // the normal points away from the vertex opposite the face
+            const Eigen::Matrix<T,dim,1> normal = (x[face[1]] - x[face[0]]).cross(x[face[2]] - x[face[0]]);
+            if(normal.dot(x[p[f]] - x[face[0]]) > 0){
+                std::swap(face[1], face[2]);
+            }
+            mTriangles.faces.push_back(face);
+        }
+    }
+
+    // compact the vertex set, surface vertices keep their particle order
+    std::vector<int> surfaceIndex(x.size(), -1);
+    for(const std::array<int,3>& face : mTriangles.faces){
+        for(int v : face){
+            surfaceIndex[v] = 0;
+        }
+    }
+    mVertices.clear();
+    for(unsigned int i = 0; i < x.size(); ++i){
+        if(surfaceIndex[i] == 0){
+            surfaceIndex[i] = mVertices.size();
+            mVertices.push_back(i);
+        }
+    }
+    for(std::array<int,3>& face : mTriangles.faces){
+        for(int& v : face){
+            v = surfaceIndex[v];
+        }
+    }
+
+    mTriangles.positions.resize(mVertices.size());
+    mTriangles.buildAdjacency();
+}
+
+template<class T, int dim>
+void SurfaceMesh<T,dim>::update(const Particles<T,dim>& particles) {
+    #pragma omp parallel for
+    for(int i = 0; i < int(mVertices.size()); ++i){
+        mTriangles.positions[i] = particles.positions[mVertices[i]];
+    }
+    mTriangles.computeNormals();
+}
+
+template<class T, int dim>
+void SurfaceMesh<T,dim>::outputFrame(int frame, const std::string& directory) const {
+    std::string f = std::to_string(frame);
+    mTriangles.writePLY(directory + "/surface" + std::string(f.length() < 4 ? 4 - f.length() : 0, '0') + f + ".ply");
+}
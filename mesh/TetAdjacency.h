@@ -0,0 +1,145 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "Tetrahedron.h"
+
+// Compressed sparse row adjacency of a tetrahedral mesh, built once from the
+// topology and read-only afterwards. All lists are flat int arrays, list i of
+// X is X[XStart[i]] to X[XStart[i + 1] - 1].
+//
+//   vertex -> tetrahedron corners   corner c is vertex c % (dim + 1) of tetrahedron c / (dim + 1),
+//                                   each list in tetrahedron order
+//   vertex -> vertices              vertices sharing a tetrahedron, sorted, without the vertex itself
+//   tetrahedron -> tetrahedra       dim + 1 per tetrahedron, the neighbor across the face opposite
+//                                   corner k, -1 on the boundary
+//
+// For P particles, N tetrahedra and E edges this takes 4 * (2 (P + 1) + 2 (dim + 1) N + 2 E) bytes,
+// about 4 * (2 P + 8 N + 2 E); box meshes have E between 5 P and 7 P.
+template<class T, int dim>
+class TetAdjacency {
+public:
+    TetAdjacency();
+
+    void build(int numParticles, const std::vector<Tetrahedron<T,dim>>& tetras);
+
+    int numParticles() const { return int(vertexTetStart.size()) - 1; }
+    int numTets() const { return tetNeighbors.size() / (dim + 1); }
+    size_t bytes() const;
+
+    std::vector<int> vertexTetStart;
+    std::vector<int> vertexTets;
+    std::vector<int> vertexVertexStart;
+    std::vector<int> vertexVertices;
+    std::vector<int> tetNeighbors;
+};
+
+template<class T, int dim>
+TetAdjacency<T,dim>::TetAdjacency() {}
+
+template<class T, int dim>
+size_t TetAdjacency<T,dim>::bytes() const {
+    return sizeof(int) * (vertexTetStart.size() + vertexTets.size() + vertexVertexStart.size()
+                          + vertexVertices.size() + tetNeighbors.size());
+}
+
+template<class T, int dim>
+void TetAdjacency<T,dim>::build(int numParticles, const std::vector<Tetrahedron<T,dim>>& tetras) {
+    const int corners = dim + 1;
+    const int numTets = tetras.size();
+
+    // vertex -> corners: count, prefix sum, fill in any order, then sort each list
+    std::unique_ptr<std::atomic<int>[]> fill(new std::atomic<int>[numParticles]);
+    for(int i = 0; i < numParticles; ++i){
+        fill[i].store(0, std::memory_order_relaxed);
+    }
+    #pragma omp parallel for
+    for(int n = 0; n < numTets; ++n){
+        for(int k = 0; k < corners; ++k){
+            fill[tetras[n].mPIndices[k]].fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    vertexTetStart.assign(numParticles + 1, 0);
+    for(int i = 0; i < numParticles; ++i){
+        vertexTetStart[i + 1] = vertexTetStart[i] + fill[i].load(std::memory_order_relaxed);
+        fill[i].store(vertexTetStart[i], std::memory_order_relaxed);
+    }
+    vertexTets.resize(vertexTetStart[numParticles]);
+    #pragma omp parallel for
+    for(int n = 0; n < numTets; ++n){
+        for(int k = 0; k < corners; ++k){
+            vertexTets[fill[tetras[n].mPIndices[k]].fetch_add(1, std::memory_order_relaxed)] = corners * n + k;
+        }
+    }
+    #pragma omp parallel for schedule(dynamic, 1024)
+    for(int i = 0; i < numParticles; ++i){
+        std::sort(vertexTets.begin() + vertexTetStart[i], vertexTets.begin() + vertexTetStart[i + 1]);
+    }
+
+    // vertex -> vertices: count the unique neighbors, prefix sum, then write them
+    auto neighbors = [&](int i, std::vector<int>& list){
+        list.clear();
+        for(int c = vertexTetStart[i]; c < vertexTetStart[i + 1]; ++c){
+            const std::vector<int>& p = tetras[vertexTets[c] / corners].mPIndices;
+            for(int k = 0; k < corners; ++k){
+                if(p[k] != i){
+                    list.push_back(p[k]);
+                }
+            }
+        }
+        std::sort(list.begin(), list.end());
+        list.erase(std::unique(list.begin(), list.end()), list.end());
+    };
+    vertexVertexStart.assign(numParticles + 1, 0);
+    #pragma omp parallel
+    {
+        std::vector<int> list;
+        #pragma omp for schedule(dynamic, 1024)
+        for(int i = 0; i < numParticles; ++i){
+            neighbors(i, list);
+            vertexVertexStart[i + 1] = list.size();
+        }
+    }
+    for(int i = 0; i < numParticles; ++i){
+        vertexVertexStart[i + 1] += vertexVertexStart[i];
+    }
+    vertexVertices.resize(vertexVertexStart[numParticles]);
+    #pragma omp parallel
+    {
+        std::vector<int> list;
+        #pragma omp for schedule(dynamic, 1024)
+        for(int i = 0; i < numParticles; ++i){
+            neighbors(i, list);
+            std::copy(list.begin(), list.end(), vertexVertices.begin() + vertexVertexStart[i]);
+        }
+    }
+
+    // tetrahedron -> tetrahedra: the other tetrahedron around the face's first vertex
+    // that also holds the face's remaining vertices
+    tetNeighbors.assign(corners * numTets, -1);
+    #pragma omp parallel for
+    for(int n = 0; n < numTets; ++n){
+        const std::vector<int>& p = tetras[n].mPIndices;
+        for(int k = 0; k < corners; ++k){
+            const int first = p[(k + 1) % corners];
+            for(int c = vertexTetStart[first]; c < vertexTetStart[first + 1]; ++c){
+                const int m = vertexTets[c] / corners;
+                if(m == n){
+                    continue;
+                }
+                const std::vector<int>& q = tetras[m].mPIndices;
+                bool shared = true;
+                for(int f = 2; f < corners && shared; ++f){
+                    shared = std::find(q.begin(), q.end(), p[(k + f) % corners]) != q.end();
+                }
+                if(shared){
+                    tetNeighbors[corners * n + k] = m;
+                    break;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/Dense>
+#include <Eigen/Geometry>
+
+#include "Tetrahedron.h"
+
+// Bounding volume hierarchy over tetrahedra for point location. Built once
+// from a set of positions, queries are read-only and can run in parallel.
+template<class T, int dim>
+class TetBVH {
+public:
+    typedef Eigen::Matrix<T,dim,1> Vec;
+    typedef Eigen::Matrix<T,dim+1,1> Weights;
+
+    TetBVH();
+
+    void build(const std::vector<Vec>& positions, const std::vector<Tetrahedron<T,dim>>& tetras);
+
+    // Tetrahedron containing p and the barycentric weights of its vertices, in
+    // mPIndices order. Outside the mesh this is the tetrahedron with the nearest
+    // bounding box and least negative weight, the weights then extrapolate.
+    // Returns whether p is inside.
+    bool locate(const Vec& p, int& tet, Weights& weights) const;
+
+    int numTets() const { return mInverse.size(); }
+
+private:
+    struct Node {
+        Eigen::AlignedBox<T,dim> box;
+        int left;               // children, -1 for leaves
+        int right;
+        int first;              // range of mOrder for leaves
+        int count;
+    };
+
+    static const int LEAF_SIZE = 4;
+    static constexpr T INSIDE_TOLERANCE = T(1e-6);     // points on shared faces count as inside
+
+    int buildNode(int first, int count, const std::vector<Vec>& centroids);
+    void weightsOf(int tet, const Vec& p, Weights& weights) const;
+
+    std::vector<Node> mNodes;
+    std::vector<int> mOrder;
+    std::vector<Eigen::AlignedBox<T,dim>> mBoxes;
+    // barycentric map of each tetrahedron, inverse of [x0 - x3, x1 - x3, x2 - x3] and x3
+    std::vector<Eigen::Matrix<T,dim,dim>> mInverse;
+    std::vector<Vec> mOrigin;
+    std::vector<bool> mDegenerate;
+};
+
+template<class T, int dim>
+TetBVH<T,dim>::TetBVH() {}
+
+template<class T, int dim>
+void TetBVH<T,dim>::build(const std::vector<Vec>& positions, const std::vector<Tetrahedron<T,dim>>& tetras) {
+    const int numTets = tetras.size();
+    mBoxes.resize(numTets);
+    mInverse.resize(numTets);
+    mOrigin.resize(numTets);
+    mDegenerate.assign(numTets, false);
+    std::vector<Vec> centroids(numTets);
+
+    #pragma omp parallel for
+    for(int n = 0; n < numTets; ++n){
+        const std::vector<int>& p = tetras[n].mPIndices;
+        Eigen::Matrix<T,dim,dim> D;
+        mBoxes[n].setEmpty();
+        for(int i = 0; i < dim + 1; ++i){
+            mBoxes[n].extend(positions[p[i]]);
+        }
+        for(int i = 0; i < dim; ++i){
+            D.col(i) = positions[p[i]] - positions[p[dim]];
+        }
+        mOrigin[n] = positions[p[dim]];
+        centroids[n] = mBoxes[n].center();
+        const T det = D.determinant();
+        if(det != 0){
+            mInverse[n] = D.inverse();
+        }
+        else{
+            mInverse[n].setZero();
+            mDegenerate[n] = true;
+        }
+    }
+
+    mOrder.resize(numTets);
+    for(int n = 0; n < numTets; ++n){
+        mOrder[n] = n;
+    }
+    mNodes.clear();
+    mNodes.reserve(2 * numTets / LEAF_SIZE + 1);
+    if(numTets > 0){
+        buildNode(0, numTets, centroids);
+    }
+}
+
+template<class T, int dim>
+int TetBVH<T,dim>::buildNode(int first, int count, const std::vector<Vec>& centroids) {
+    const int index = mNodes.size();
+    mNodes.push_back(Node());
+    Eigen::AlignedBox<T,dim> box, centers;
+    box.setEmpty();
+    centers.setEmpty();
+    for(int i = first; i < first + count; ++i){
+        box.extend(mBoxes[mOrder[i]]);
+        centers.extend(centroids[mOrder[i]]);
+    }
+    mNodes[index].box = box;
+    mNodes[index].first = first;
+    mNodes[index].count = count;
+    mNodes[index].left = -1;
+    mNodes[index].right = -1;
+    if(count <= LEAF_SIZE){
+        return index;
+    }
+
+    // median split along the longest axis of the centroids
+    int axis = 0;
+    centers.sizes().maxCoeff(&axis);
+    const int half = count / 2;
+    std::nth_element(mOrder.begin() + first, mOrder.begin() + first + half, mOrder.begin() + first + count,
+                     [&](int a, int b){ return centroids[a][axis] < centroids[b][axis]; });
+    const int left = buildNode(first, half, centroids);
+    const int right = buildNode(first + half, count - half, centroids);
+    mNodes[index].left = left;
+    mNodes[index].right = right;
+    return index;
+}
+
+template<class T, int dim>
+void TetBVH<T,dim>::weightsOf(int tet, const Vec& p, Weights& weights) const {
+    const Vec b = mInverse[tet] * (p - mOrigin[tet]);
+    weights.template head<dim>() = b;
+    weights[dim] = 1 - b.sum();
+}
+
+template<class T, int dim>
+bool TetBVH<T,dim>::locate(const Vec& p, int& tet, Weights& weights) const {
+    tet = -1;
+    if(mNodes.empty()){
+        return false;
+    }
+    // best candidate so far: box distance, then smallest weight
+    T bestDistance = std::numeric_limits<T>::max();
+    T bestWeight = -std::numeric_limits<T>::max();
+    Weights w;
+
+    int stack[64];
+    int top = 0;
+    stack[top++] = 0;
+    while(top > 0){
+        const Node& node = mNodes[stack[--top]];
+        const T distance = node.box.exteriorDistance(p);
+        if(distance > bestDistance){
+            continue;
+        }
+        if(node.left >= 0){
+            stack[top++] = node.left;
+            stack[top++] = node.right;
+            continue;
+        }
+        for(int i = node.first; i < node.first + node.count; ++i){
+            const int n = mOrder[i];
+            if(mDegenerate[n]){
+                continue;
+            }
+            const T boxDistance = mBoxes[n].exteriorDistance(p);
+            if(boxDistance > bestDistance){
+                continue;
+            }
+            weightsOf(n, p, w);
+            const T smallest = w.minCoeff();
+            if(boxDistance < bestDistance || smallest > bestWeight){
+                bestDistance = boxDistance;
+                bestWeight = smallest;
+                tet = n;
+                weights = w;
+                if(smallest >= -INSIDE_TOLERANCE){
+                    return true;
+                }
+            }
+        }
+    }
+    return bestWeight >= -INSIDE_TOLERANCE;
+}
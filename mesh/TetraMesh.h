@@ -1,35 +1,92 @@
 #pragma once
 
 #include <iostream>
+#include <memory>
 #include <string>
 
 #include "Mesh.h"
 #include "Particles.h"
+#include "TetAdjacency.h"
 #include "Tetrahedron.h"
 
 template<class T, int dim>
 class TetraMesh : public Mesh<T,dim>{
 public:
-    static double k;
-    static double nu;
-
     TetraMesh(std::string s);
     virtual ~TetraMesh();
 
     void generateTetras();      // read data from tetgen and populate particles and tetras
-    void outputFrame(int frame);    // write data to frame
+    void outputFrame(int frame, const std::string& directory);    // write data to directory/frameNNNN.bgeo
     void generateSimpleTetrahedron();
+    // structured box of cells x cells split into 5 or 6 tetrahedra each, interior vertices
+    // displaced by up to jitter * cell size
+    void generateBox(const Eigen::Vector3i& cells,
+                     const Eigen::Matrix<T,dim,1>& minCorner,
+                     const Eigen::Matrix<T,dim,1>& maxCorner,
+                     int tetsPerCell, T jitter, unsigned int seed);
+    // builds mAdjacency from the current tetrahedra, call again after replacing them
+    void buildAdjacency();
+    // rest position of every particle from the tetrahedra's mDm, each connected piece placed at the current
+    // position of its lowest numbered particle, needs mAdjacency
+    void restPositions(std::vector<Eigen::Matrix<T,dim,1>>& rest) const;
 
     Particles<T,dim> mParticles;
-    std::vector<Tetrahedron<T,dim>> mTetras;
+    // tetrahedra are read-only once precomputed, so copies of a mesh share them
+    std::shared_ptr<std::vector<Tetrahedron<T,dim>>> mTetras;
+    // shared the same way, null until buildAdjacency
+    std::shared_ptr<const TetAdjacency<T,dim>> mAdjacency;
+    // particle positions the mesh was built at, where it was placed in the scene; shared the same way and
+    // kept in checkpoints, null until the solver precomputes the mesh
+    std::shared_ptr<const std::vector<Eigen::Matrix<T,dim,1>>> mRest;
 };
 
 template<class T, int dim>
-TetraMesh<T,dim>::TetraMesh(std::string s) : Mesh<T,dim>(s) {}
+TetraMesh<T,dim>::TetraMesh(std::string s) : Mesh<T,dim>(s), mTetras(std::make_shared<std::vector<Tetrahedron<T,dim>>>()) {}
 
 template<class T, int dim>
 TetraMesh<T,dim>::~TetraMesh(){}
 
+template<class T, int dim>
+void TetraMesh<T,dim>::buildAdjacency(){
+    std::shared_ptr<TetAdjacency<T,dim>> adjacency = std::make_shared<TetAdjacency<T,dim>>();
+    adjacency->build(this->mParticles.positions.size(), *this->mTetras);
+    mAdjacency = adjacency;
+}
+
+template<class T, int dim>
+void TetraMesh<T,dim>::restPositions(std::vector<Eigen::Matrix<T,dim,1>>& rest) const{
+    const std::vector<Tetrahedron<T,dim>>& tetras = *mTetras;
+    const TetAdjacency<T,dim>& adjacency = *mAdjacency;
+    const int numParticles = mParticles.positions.size();
+    rest = mParticles.positions;
+    std::vector<char> placed(numParticles, 0);
+    std::vector<int> queue;
+    for(int first = 0; first < numParticles; ++first){
+        if(placed[first]){
+            continue;
+        }
+        placed[first] = 1;
+        queue.assign(1, first);
+        // breadth first over the tetrahedra around placed particles, column j of mDm is corner j minus corner dim
+        for(unsigned int next = 0; next < queue.size(); ++next){
+            const int i = queue[next];
+            for(int k = adjacency.vertexTetStart[i]; k < adjacency.vertexTetStart[i + 1]; ++k){
+                const Tetrahedron<T,dim>& t = tetras[adjacency.vertexTets[k] / (dim + 1)];
+                const int corner = adjacency.vertexTets[k] % (dim + 1);
+                const Eigen::Matrix<T,dim,1> last = corner == dim ? rest[i] : Eigen::Matrix<T,dim,1>(rest[i] - t.mDm.col(corner));
+                for(int j = 0; j < dim + 1; ++j){
+                    const int p = t.mPIndices[j];
+                    if(!placed[p]){
+                        rest[p] = j == dim ? last : Eigen::Matrix<T,dim,1>(last + t.mDm.col(j));
+                        placed[p] = 1;
+                        queue.push_back(p);
+                    }
+                }
+            }
+        }
+    }
+}
+
 template<class T, int dim>
 void TetraMesh<T,dim>::generateTetras(){
     std::ifstream instream; //input file stream
@@ -76,7 +133,6 @@ void TetraMesh<T,dim>::generateTetras(){
                     this->mParticles.velocities.push_back(Eigen::Matrix<T,dim,1>(0.0,0.0,0.0));
                     this->mParticles.masses.push_back(0.0);
                     this->mParticles.forces.push_back(Eigen::Matrix<T,dim,1>(0.0,0.0,0.0));
-                    this->mParticles.drags.push_back(Eigen::Matrix<T,dim,1>(0.0,0.0,0.0));
                     this->mParticles.tets.push_back(0);
 
                     outFile << x1 << ": " << x2 << " " << x3 << " " << x4 << "\n";  // .poly
@@ -113,7 +169,7 @@ void TetraMesh<T,dim>::generateTetras(){
 
                     // create tetrahedron instance
                     Tetrahedron<T, dim> tet(indices);
-                    this->mTetras.push_back(tet);
+                    this->mTetras->push_back(tet);
                     indices.clear();
 
                     outFile << (i * 3) + 1 <<": " << b << " " << c << " " << d << " " << b << "\n";
@@ -170,39 +226,106 @@ void TetraMesh<T,dim>::generateSimpleTetrahedron() {
     indices.push_back(1);
     indices.push_back(6);
     indices.push_back(3);
-    this->mTetras.push_back(Tetrahedron<T, dim>(indices));
+    this->mTetras->push_back(Tetrahedron<T, dim>(indices));
 
     indices.clear();
     indices.push_back(0);
     indices.push_back(1);
     indices.push_back(4);
     indices.push_back(3);
-    this->mTetras.push_back(Tetrahedron<T, dim>(indices));
+    this->mTetras->push_back(Tetrahedron<T, dim>(indices));
 
     indices.clear();
     indices.push_back(7);
     indices.push_back(4);
     indices.push_back(6);
     indices.push_back(3);
-    this->mTetras.push_back(Tetrahedron<T, dim>(indices));
+    this->mTetras->push_back(Tetrahedron<T, dim>(indices));
 
     indices.clear();
     indices.push_back(2);
     indices.push_back(1);
     indices.push_back(3);
     indices.push_back(6);
-    this->mTetras.push_back(Tetrahedron<T, dim>(indices));
+    this->mTetras->push_back(Tetrahedron<T, dim>(indices));
 
     indices.clear();
     indices.push_back(5);
     indices.push_back(6);
     indices.push_back(4);
     indices.push_back(1);
-    this->mTetras.push_back(Tetrahedron<T, dim>(indices));
+    this->mTetras->push_back(Tetrahedron<T, dim>(indices));
+}
+
+template<class T, int dim>
+void TetraMesh<T,dim>::generateBox(const Eigen::Vector3i& cells,
+                                   const Eigen::Matrix<T,dim,1>& minCorner,
+                                   const Eigen::Matrix<T,dim,1>& maxCorner,
+                                   int tetsPerCell, T jitter, unsigned int seed) {
+    const int nx = cells[0], ny = cells[1], nz = cells[2];
+    const int sx = nx + 1, sy = ny + 1, sz = nz + 1;
+    const Eigen::Matrix<T,dim,1> h = (maxCorner - minCorner).cwiseQuotient(Eigen::Matrix<T,dim,1>(nx, ny, nz));
+
+    const int first = this->mParticles.positions.size();
+    this->mParticles.resize(first + sx * sy * sz);
+
+    #pragma omp parallel for
+    for(int k = 0; k < sz; ++k){
+        for(int j = 0; j < sy; ++j){
+            for(int i = 0; i < sx; ++i){
+                const int v = i + sx * (j + sy * k);
+                Eigen::Matrix<T,dim,1> x = minCorner + Eigen::Matrix<T,dim,1>(i * h[0], j * h[1], k * h[2]);
+                const bool interior = i > 0 && i < nx && j > 0 && j < ny && k > 0 && k < nz;
+                if(jitter > 0 && interior){
+                    // hash of the vertex index so the result does not depend on the thread count
+                    unsigned int state = seed ^ (unsigned int)(v * 2654435761u);
+                    for(int d = 0; d < dim; ++d){
+                        state = state * 1664525u + 1013904223u;
+                        x[d] += jitter * h[d] * ((state >> 8) * (2.0 / 16777216.0) - 1.0);
+                    }
+                }
+                this->mParticles.positions[first + v] = x;
+            }
+        }
+    }
+
+    // cell corner c is offset (c & 1, c >> 1 & 1, c >> 2 & 1). The 5 tetrahedron split
+    // alternates orientation between neighbouring cells so face diagonals match, the
+    // 6 tetrahedron split shares the 0-7 diagonal and needs no alternation.
+    static const int fiveEven[5][4] = {{1, 2, 4, 7}, {0, 1, 2, 4}, {3, 1, 2, 7}, {5, 1, 4, 7}, {6, 2, 4, 7}};
+    static const int fiveOdd[5][4] = {{0, 3, 5, 6}, {1, 0, 3, 5}, {2, 0, 3, 6}, {4, 0, 5, 6}, {7, 3, 5, 6}};
+    static const int six[6][4] = {{0, 1, 3, 7}, {0, 1, 5, 7}, {0, 2, 3, 7}, {0, 2, 6, 7}, {0, 4, 5, 7}, {0, 4, 6, 7}};
+    if(tetsPerCell != 5 && tetsPerCell != 6){
+        std::cout << "error: box cells split into 5 or 6 tetrahedra" << std::endl;
+        exit(1);
+    }
+
+    const int firstTet = this->mTetras->size();
+    this->mTetras->resize(firstTet + nx * ny * nz * tetsPerCell, Tetrahedron<T,dim>(std::vector<int>(dim + 1, 0)));
+
+    #pragma omp parallel for
+    for(int k = 0; k < nz; ++k){
+        for(int j = 0; j < ny; ++j){
+            for(int i = 0; i < nx; ++i){
+                int corners[8];
+                for(int c = 0; c < 8; ++c){
+                    corners[c] = first + (i + (c & 1)) + sx * ((j + ((c >> 1) & 1)) + sy * (k + ((c >> 2) & 1)));
+                }
+                const int (*split)[4] = tetsPerCell == 6 ? six : ((i + j + k) % 2 == 0 ? fiveEven : fiveOdd);
+                const int cell = i + nx * (j + ny * k);
+                for(int t = 0; t < tetsPerCell; ++t){
+                    std::vector<int>& indices = (*this->mTetras)[firstTet + cell * tetsPerCell + t].mPIndices;
+                    for(int v = 0; v < 4; ++v){
+                        indices[v] = corners[split[t][v]];
+                    }
+                }
+            }
+        }
+    }
 }
 
 template<class T, int dim>
-void TetraMesh<T,dim>::outputFrame(int frame){
+void TetraMesh<T,dim>::outputFrame(int frame, const std::string& directory){
     Partio::ParticlesDataMutable* parts = Partio::create();
        Partio::ParticleAttribute posH, vH, mH, fH;
        mH = parts->addAttribute("m", Partio::VECTOR, 1);
@@ -238,7 +361,7 @@ void TetraMesh<T,dim>::outputFrame(int frame){
           else
              particleFile = "frame" + f +".bgeo";
 
-          particleFile = "output/" + particleFile;
+          particleFile = directory + "/" + particleFile;
           Partio::write(particleFile.c_str(), *parts);
           parts->release();
 }
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <iostream>
+#include <algorithm>
+#include <limits>
 #include <vector>
 #include <string>
 
@@ -11,6 +13,8 @@
 template<class T, int dim>
 class Tetrahedron{
 public:
+    static constexpr double DENSITY = 1000.0;
+
 	std::vector<int> mPIndices;         // tetrahedron vertices
     Eigen::Matrix<T,dim,dim> mDm;
     Eigen::Matrix<T,dim,dim> mDmInv;    // rest configuration Dm inverse
@@ -23,6 +27,15 @@ public:
 
     // precompute populates Dm inverse matrix and tetrahedron volume in rest configuration
     void precompute();
+    // smallest distance of a vertex from the opposite face in the rest configuration
+    T minHeight() const;
+    // time a pressure wave of the material takes to cross minHeight, the longest stable explicit
+    // step up to a Courant number; the density is mass / volume, so a mass scaled element
+    // allows a longer step, and a degenerate one exerts no force and limits nothing
+    T stableTimeStep(T mu, T lambda) const;
+    // F = sum over corners k of x_k c_k^T, so dF / dx_k = c_k: row k of DmInv, and the last corner,
+    // which the columns of Dm start from, takes minus their sum
+    Eigen::Matrix<T,dim,1> corner(int k) const;
 	void print_info() const;           // for debugging
 };
 
@@ -52,7 +65,45 @@ void Tetrahedron<T,dim>::precompute(){
         std::cout << "bad tetrahedron" << std::endl;
     }
     mVolDmInvT = volume * (mDmInv.transpose());
-    mass = 1000.f * volume; // density is 1000
+    mass = T(DENSITY) * volume;
+}
+
+template<class T, int dim>
+T Tetrahedron<T,dim>::minHeight() const{
+    // dim volume / the largest face, the faces spanned by edges of mDm (from vertex dim)
+    T largest = 0;
+    if(dim == 2){
+        largest = std::max(std::max(mDm.col(0).norm(), mDm.col(1).norm()), (mDm.col(1) - mDm.col(0)).norm());
+    }
+    else{
+        const Eigen::Matrix<T,dim,1> edges[4][2] = {{mDm.col(1), mDm.col(2)}, {mDm.col(0), mDm.col(2)},
+                                                    {mDm.col(0), mDm.col(1)},
+                                                    {mDm.col(1) - mDm.col(0), mDm.col(2) - mDm.col(0)}};
+        for(int f = 0; f < 4; ++f){
+            const Eigen::Matrix<T,dim,1>& a = edges[f][0];
+            const Eigen::Matrix<T,dim,1>& b = edges[f][1];
+            const T gram = a.squaredNorm() * b.squaredNorm() - a.dot(b) * a.dot(b);
+            largest = std::max(largest, T(0.5) * std::sqrt(std::max(gram, T(0))));
+        }
+    }
+    return largest > 0 ? dim * volume / largest : T(0);
+}
+
+template<class T, int dim>
+T Tetrahedron<T,dim>::stableTimeStep(T mu, T lambda) const{
+    if(volume == 0){
+        return std::numeric_limits<T>::infinity();
+    }
+    // pressure wave speed sqrt((lambda + 2 mu) / density)
+    return minHeight() / std::sqrt((lambda + 2 * mu) * volume / mass);
+}
+
+template<class T, int dim>
+Eigen::Matrix<T,dim,1> Tetrahedron<T,dim>::corner(int k) const{
+    if(k < dim){
+        return mDmInv.row(k).transpose();
+    }
+    return -mDmInv.colwise().sum().transpose();
 }
 
 template<class T, int dim>
@@ -0,0 +1,331 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/Dense>
+
+// Triangle mesh with per-vertex normals, read from PLY or STL and written as
+// binary PLY. Polygons are triangulated as fans, STL vertices are welded.
+template<class T, int dim>
+class TriangleMesh {
+public:
+    TriangleMesh();
+
+    bool read(const std::string& path);         // .ply (ascii or binary little endian) or .stl (ascii or binary)
+    void buildAdjacency();                      // faces around each vertex, call when the faces change
+    void computeNormals();                      // area weighted vertex normals, in parallel
+    bool writePLY(const std::string& path) const;
+
+    std::vector<Eigen::Matrix<T,dim,1>> positions;
+    std::vector<Eigen::Matrix<T,dim,1>> normals;
+    std::vector<std::array<int,3>> faces;       // counter clockwise seen from outside
+
+private:
+    bool readPLY(std::ifstream& in, const std::string& path);
+    bool readSTL(std::ifstream& in, const std::string& path);
+    void addPolygon(const std::vector<int>& polygon);
+
+    // faces around each vertex, so normals are gathered without write conflicts
+    std::vector<int> mVertexFaceStart;
+    std::vector<int> mVertexFaces;
+    std::vector<Eigen::Matrix<T,dim,1>> mFaceNormals;
+};
+
+template<class T, int dim>
+TriangleMesh<T,dim>::TriangleMesh() {}
+
+template<class T, int dim>
+bool TriangleMesh<T,dim>::read(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if(!in){
+        std::cout << "Unable to open file " << path << std::endl;
+        return false;
+    }
+    positions.clear();
+    faces.clear();
+    const std::string extension = path.substr(path.find_last_of('.') + 1);
+    bool ok = false;
+    if(extension == "ply" || extension == "PLY"){
+        ok = readPLY(in, path);
+    }
+    else if(extension == "stl" || extension == "STL"){
+        ok = readSTL(in, path);
+    }
+    else{
+        std::cout << "error: " << path << " is not a .ply or .stl file" << std::endl;
+    }
+    if(ok){
+        buildAdjacency();
+        computeNormals();
+    }
+    return ok;
+}
+
+template<class T, int dim>
+void TriangleMesh<T,dim>::addPolygon(const std::vector<int>& polygon) {
+    for(unsigned int i = 2; i < polygon.size(); ++i){
+        faces.push_back({{polygon[0], polygon[i - 1], polygon[i]}});
+    }
+}
+
+template<class T, int dim>
+bool TriangleMesh<T,dim>::readPLY(std::ifstream& in, const std::string& path) {
+    struct Property {
+        std::string name;
+        std::string type;
+        std::string countType;      // non-empty for list properties
+    };
+    struct Element {
+        std::string name;
+        int count;
+        std::vector<Property> properties;
+    };
+
+    std::string line, format;
+    std::vector<Element> elements;
+    std::getline(in, line);
+    if(line.compare(0, 3, "ply") != 0){
+        std::cout << "error: " << path << " is not a PLY file" << std::endl;
+        return false;
+    }
+    while(std::getline(in, line)){
+        if(!line.empty() && line.back() == '\r'){
+            line.pop_back();
+        }
+        std::istringstream words(line);
+        std::string keyword;
+        words >> keyword;
+        if(keyword == "format"){
+            words >> format;
+        }
+        else if(keyword == "element"){
+            Element element;
+            words >> element.name >> element.count;
+            elements.push_back(element);
+        }
+        else if(keyword == "property" && !elements.empty()){
+            Property property;
+            words >> property.type;
+            if(property.type == "list"){
+                words >> property.countType >> property.type;
+            }
+            words >> property.name;
+            elements.back().properties.push_back(property);
+        }
+        else if(keyword == "end_header"){
+            break;
+        }
+    }
+    if(format != "ascii" && format != "binary_little_endian"){
+        std::cout << "error: " << path << " has unsupported PLY format " << format << std::endl;
+        return false;
+    }
+    const bool ascii = format == "ascii";
+
+    auto readValue = [&](const std::string& type) -> double {
+        if(ascii){
+            double value = 0;
+            in >> value;
+            return value;
+        }
+        char bytes[8] = {0};
+        if(type == "char" || type == "int8"){ in.read(bytes, 1); return *reinterpret_cast<int8_t*>(bytes); }
+        if(type == "uchar" || type == "uint8"){ in.read(bytes, 1); return *reinterpret_cast<uint8_t*>(bytes); }
+        if(type == "short" || type == "int16"){ in.read(bytes, 2); int16_t v; std::memcpy(&v, bytes, 2); return v; }
+        if(type == "ushort" || type == "uint16"){ in.read(bytes, 2); uint16_t v; std::memcpy(&v, bytes, 2); return v; }
+        if(type == "int" || type == "int32"){ in.read(bytes, 4); int32_t v; std::memcpy(&v, bytes, 4); return v; }
+        if(type == "uint" || type == "uint32"){ in.read(bytes, 4); uint32_t v; std::memcpy(&v, bytes, 4); return v; }
+        if(type == "float" || type == "float32"){ in.read(bytes, 4); float v; std::memcpy(&v, bytes, 4); return v; }
+        in.read(bytes, 8);
+        double v;
+        std::memcpy(&v, bytes, 8);
+        return v;
+    };
+
+    std::vector<int> polygon;
+    for(const Element& element : elements){
+        for(int i = 0; i < element.count; ++i){
+            Eigen::Matrix<T,dim,1> x = Eigen::Matrix<T,dim,1>::Zero();
+            for(const Property& property : element.properties){
+                if(!property.countType.empty()){
+                    const int count = int(readValue(property.countType));
+                    polygon.resize(count);
+                    for(int k = 0; k < count; ++k){
+                        polygon[k] = int(readValue(property.type));
+                    }
+                    if(element.name == "face" && (property.name == "vertex_indices" || property.name == "vertex_index")){
+                        addPolygon(polygon);
+                    }
+                    continue;
+                }
+                const double value = readValue(property.type);
+                const int axis = property.name == "x" ? 0 : property.name == "y" ? 1 : property.name == "z" ? 2 : -1;
+                if(axis >= 0 && axis < dim){
+                    x[axis] = value;
+                }
+            }
+            if(element.name == "vertex"){
+                positions.push_back(x);
+            }
+        }
+    }
+    if(!in){
+        std::cout << "error: " << path << " is truncated" << std::endl;
+        return false;
+    }
+    for(const std::array<int,3>& face : faces){
+        for(int v : face){
+            if(v < 0 || v >= int(positions.size())){
+                std::cout << "error: " << path << " has a face with a bad vertex index" << std::endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+template<class T, int dim>
+bool TriangleMesh<T,dim>::readSTL(std::ifstream& in, const std::string& path) {
+    // binary STL is an 80 byte header, a triangle count and 50 bytes per triangle
+    in.seekg(0, std::ios::end);
+    const std::streamoff size = in.tellg();
+    in.seekg(80);
+    uint32_t triangles = 0;
+    in.read(reinterpret_cast<char*>(&triangles), 4);
+    const bool binary = in && size == 84 + 50 * std::streamoff(triangles);
+
+    std::vector<std::array<float,3>> corners;
+    if(binary){
+        char record[50];
+        for(uint32_t t = 0; t < triangles; ++t){
+            in.read(record, 50);
+            for(int c = 0; c < 3; ++c){
+                std::array<float,3> corner;
+                std::memcpy(corner.data(), record + 12 * (c + 1), 12);
+                corners.push_back(corner);
+            }
+        }
+    }
+    else{
+        in.clear();
+        in.seekg(0);
+        std::string word;
+        while(in >> word){
+            if(word == "vertex"){
+                std::array<float,3> corner;
+                in >> corner[0] >> corner[1] >> corner[2];
+                corners.push_back(corner);
+            }
+        }
+        in.clear();
+    }
+    if(corners.empty() || corners.size() % 3 != 0){
+        std::cout << "error: " << path << " has no triangles" << std::endl;
+        return false;
+    }
+
+    // every triangle repeats its corners, shared corners become one vertex
+    std::map<std::array<float,3>, int> welded;
+    std::vector<int> polygon(3);
+    for(unsigned int i = 0; i < corners.size(); ++i){
+        std::map<std::array<float,3>, int>::iterator it = welded.find(corners[i]);
+        if(it == welded.end()){
+            it = welded.insert(std::make_pair(corners[i], int(positions.size()))).first;
+            Eigen::Matrix<T,dim,1> x = Eigen::Matrix<T,dim,1>::Zero();
+            for(int k = 0; k < dim && k < 3; ++k){
+                x[k] = corners[i][k];
+            }
+            positions.push_back(x);
+        }
+        polygon[i % 3] = it->second;
+        if(i % 3 == 2){
+            addPolygon(polygon);
+        }
+    }
+    return true;
+}
+
+template<class T, int dim>
+void TriangleMesh<T,dim>::buildAdjacency() {
+    mVertexFaceStart.assign(positions.size() + 1, 0);
+    for(const std::array<int,3>& face : faces){
+        for(int v : face){
+            ++mVertexFaceStart[v + 1];
+        }
+    }
+    for(unsigned int i = 0; i < positions.size(); ++i){
+        mVertexFaceStart[i + 1] += mVertexFaceStart[i];
+    }
+    mVertexFaces.resize(mVertexFaceStart.back());
+    std::vector<int> fill(mVertexFaceStart.begin(), mVertexFaceStart.end() - 1);
+    for(unsigned int f = 0; f < faces.size(); ++f){
+        for(int v : faces[f]){
+            mVertexFaces[fill[v]++] = f;
+        }
+    }
+    normals.resize(positions.size());
+    mFaceNormals.resize(faces.size());
+}
+
+template<class T, int dim>
+void TriangleMesh<T,dim>::computeNormals() {
+    // unnormalized face normals are weighted by twice the face area
+    #pragma omp parallel for
+    for(int f = 0; f < int(faces.size()); ++f){
+        const std::array<int,3>& face = faces[f];
+        mFaceNormals[f] = (positions[face[1]] - positions[face[0]]).cross(positions[face[2]] - positions[face[0]]);
+    }
+    #pragma omp parallel for
+    for(int i = 0; i < int(positions.size()); ++i){
+        Eigen::Matrix<T,dim,1> normal = Eigen::Matrix<T,dim,1>::Zero();
+        for(int k = mVertexFaceStart[i]; k < mVertexFaceStart[i + 1]; ++k){
+            normal += mFaceNormals[mVertexFaces[k]];
+        }
+        const T length = normal.norm();
+        normals[i] = length > 0 ? Eigen::Matrix<T,dim,1>(normal / length) : normal;
+    }
+}
+
+template<class T, int dim>
+bool TriangleMesh<T,dim>::writePLY(const std::string& path) const {
+    std::ofstream out(path, std::ios::binary);
+    if(!out){
+        std::cout << "Unable to open file " << path << std::endl;
+        return false;
+    }
+    out << "ply\nformat binary_little_endian 1.0\n"
+        << "element vertex " << positions.size() << "\n"
+        << "property float x\nproperty float y\nproperty float z\n"
+        << "property float nx\nproperty float ny\nproperty float nz\n"
+        << "element face " << faces.size() << "\n"
+        << "property list uchar int vertex_indices\n"
+        << "end_header\n";
+
+    // one buffer per element block, x86 is little endian
+    std::vector<float> vertices(6 * positions.size(), 0.f);
+    for(unsigned int i = 0; i < positions.size(); ++i){
+        for(int k = 0; k < dim && k < 3; ++k){
+            vertices[6 * i + k] = positions[i][k];
+            vertices[6 * i + 3 + k] = normals[i][k];
+        }
+    }
+    out.write(reinterpret_cast<const char*>(vertices.data()), vertices.size() * sizeof(float));
+
+    const int faceBytes = 1 + 3 * sizeof(int);
+    std::vector<char> faceData(faceBytes * faces.size());
+    for(unsigned int f = 0; f < faces.size(); ++f){
+        faceData[faceBytes * f] = 3;
+        std::memcpy(&faceData[faceBytes * f + 1], faces[f].data(), 3 * sizeof(int));
+    }
+    out.write(faceData.data(), faceData.size());
+    return bool(out);
+}
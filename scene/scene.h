@@ -11,7 +11,9 @@ class Scene
         Scene();
         virtual ~Scene();
         bool checkCollisions(const Eigen::Matrix<T, dim, 1> pos, Eigen::Matrix<T, dim,1> &out_pos) const;
-        void outputFrame(int currFrame);
+        // collisions against the shapes as they will be after updatePosition(dt), without moving them
+        bool checkCollisions(const Eigen::Matrix<T, dim, 1> pos, Eigen::Matrix<T, dim,1> &out_pos, T dt) const;
+        void outputFrame(int currFrame, const std::string& directory);
         void updatePosition(T dt);
         
         std::vector<Shape<T, dim>*> shapes;
@@ -59,9 +61,25 @@ bool Scene<T, dim>::checkCollisions(const Eigen::Matrix<T, dim, 1> pos, Eigen::M
 }
 
 template<class T, int dim>
-void Scene<T, dim>::outputFrame(int currFrame) {
+bool Scene<T, dim>::checkCollisions(const Eigen::Matrix<T, dim, 1> pos, Eigen::Matrix<T, dim, 1> &out_pos, T dt) const {
+
+    bool collide = false;
+    for (unsigned int i = 0; i < shapes.size(); ++i) {
+        // a shape moved by d contains pos where the unmoved shape contains pos - d
+        const Eigen::Matrix<T, dim, 1> displacement = dt * shapes[i]->getVelocity();
+        Eigen::Matrix<T, dim, 1> out;
+        if (shapes[i]->checkCollisions(pos - displacement, out)) {
+            collide = true;
+            out_pos = out + displacement;
+        }
+    }
+    return collide;
+}
+
+template<class T, int dim>
+void Scene<T, dim>::outputFrame(int currFrame, const std::string& directory) {
     for (unsigned int i = 0; i < shapes.size(); ++i) {
-        shapes[i]->outputFrame(currFrame);
+        shapes[i]->outputFrame(currFrame, directory);
     }
 }
 
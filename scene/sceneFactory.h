@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+
+#include "scene.h"
+#include "defaultScene.h"
+#include "plinkoScene.h"
+#include "bulldozeScene.h"
+#include "constrainedTop.h"
+
+// Creates the scene registered under name, or returns nullptr if there is none.
+template<class T, int dim>
+Scene<T, dim>* createScene(const std::string& name) {
+    if (name == "default") {
+        return new DefaultScene<T, dim>();
+    }
+    if (name == "plinko") {
+        return new PlinkoScene<T, dim>();
+    }
+    if (name == "bulldoze") {
+        return new BulldozeScene<T, dim>();
+    }
+    if (name == "constrained") {
+        return new ConstrainedTop<T, dim>();
+    }
+    std::cout << "error: unknown scene " << name << std::endl;
+    return nullptr;
+}
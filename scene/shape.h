@@ -2,19 +2,24 @@
 
 #pragma once
 
+#include "../utility/FileHelper.h"
 
 template<class T, int dim>
 class Shape
 {
 public:
-    Shape(std::string file) : filepath(file), isMoving(true) {}
-    Shape() : filepath(""), isMoving(false) {}
+    Shape(std::string file) : center(Eigen::Matrix<T, dim, 1>::Zero()), velocity(Eigen::Matrix<T, dim, 1>::Zero()), filepath(file), isMoving(true) {}
+    Shape() : center(Eigen::Matrix<T, dim, 1>::Zero()), velocity(Eigen::Matrix<T, dim, 1>::Zero()), filepath(""), isMoving(false) {}
 
     virtual ~Shape(){}
     virtual bool checkCollisions(const Eigen::Matrix<T, dim, 1> &pos, Eigen::Matrix<T, dim, 1> &out_pos) const = 0;
+    // axis aligned box around every position checkCollisions reports, infinite where the shape is
+    virtual void bounds(Eigen::Matrix<T, dim, 1> &min, Eigen::Matrix<T, dim, 1> &max) const = 0;
     void setCenter(Eigen::Matrix<T, dim, 1> &n_cen);
     void setVelocity(Eigen::Matrix<T, dim, 1> &n_vel);
-    void outputFrame(int frame);
+    const Eigen::Matrix<T, dim, 1>& getCenter() const;
+    const Eigen::Matrix<T, dim, 1>& getVelocity() const;
+    void outputFrame(int frame, const std::string& directory);
     void updatePosition(T dt);
 
 protected:
@@ -36,6 +41,16 @@ void Shape<T, dim>::setVelocity(Eigen::Matrix<T, dim, 1> &n_vel) {
     velocity = n_vel;
 }
 
+template<class T, int dim>
+const Eigen::Matrix<T, dim, 1>& Shape<T, dim>::getCenter() const {
+    return center;
+}
+
+template<class T, int dim>
+const Eigen::Matrix<T, dim, 1>& Shape<T, dim>::getVelocity() const {
+    return velocity;
+}
+
 template<class T, int dim>
 void Shape<T, dim>::updatePosition(T dt) {
     //center = center + (dt * velocity);
@@ -44,7 +59,7 @@ void Shape<T, dim>::updatePosition(T dt) {
 }
 
 template<class T, int dim>
-void Shape<T,dim>::outputFrame(int frame){
+void Shape<T,dim>::outputFrame(int frame, const std::string& directory){
     if (isMoving) {
         Partio::ParticlesDataMutable* parts = Partio::create();
         Partio::ParticleAttribute posH, vH;
@@ -71,7 +86,9 @@ void Shape<T,dim>::outputFrame(int frame){
         else
             particleFile = "frame" + f +".bgeo";
 
-        particleFile = filepath + "/" + particleFile;
+        const std::string shapeDir = directory + "/" + filepath;
+        FileHelper::makeDirectory(shapeDir);
+        particleFile = shapeDir + "/" + particleFile;
         Partio::write(particleFile.c_str(), *parts);
         parts->release();
     }
@@ -11,6 +11,7 @@ class Sphere : public Shape<T, dim>
         Sphere() : Shape<T, dim>() {};
         Sphere(std::string file);
         bool checkCollisions(const Eigen::Matrix<T, dim, 1> &pos, Eigen::Matrix<T, dim, 1> &out_pos) const override;
+        void bounds(Eigen::Matrix<T, dim, 1> &min, Eigen::Matrix<T, dim, 1> &max) const override;
 
     private:
         float radius = 1.0f;
@@ -71,3 +72,9 @@ bool Sphere<T, dim>::checkCollisions(const Eigen::Matrix<T, dim, 1> &pos, Eigen:
     return false;
 }
 
+template<class T, int dim>
+void Sphere<T, dim>::bounds(Eigen::Matrix<T, dim, 1> &min, Eigen::Matrix<T, dim, 1> &max) const
+{
+    min = this->center - Eigen::Matrix<T, dim, 1>::Constant(T(radius));
+    max = this->center + Eigen::Matrix<T, dim, 1>::Constant(T(radius));
+}
@@ -1,6 +1,7 @@
 // base copied from CIS 561
 
 #pragma  once
+#include <limits>
 #include "shape.h"
 
 //A SquarePlane is assumed to have a center of <0,0,0> and is horizontal.
@@ -11,6 +12,7 @@ class SquarePlane : public Shape<T, dim>
         SquarePlane() : Shape<T, dim>() {};
         SquarePlane(std::string file);
         bool checkCollisions(const Eigen::Matrix<T, dim, 1> &pos, Eigen::Matrix<T, dim, 1> &out_pos) const override;
+        void bounds(Eigen::Matrix<T, dim, 1> &min, Eigen::Matrix<T, dim, 1> &max) const override;
 
     private:
         float length_half = 200.f;
@@ -57,3 +59,12 @@ bool SquarePlane<T, dim>::checkCollisions(const Eigen::Matrix<T, dim, 1> &pos, E
     return false;
 }
 
+template<class T, int dim>
+void SquarePlane<T, dim>::bounds(Eigen::Matrix<T, dim, 1> &min, Eigen::Matrix<T, dim, 1> &max) const
+{
+    // checkCollisions takes everything below the plane within length_half of the center in x or z,
+    // which is unbounded in both
+    min = Eigen::Matrix<T, dim, 1>::Constant(-std::numeric_limits<T>::infinity());
+    max = Eigen::Matrix<T, dim, 1>::Constant(std::numeric_limits<T>::infinity());
+    max[1] = this->center[1];
+}
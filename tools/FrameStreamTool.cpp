@@ -0,0 +1,132 @@
+// Reads frame streams written with output.format = stream.
+//
+//   FEMStream info <frames.femstream>
+//   FEMStream extract <frames.femstream> <frame> <out.bgeo>
+//   FEMStream export <frames.femstream> <directory> [first last]
+//
+// extract decodes a single frame, export writes directory/frameNNNN.bgeo for
+// every stored frame in [first, last] in the layout TetraMesh::outputFrame uses.
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Partio.h"
+#include "../utility/FileHelper.h"
+#include "../utility/FrameStream.h"
+
+namespace {
+
+void printUsage(const char* program)
+{
+    std::cout << "usage: " << program << " info <frames.femstream>\n"
+              << "       " << program << " extract <frames.femstream> <frame> <out.bgeo>\n"
+              << "       " << program << " export <frames.femstream> <directory> [first last]" << std::endl;
+}
+
+std::string frameFileName(int frame)
+{
+    std::string f = std::to_string(frame);
+    return "frame" + std::string(f.length() < 4 ? 4 - f.length() : 0, '0') + f + ".bgeo";
+}
+
+bool writeFrame(FrameStreamReader& reader, int frame, const std::string& path)
+{
+    std::vector<float> positions, velocities, forces;
+    if(!reader.read(frame, positions, velocities, forces)){
+        return false;
+    }
+
+    Partio::ParticlesDataMutable* parts = Partio::create();
+    Partio::ParticleAttribute posH, vH, mH, fH;
+    const bool hasMass = !reader.masses().empty();
+    if(hasMass){
+        mH = parts->addAttribute("m", Partio::VECTOR, 1);
+    }
+    if(!positions.empty()){
+        posH = parts->addAttribute("position", Partio::VECTOR, 3);
+    }
+    if(!velocities.empty()){
+        vH = parts->addAttribute("v", Partio::VECTOR, 3);
+    }
+    if(!forces.empty()){
+        fH = parts->addAttribute("f", Partio::VECTOR, 3);
+    }
+
+    for(int i = 0; i < reader.numParticles(); ++i){
+        int idx = parts->addParticle();
+        if(hasMass){
+            parts->dataWrite<float>(mH, idx)[0] = reader.masses()[i];
+        }
+        for(int k = 0; k < 3; ++k){
+            if(!positions.empty()) parts->dataWrite<float>(posH, idx)[k] = positions[3 * i + k];
+            if(!velocities.empty()) parts->dataWrite<float>(vH, idx)[k] = velocities[3 * i + k];
+            if(!forces.empty()) parts->dataWrite<float>(fH, idx)[k] = forces[3 * i + k];
+        }
+    }
+
+    Partio::write(path.c_str(), *parts);
+    parts->release();
+    return true;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc < 3){
+        printUsage(argv[0]);
+        return 1;
+    }
+    const std::string command = argv[1];
+    FrameStreamReader reader;
+    if(!reader.open(argv[2])){
+        std::cout << "Unable to open frame stream " << argv[2] << std::endl;
+        return 1;
+    }
+
+    if(command == "info" && argc == 3){
+        size_t bytes = 0;
+        int keyframes = 0;
+        for(int i = 0; i < reader.numFrames(); ++i){
+            bytes += reader.frameBytes(i);
+            keyframes += reader.isKeyframe(i);
+        }
+        std::cout << reader.numParticles() << " particles, " << reader.numFrames() << " frames";
+        if(reader.numFrames() > 0){
+            std::cout << " (" << reader.frameNumber(0) << " to " << reader.frameNumber(reader.numFrames() - 1) << ")";
+        }
+        std::cout << ", " << keyframes << " keyframes\n"
+                  << "attributes " << FrameStream::attributeNames(reader.attributes())
+                  << ", " << reader.bits() << " bits, keyframe every " << reader.keyframeEvery() << " frames\n";
+        if(reader.numFrames() > 0){
+            std::cout << "average frame " << bytes / reader.numFrames() << " bytes" << std::endl;
+        }
+        return 0;
+    }
+    if(command == "extract" && argc == 5){
+        return writeFrame(reader, std::atoi(argv[3]), argv[4]) ? 0 : 1;
+    }
+    if(command == "export" && (argc == 4 || argc == 6)){
+        const std::string directory = argv[3];
+        const int first = argc == 6 ? std::atoi(argv[4]) : -1;
+        const int last = argc == 6 ? std::atoi(argv[5]) : -1;
+        if(!FileHelper::makeDirectory(directory)){
+            return 1;
+        }
+        for(int i = 0; i < reader.numFrames(); ++i){
+            const int frame = reader.frameNumber(i);
+            if(argc == 6 && (frame < first || frame > last)){
+                continue;
+            }
+            if(!writeFrame(reader, frame, directory + "/" + frameFileName(frame))){
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    printUsage(argv[0]);
+    return 1;
+}
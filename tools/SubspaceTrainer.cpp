@@ -0,0 +1,69 @@
+// Trains the basis and cubature of the subspace integrator from checkpoints of
+// a full simulation of the same mesh and material.
+//
+//   FEMTrain [config.ini] [--set section.key=value]... <checkpoint.bin>...
+//
+// Arguments ending in .ini are configurations, every other argument that is not
+// an option is a checkpoint. The result is written to subspace.basis, keyed on
+// the mesh, material and subspace settings the subspace integrator reads it with.
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../FEMSolver.h"
+
+namespace {
+
+void printUsage(const char* program)
+{
+    std::cout << "usage: " << program << " [config.ini] [--set section.key=value]... <checkpoint.bin>..." << std::endl;
+}
+
+bool endsWith(const std::string& s, const std::string& suffix)
+{
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    SimConfig config;
+    std::vector<std::string> checkpoints;
+
+    for(int i = 1; i < argc; ++i){
+        std::string arg = argv[i];
+        if(arg == "--set" && i + 1 < argc){
+            std::string assignment = argv[++i];
+            size_t equals = assignment.find('=');
+            if(equals == std::string::npos || !config.set(assignment.substr(0, equals), assignment.substr(equals + 1))){
+                printUsage(argv[0]);
+                return 1;
+            }
+        }
+        else if(arg[0] == '-'){
+            printUsage(argv[0]);
+            return 1;
+        }
+        else if(endsWith(arg, ".ini")){
+            if(!config.load(arg)){
+                return 1;
+            }
+        }
+        else{
+            checkpoints.push_back(arg);
+        }
+    }
+    if(checkpoints.empty()){
+        printUsage(argv[0]);
+        return 1;
+    }
+    if(!config.finalize()){
+        return 1;
+    }
+
+    FEMSolver<double,3> solver(config);
+    solver.initializeMesh();
+    return solver.trainSubspace(checkpoints) ? 0 : 1;
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+
+#include "../mesh/GraphColoring.h"
+#include "../mesh/TetAdjacency.h"
+
+// Symmetric block sparse matrix over the vertex graph of a tetrahedral mesh,
+// one dim x dim block per vertex and per pair of vertices sharing an edge,
+// solved approximately with multicolored block Gauss-Seidel. Off-diagonal
+// blocks of row i are stored in the order of the adjacency's vertexVertices,
+// vertices of one color are updated in parallel. A fixed number of sweeps
+// keeps the cost per solve predictable; convergence needs a symmetric positive
+// definite matrix.
+template<class T, int dim>
+class BlockGaussSeidel {
+public:
+    typedef Eigen::Matrix<T,dim,dim> Block;
+    typedef Eigen::Matrix<T,dim,1> Vec;
+
+    BlockGaussSeidel();
+
+    // sizes the blocks for the adjacency's vertex graph and colors it
+    void setPattern(const TetAdjacency<T,dim>& adjacency);
+    void setZero();
+
+    Block& diagonal(int i) { return mDiagonal[i]; }
+    Block& block(int i, int j);        // j must be a neighbor of i
+
+    // iterations sweeps over all colors, x holds the initial guess
+    void solve(const std::vector<Vec>& b, std::vector<Vec>& x, int iterations) const;
+    T residual(const std::vector<Vec>& b, const std::vector<Vec>& x) const;     // |b - Ax| / |b|
+    // the same matrix as scalars, entry (dim i + r, dim j + c) is block(i, j)(r, c)
+    void toSparse(Eigen::SparseMatrix<T, Eigen::RowMajor>& matrix) const;
+
+    int numColors() const { return mColoring.numColors(); }
+
+private:
+    const TetAdjacency<T,dim>* mAdjacency;
+    GraphColoring<T,dim> mColoring;
+    std::vector<Block> mDiagonal;
+    std::vector<Block> mOffDiagonal;
+};
+
+template<class T, int dim>
+BlockGaussSeidel<T,dim>::BlockGaussSeidel() : mAdjacency(nullptr) {}
+
+template<class T, int dim>
+void BlockGaussSeidel<T,dim>::setPattern(const TetAdjacency<T,dim>& adjacency) {
+    mAdjacency = &adjacency;
+    mColoring.colorVertices(adjacency);
+    mDiagonal.resize(adjacency.numParticles());
+    mOffDiagonal.resize(adjacency.vertexVertices.size());
+    setZero();
+}
+
+template<class T, int dim>
+void BlockGaussSeidel<T,dim>::setZero() {
+    #pragma omp parallel for
+    for(int i = 0; i < int(mDiagonal.size()); ++i){
+        mDiagonal[i].setZero();
+    }
+    #pragma omp parallel for
+    for(int k = 0; k < int(mOffDiagonal.size()); ++k){
+        mOffDiagonal[k].setZero();
+    }
+}
+
+template<class T, int dim>
+typename BlockGaussSeidel<T,dim>::Block& BlockGaussSeidel<T,dim>::block(int i, int j) {
+    if(i == j){
+        return mDiagonal[i];
+    }
+    const std::vector<int>& neighbors = mAdjacency->vertexVertices;
+    const int k = std::lower_bound(neighbors.begin() + mAdjacency->vertexVertexStart[i],
+                                   neighbors.begin() + mAdjacency->vertexVertexStart[i + 1], j) - neighbors.begin();
+    return mOffDiagonal[k];
+}
+
+template<class T, int dim>
+void BlockGaussSeidel<T,dim>::solve(const std::vector<Vec>& b, std::vector<Vec>& x, int iterations) const {
+    const std::vector<int>& start = mAdjacency->vertexVertexStart;
+    const std::vector<int>& neighbors = mAdjacency->vertexVertices;
+    std::vector<Block> inverse(mDiagonal.size());
+    #pragma omp parallel for
+    for(int i = 0; i < int(mDiagonal.size()); ++i){
+        inverse[i] = mDiagonal[i].inverse();
+    }
+
+    for(int iteration = 0; iteration < iterations; ++iteration){
+        for(int c = 0; c < mColoring.numColors(); ++c){
+            const int* vertices = mColoring.begin(c);
+            #pragma omp parallel for
+            for(int v = 0; v < mColoring.size(c); ++v){
+                const int i = vertices[v];
+                Vec r = b[i];
+                for(int k = start[i]; k < start[i + 1]; ++k){
+                    r -= mOffDiagonal[k] * x[neighbors[k]];
+                }
+                x[i] = inverse[i] * r;
+            }
+        }
+    }
+}
+
+template<class T, int dim>
+T BlockGaussSeidel<T,dim>::residual(const std::vector<Vec>& b, const std::vector<Vec>& x) const {
+    const std::vector<int>& start = mAdjacency->vertexVertexStart;
+    const std::vector<int>& neighbors = mAdjacency->vertexVertices;
+    T rr = 0;
+    T bb = 0;
+    #pragma omp parallel for reduction(+:rr, bb)
+    for(int i = 0; i < int(mDiagonal.size()); ++i){
+        Vec r = b[i] - mDiagonal[i] * x[i];
+        for(int k = start[i]; k < start[i + 1]; ++k){
+            r -= mOffDiagonal[k] * x[neighbors[k]];
+        }
+        rr += r.squaredNorm();
+        bb += b[i].squaredNorm();
+    }
+    return bb > 0 ? std::sqrt(rr / bb) : std::sqrt(rr);
+}
+
+template<class T, int dim>
+void BlockGaussSeidel<T,dim>::toSparse(Eigen::SparseMatrix<T, Eigen::RowMajor>& matrix) const {
+    const std::vector<int>& start = mAdjacency->vertexVertexStart;
+    const std::vector<int>& neighbors = mAdjacency->vertexVertices;
+    const int n = mDiagonal.size();
+    std::vector<Eigen::Triplet<T>> entries;
+    entries.reserve(size_t(dim * dim) * (n + neighbors.size()));
+    for(int i = 0; i < n; ++i){
+        for(int r = 0; r < dim; ++r){
+            for(int c = 0; c < dim; ++c){
+                entries.push_back(Eigen::Triplet<T>(dim * i + r, dim * i + c, mDiagonal[i](r, c)));
+                for(int k = start[i]; k < start[i + 1]; ++k){
+                    entries.push_back(Eigen::Triplet<T>(dim * i + r, dim * neighbors[k] + c, mOffDiagonal[k](r, c)));
+                }
+            }
+        }
+    }
+    matrix.resize(dim * n, dim * n);
+    matrix.setFromTriplets(entries.begin(), entries.end());
+}
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "../mesh/TetraMesh.h"
+#include "../scene/scene.h"
+#include "FileHelper.h"
+
+// Binary snapshot of the full simulation state: particles, precomputed
+// tetrahedron data and collider state. Layout (native endianness):
+//   header   FileHelper::Header, counts frame, numParticles, numTets, numShapes
+//   particles positions, velocities, masses, tets, rest positions (TetraMesh::mRest, the positions if unset)
+//   tetras   per tet: indices[dim+1], Dm, DmInv, volume, VolDmInvT, mass
+//   shapes   per shape: center, velocity
+template<class T, int dim>
+class Checkpoint {
+
+public:
+    static const int VERSION = 3;
+
+    // writes through FileHelper::writeAtomic so a crash never leaves a partial file
+    static bool write(const std::string &path, int frame,
+                      const TetraMesh<T,dim> &mesh, const Scene<T,dim> &scene);
+
+    // restores mesh and scene, returns the frame the checkpoint was taken at in frame
+    static bool read(const std::string &path, int &frame,
+                     TetraMesh<T,dim> &mesh, Scene<T,dim> &scene);
+
+private:
+    template<class V>
+    static void put(std::ofstream &out, const V &value) {
+        out.write(reinterpret_cast<const char*>(&value), sizeof(V));
+    }
+
+    template<class V>
+    static void get(std::ifstream &in, V &value) {
+        in.read(reinterpret_cast<char*>(&value), sizeof(V));
+    }
+
+    template<class Derived>
+    static void putMatrix(std::ofstream &out, const Eigen::MatrixBase<Derived> &m) {
+        for(int j = 0; j < m.cols(); ++j){
+            for(int i = 0; i < m.rows(); ++i){
+                put(out, T(m(i, j)));
+            }
+        }
+    }
+
+    template<class Derived>
+    static void getMatrix(std::ifstream &in, Eigen::MatrixBase<Derived> &m) {
+        for(int j = 0; j < m.cols(); ++j){
+            for(int i = 0; i < m.rows(); ++i){
+                get(in, m(i, j));
+            }
+        }
+    }
+
+    static const char* magic() { return "FEMCKPT"; }
+};
+
+template<class T, int dim>
+bool Checkpoint<T,dim>::write(const std::string &path, int frame,
+                              const TetraMesh<T,dim> &mesh, const Scene<T,dim> &scene) {
+    const Particles<T,dim> &particles = mesh.mParticles;
+    const int numParticles = particles.positions.size();
+    const int numTets = mesh.mTetras->size();
+    const int numShapes = scene.shapes.size();
+
+    FileHelper::Header header = FileHelper::makeHeader(magic(), VERSION, sizeof(T), dim, 0);
+    header.counts[0] = frame;
+    header.counts[1] = numParticles;
+    header.counts[2] = numTets;
+    header.counts[3] = numShapes;
+
+    return FileHelper::writeAtomic(path, "checkpoint", [&](std::ofstream &out){
+        FileHelper::writeHeader(out, header);
+
+        for(int i = 0; i < numParticles; ++i){
+            putMatrix(out, particles.positions[i]);
+        }
+        for(int i = 0; i < numParticles; ++i){
+            putMatrix(out, particles.velocities[i]);
+        }
+        for(int i = 0; i < numParticles; ++i){
+            put(out, particles.masses[i]);
+        }
+        for(int i = 0; i < numParticles; ++i){
+            put(out, particles.tets[i]);
+        }
+        const std::vector<Eigen::Matrix<T,dim,1>> &rest = mesh.mRest ? *mesh.mRest : particles.positions;
+        for(int i = 0; i < numParticles; ++i){
+            putMatrix(out, rest[i]);
+        }
+
+        for(const Tetrahedron<T,dim> &t : *mesh.mTetras){
+            for(int i = 0; i < dim + 1; ++i){
+                put(out, t.mPIndices[i]);
+            }
+            putMatrix(out, t.mDm);
+            putMatrix(out, t.mDmInv);
+            put(out, t.volume);
+            putMatrix(out, t.mVolDmInvT);
+            put(out, t.mass);
+        }
+
+        for(int i = 0; i < numShapes; ++i){
+            putMatrix(out, scene.shapes[i]->getCenter());
+            putMatrix(out, scene.shapes[i]->getVelocity());
+        }
+    });
+}
+
+template<class T, int dim>
+bool Checkpoint<T,dim>::read(const std::string &path, int &frame,
+                             TetraMesh<T,dim> &mesh, Scene<T,dim> &scene) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        std::cout << "Unable to open checkpoint " << path << std::endl;
+        return false;
+    }
+
+    FileHelper::Header header;
+    if (!FileHelper::readHeader(in, header)
+        || !FileHelper::matchHeader(header, FileHelper::makeHeader(magic(), VERSION, sizeof(T), dim, 0))) {
+        std::cout << "error: " << path << " is not a compatible checkpoint" << std::endl;
+        return false;
+    }
+    frame = header.counts[0];
+    const int numParticles = header.counts[1];
+    const int numTets = header.counts[2];
+    const int numShapes = header.counts[3];
+    if (numShapes != int(scene.shapes.size())) {
+        std::cout << "error: checkpoint has " << numShapes << " colliders but scene has "
+                  << scene.shapes.size() << std::endl;
+        return false;
+    }
+
+    Particles<T,dim> &particles = mesh.mParticles;
+    particles.positions.resize(numParticles);
+    particles.velocities.resize(numParticles);
+    particles.forces.assign(numParticles, Eigen::Matrix<T,dim,1>::Zero());
+    particles.masses.resize(numParticles);
+    particles.tets.resize(numParticles);
+
+    for(int i = 0; i < numParticles; ++i){
+        getMatrix(in, particles.positions[i]);
+    }
+    for(int i = 0; i < numParticles; ++i){
+        getMatrix(in, particles.velocities[i]);
+    }
+    for(int i = 0; i < numParticles; ++i){
+        get(in, particles.masses[i]);
+    }
+    for(int i = 0; i < numParticles; ++i){
+        get(in, particles.tets[i]);
+    }
+    std::shared_ptr<std::vector<Eigen::Matrix<T,dim,1>>> rest = std::make_shared<std::vector<Eigen::Matrix<T,dim,1>>>(numParticles);
+    for(int i = 0; i < numParticles; ++i){
+        getMatrix(in, (*rest)[i]);
+    }
+    mesh.mRest = rest;
+
+    mesh.mTetras = std::make_shared<std::vector<Tetrahedron<T,dim>>>();
+    mesh.mTetras->reserve(numTets);
+    std::vector<int> indices(dim + 1);
+    for(int n = 0; n < numTets; ++n){
+        for(int i = 0; i < dim + 1; ++i){
+            get(in, indices[i]);
+        }
+        Tetrahedron<T,dim> t(indices);
+        getMatrix(in, t.mDm);
+        getMatrix(in, t.mDmInv);
+        get(in, t.volume);
+        getMatrix(in, t.mVolDmInvT);
+        get(in, t.mass);
+        mesh.mTetras->push_back(t);
+    }
+
+    for(int i = 0; i < numShapes; ++i){
+        Eigen::Matrix<T,dim,1> center, velocity;
+        getMatrix(in, center);
+        getMatrix(in, velocity);
+        scene.shapes[i]->setCenter(center);
+        scene.shapes[i]->setVelocity(velocity);
+    }
+
+    if (!in) {
+        std::cout << "error: checkpoint " << path << " is truncated" << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -1,6 +1,15 @@
 
 #include <fstream>
 #include <iostream>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "FileHelper.h"
 
 bool FileHelper::readFloats(char *path, std::vector<float> &result) {
@@ -47,4 +56,117 @@ bool FileHelper::printFloats(char *path, std::vector<float> &output) {
     outputStream.close();
 
     return true;
-}
\ No newline at end of file
+}
+
+bool FileHelper::makeDirectory(const std::string &path) {
+
+    if (mkdir(path.c_str(), 0755) != 0 && errno != EEXIST)
+    {
+        std::cout << "\nError creating directory " << path << ".\n";
+        return false;
+    }
+
+    return true;
+}
+
+const char* FileHelper::mapFile(const std::string &path, size_t &size) {
+
+    size = 0;
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return nullptr;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0)
+    {
+        close(fd);
+        return nullptr;
+    }
+    void *data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        return nullptr;
+    }
+    size = info.st_size;
+    return static_cast<const char*>(data);
+}
+
+void FileHelper::unmapFile(const char *data, size_t size) {
+
+    if (data != nullptr)
+    {
+        munmap(const_cast<char*>(data), size);
+    }
+}
+
+bool FileHelper::truncateFile(const std::string &path, long long size) {
+
+    if (truncate(path.c_str(), size) != 0)
+    {
+        std::cout << "\nError truncating " << path << ".\n";
+        return false;
+    }
+
+    return true;
+}
+
+FileHelper::Header FileHelper::makeHeader(const char *magic, int version, int scalarSize, int dimension, uint64_t key) {
+
+    Header header;
+    std::memset(&header, 0, sizeof(Header));
+    std::memcpy(header.magic, magic, std::min(std::strlen(magic) + 1, sizeof(header.magic)));
+    header.version = version;
+    header.scalarSize = scalarSize;
+    header.dimension = dimension;
+    header.key = key;
+    return header;
+}
+
+bool FileHelper::matchHeader(const Header &header, const Header &expected) {
+
+    return std::strncmp(header.magic, expected.magic, 8) == 0 && header.version == expected.version
+           && header.scalarSize == expected.scalarSize && header.dimension == expected.dimension
+           && header.key == expected.key;
+}
+
+bool FileHelper::readHeader(std::istream &in, Header &header) {
+
+    char buffer[HEADER_BYTES];
+    in.read(buffer, HEADER_BYTES);
+    std::memcpy(&header, buffer, sizeof(Header));
+    return bool(in);
+}
+
+void FileHelper::writeHeader(std::ostream &out, const Header &header) {
+
+    static_assert(sizeof(Header) <= HEADER_BYTES, "the header must fit its padding");
+    char buffer[HEADER_BYTES];
+    std::memset(buffer, 0, HEADER_BYTES);
+    std::memcpy(buffer, &header, sizeof(Header));
+    out.write(buffer, HEADER_BYTES);
+}
+
+bool FileHelper::writeAtomic(const std::string &path, const std::string &what,
+                             const std::function<void(std::ofstream &out)> &write) {
+
+    const std::string tmpPath = path + "." + std::to_string(getpid()) + "."
+                                + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+    std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+        std::cout << "Unable to open " << what << " " << tmpPath << std::endl;
+        return false;
+    }
+    write(out);
+    out.close();
+    if (!out || std::rename(tmpPath.c_str(), path.c_str()) != 0)
+    {
+        std::cout << "Error writing " << what << " " << path << std::endl;
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+
+    return true;
+}
@@ -1,6 +1,9 @@
 
 #pragma once
 
+#include <cstdint>
+#include <functional>
+#include <fstream>
 #include <vector>
 #include <string>
 
@@ -11,6 +14,41 @@ public:
 
     static bool printFloats(char *path, std::vector<float> &output);
 
+    // creates a directory if it does not already exist
+    static bool makeDirectory(const std::string &path);
+
+    // cuts a file down to size bytes
+    static bool truncateFile(const std::string &path, long long size);
+
+    // maps a whole file read-only, returns nullptr if it cannot be opened or is empty
+    static const char* mapFile(const std::string &path, size_t &size);
+    static void unmapFile(const char *data, size_t size);
+
+    // start of the binary caches and checkpoints, padded to HEADER_BYTES on disk (native endianness);
+    // counts are up to four sizes of the format's sections
+    struct Header {
+        char magic[8];
+        int version;
+        int scalarSize;
+        int dimension;
+        int counts[4];
+        uint64_t key;
+    };
+    static const int HEADER_BYTES = 64;
+
+    // a header with zero counts
+    static Header makeHeader(const char *magic, int version, int scalarSize, int dimension, uint64_t key);
+    // true if header has the magic, version, scalar size, dimension and key of expected
+    static bool matchHeader(const Header &header, const Header &expected);
+    static bool readHeader(std::istream &in, Header &header);
+    static void writeHeader(std::ostream &out, const Header &header);
+
+    // write fills a temporary file next to path, named after the process and thread so that concurrent
+    // writers never share it, which is then renamed over path; readers see the old file or the whole
+    // new one. what names the file in error messages
+    static bool writeAtomic(const std::string &path, const std::string &what,
+                            const std::function<void(std::ofstream &out)> &write);
+
 };
 
 
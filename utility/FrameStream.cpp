@@ -0,0 +1,324 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <zlib.h>
+#include "FrameStream.h"
+
+namespace {
+
+const char *attributeNameList[] = {"position", "velocity", "force", "mass"};
+const int numAttributeNames = 4;
+
+template<class V>
+void append(std::vector<char> &block, const V &value) {
+    const char *bytes = reinterpret_cast<const char*>(&value);
+    block.insert(block.end(), bytes, bytes + sizeof(V));
+}
+
+template<class V>
+V fetch(const char *block) {
+    V value;
+    std::memcpy(&value, block, sizeof(V));
+    return value;
+}
+
+template<class V>
+void get(std::ifstream &in, V &value) {
+    in.read(reinterpret_cast<char*>(&value), sizeof(V));
+}
+
+}
+
+bool FrameStream::parseAttributes(const std::string &list, int &attributes) {
+    attributes = 0;
+    size_t begin = 0;
+    while (begin <= list.size()) {
+        size_t end = list.find(',', begin);
+        if (end == std::string::npos) {
+            end = list.size();
+        }
+        std::string name = list.substr(begin, end - begin);
+        name.erase(0, name.find_first_not_of(" \t"));
+        name.erase(name.find_last_not_of(" \t") + 1);
+        if (!name.empty()) {
+            int i = 0;
+            while (i < numAttributeNames && name != attributeNameList[i]) {
+                ++i;
+            }
+            if (i == numAttributeNames) {
+                std::cout << "error: unknown output attribute " << name << std::endl;
+                return false;
+            }
+            attributes |= 1 << i;
+        }
+        begin = end + 1;
+    }
+    return true;
+}
+
+std::string FrameStream::attributeNames(int attributes) {
+    std::string names;
+    for (int i = 0; i < numAttributeNames; ++i) {
+        if (attributes & (1 << i)) {
+            names += (names.empty() ? "" : ", ") + std::string(attributeNameList[i]);
+        }
+    }
+    return names;
+}
+
+void FrameStream::deflateBlock(const char *data, size_t size, std::vector<char> &block) {
+    uLongf compressedSize = compressBound(size);
+    block.resize(sizeof(uint64_t) + compressedSize);
+    compress2(reinterpret_cast<Bytef*>(&block[sizeof(uint64_t)]), &compressedSize,
+              reinterpret_cast<const Bytef*>(data), size, Z_DEFAULT_COMPRESSION);
+    block.resize(sizeof(uint64_t) + compressedSize);
+    const uint64_t stored = compressedSize;
+    std::memcpy(&block[0], &stored, sizeof(uint64_t));
+}
+
+size_t FrameStream::inflateBlock(const char *block, size_t size, char *data, size_t dataSize) {
+    if (size < sizeof(uint64_t)) {
+        return 0;
+    }
+    const uint64_t compressedSize = fetch<uint64_t>(block);
+    if (compressedSize > size - sizeof(uint64_t)) {
+        return 0;
+    }
+    uLongf inflatedSize = dataSize;
+    if (uncompress(reinterpret_cast<Bytef*>(data), &inflatedSize,
+                   reinterpret_cast<const Bytef*>(block + sizeof(uint64_t)), compressedSize) != Z_OK
+        || inflatedSize != dataSize) {
+        return 0;
+    }
+    return sizeof(uint64_t) + compressedSize;
+}
+
+void FrameStream::encodeChannel(const std::vector<float> &values, int bits,
+                                std::vector<char> &block, std::vector<float> &reconstructed) {
+    const int n = values.size() / 3;
+    const float levels = float((1 << bits) - 1);
+    block.clear();
+    reconstructed.resize(values.size());
+
+    // component-major quantized values, each stored as the difference to the previous particle
+    std::vector<uint16_t> deltas(3 * n);
+    float low[3], high[3];
+    for (int k = 0; k < 3; ++k) {
+        low[k] = n > 0 ? values[k] : 0.f;
+        high[k] = low[k];
+        for (int i = 1; i < n; ++i) {
+            low[k] = std::min(low[k], values[3 * i + k]);
+            high[k] = std::max(high[k], values[3 * i + k]);
+        }
+        const float extent = high[k] - low[k];
+        const float toLevels = extent > 0.f ? levels / extent : 0.f;
+        const float step = extent / levels;
+        uint16_t previous = 0;
+        for (int i = 0; i < n; ++i) {
+            const uint16_t q = uint16_t(std::min(levels, std::floor((values[3 * i + k] - low[k]) * toLevels + 0.5f)));
+            deltas[k * n + i] = uint16_t(q - previous);
+            previous = q;
+            reconstructed[3 * i + k] = low[k] + q * step;
+        }
+    }
+
+    // low bytes then high bytes, the high bytes of small differences are mostly zero
+    std::vector<char> planes(6 * n);
+    for (int i = 0; i < 3 * n; ++i) {
+        planes[i] = char(deltas[i] & 0xff);
+        planes[3 * n + i] = char(deltas[i] >> 8);
+    }
+
+    for (int k = 0; k < 3; ++k) {
+        append(block, low[k]);
+    }
+    for (int k = 0; k < 3; ++k) {
+        append(block, high[k]);
+    }
+    std::vector<char> compressed;
+    deflateBlock(planes.data(), planes.size(), compressed);
+    block.insert(block.end(), compressed.begin(), compressed.end());
+}
+
+size_t FrameStream::decodeChannel(const char *block, size_t size, int bits, int n, std::vector<float> &values) {
+    const size_t boundsSize = 6 * sizeof(float);
+    if (size < boundsSize) {
+        return 0;
+    }
+    float low[3], high[3];
+    for (int k = 0; k < 3; ++k) {
+        low[k] = fetch<float>(block + k * sizeof(float));
+        high[k] = fetch<float>(block + (3 + k) * sizeof(float));
+    }
+    std::vector<char> planes(6 * n);
+    const size_t used = inflateBlock(block + boundsSize, size - boundsSize, planes.data(), planes.size());
+    if (used == 0) {
+        return 0;
+    }
+
+    const float levels = float((1 << bits) - 1);
+    values.resize(3 * n);
+    for (int k = 0; k < 3; ++k) {
+        const float step = (high[k] - low[k]) / levels;
+        uint16_t q = 0;
+        for (int i = 0; i < n; ++i) {
+            const int d = k * n + i;
+            q = uint16_t(q + uint16_t((unsigned char)planes[d] | ((unsigned char)planes[3 * n + d] << 8)));
+            values[3 * i + k] = low[k] + q * step;
+        }
+    }
+    return boundsSize + used;
+}
+
+FrameStreamReader::FrameStreamReader() : mNumParticles(0), mAttributes(0), mBits(16), mKeyframeEvery(0),
+                                         mDataOffset(0), mDecodedEntry(-1) {}
+
+bool FrameStreamReader::open(const std::string &path) {
+    mIn.close();
+    mIn.clear();
+    mIn.open(path, std::ios::binary);
+    mPath = path;
+    mEntries.clear();
+    mMasses.clear();
+    mDecodedEntry = -1;
+    if (!mIn) {
+        return false;
+    }
+
+    char header[8];
+    int version;
+    mIn.read(header, 8);
+    get(mIn, version);
+    get(mIn, mNumParticles);
+    get(mIn, mAttributes);
+    get(mIn, mBits);
+    get(mIn, mKeyframeEvery);
+    if (!mIn || std::strncmp(header, FrameStream::magic(), 8) != 0 || version != FrameStream::VERSION) {
+        std::cout << "error: " << path << " is not a compatible frame stream" << std::endl;
+        return false;
+    }
+
+    if (mAttributes & STREAM_MASS) {
+        uint64_t compressedSize;
+        get(mIn, compressedSize);
+        std::vector<char> block(sizeof(uint64_t) + compressedSize);
+        std::memcpy(&block[0], &compressedSize, sizeof(uint64_t));
+        mIn.read(&block[sizeof(uint64_t)], compressedSize);
+        mMasses.resize(mNumParticles);
+        if (!mIn || FrameStream::inflateBlock(block.data(), block.size(), reinterpret_cast<char*>(mMasses.data()),
+                                              mMasses.size() * sizeof(float)) == 0) {
+            std::cout << "error: " << path << " has corrupt masses" << std::endl;
+            return false;
+        }
+    }
+    mDataOffset = mIn.tellg();
+
+    // index the frames, a frame cut short by an interrupted write ends the stream
+    mIn.seekg(0, std::ios::end);
+    const std::streamoff fileSize = mIn.tellg();
+    std::streamoff offset = mDataOffset;
+    const std::streamoff recordHeader = 4 + 2 * sizeof(int) + sizeof(uint64_t);
+    while (offset + recordHeader <= fileSize) {
+        mIn.seekg(offset);
+        char tag[4];
+        int frame, keyframe;
+        uint64_t size;
+        mIn.read(tag, 4);
+        get(mIn, frame);
+        get(mIn, keyframe);
+        get(mIn, size);
+        if (!mIn || std::strncmp(tag, FrameStream::frameTag(), 4) != 0
+            || offset + recordHeader + std::streamoff(size) > fileSize) {
+            break;
+        }
+        Entry entry;
+        entry.frame = frame;
+        entry.keyframe = keyframe != 0;
+        entry.offset = offset + recordHeader;
+        entry.size = size;
+        // a stream always starts with a keyframe
+        if (!mEntries.empty() || entry.keyframe) {
+            mEntries.push_back(entry);
+        }
+        offset = entry.offset + size;
+    }
+    mIn.clear();
+    return true;
+}
+
+std::streamoff FrameStreamReader::endOffset(int frame) const {
+    std::streamoff end = mDataOffset;
+    for (unsigned int i = 0; i < mEntries.size() && mEntries[i].frame <= frame; ++i) {
+        end = mEntries[i].offset + mEntries[i].size;
+    }
+    return end;
+}
+
+bool FrameStreamReader::decodeEntry(int entry) {
+    const Entry &e = mEntries[entry];
+    std::vector<char> payload(e.size);
+    mIn.seekg(e.offset);
+    mIn.read(payload.data(), payload.size());
+    if (!mIn) {
+        mIn.clear();
+        return false;
+    }
+
+    size_t offset = 0;
+    std::vector<float> values;
+    for (int a = 0; a < FrameStream::NUM_DYNAMIC; ++a) {
+        if (!(mAttributes & (1 << a))) {
+            mDecoded[a].clear();
+            continue;
+        }
+        const size_t used = FrameStream::decodeChannel(payload.data() + offset, payload.size() - offset,
+                                                       mBits, mNumParticles, values);
+        if (used == 0) {
+            return false;
+        }
+        offset += used;
+        if (e.keyframe) {
+            mDecoded[a].swap(values);
+        }
+        else {
+            for (unsigned int i = 0; i < values.size(); ++i) {
+                mDecoded[a][i] += values[i];
+            }
+        }
+    }
+    mDecodedEntry = entry;
+    return true;
+}
+
+bool FrameStreamReader::read(int frame, std::vector<float> &positions, std::vector<float> &velocities,
+                             std::vector<float> &forces) {
+    int target = 0;
+    while (target < int(mEntries.size()) && mEntries[target].frame != frame) {
+        ++target;
+    }
+    if (target == int(mEntries.size())) {
+        std::cout << "error: frame " << frame << " is not in " << mPath << std::endl;
+        return false;
+    }
+
+    int first = target;
+    while (!mEntries[first].keyframe) {
+        --first;
+    }
+    // continue from the last decoded frame when it lies between the keyframe and the target
+    if (mDecodedEntry >= first && mDecodedEntry <= target) {
+        first = mDecodedEntry + 1;
+    }
+    for (int entry = first; entry <= target; ++entry) {
+        if (!decodeEntry(entry)) {
+            mDecodedEntry = -1;
+            std::cout << "error: frame " << mEntries[entry].frame << " of " << mPath << " is corrupt" << std::endl;
+            return false;
+        }
+    }
+
+    positions = mDecoded[0];
+    velocities = mDecoded[1];
+    forces = mDecoded[2];
+    return true;
+}
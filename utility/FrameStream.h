@@ -0,0 +1,252 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../mesh/Particles.h"
+#include "FileHelper.h"
+
+// Compressed frame output appended to a single file. Dynamic attributes are
+// quantized inside a per-frame bounding box, keyframes store values and the
+// frames in between store the change from the previous decoded frame, both
+// as differences along the particle order, byte-plane split and deflated.
+// Layout (native endianness):
+//   header   magic[8], version, numParticles, attributes, bits, keyframeEvery
+//   static   mass block when selected
+//   frames   tag[4] "FRAM", frame, keyframe, payload bytes, one channel block per dynamic attribute
+//   channel  min[3], max[3], compressed bytes, deflated quantized values
+// Readers index the file by skipping over frame payloads, so an interrupted
+// write only loses the frame it was in.
+
+enum FrameStreamAttribute {
+    STREAM_POSITION = 1,
+    STREAM_VELOCITY = 2,
+    STREAM_FORCE = 4,
+    STREAM_MASS = 8
+};
+
+class FrameStream {
+
+public:
+    static const int VERSION = 1;
+    static const int NUM_DYNAMIC = 3;       // position, velocity, force, in this order in a frame
+
+    static const char* magic() { return "FEMSTRM"; }
+    static const char* frameTag() { return "FRAM"; }
+
+    // comma separated attribute names, e.g. "position, velocity, mass"
+    static bool parseAttributes(const std::string &list, int &attributes);
+    static std::string attributeNames(int attributes);
+
+    // quantizes 3 floats per particle to bits inside their bounding box; reconstructed
+    // receives the values a reader will decode
+    static void encodeChannel(const std::vector<float> &values, int bits,
+                              std::vector<char> &block, std::vector<float> &reconstructed);
+    // decodes a channel block of n particles, returns the bytes consumed or 0 on corrupt data
+    static size_t decodeChannel(const char *block, size_t size, int bits, int n, std::vector<float> &values);
+
+    static void deflateBlock(const char *data, size_t size, std::vector<char> &block);
+    static size_t inflateBlock(const char *block, size_t size, char *data, size_t dataSize);
+};
+
+// Random access reader. Frames are decoded from the closest keyframe at or
+// before them; reading forward from the last decoded frame continues from it.
+class FrameStreamReader {
+
+public:
+    FrameStreamReader();
+
+    bool open(const std::string &path);
+
+    int numParticles() const { return mNumParticles; }
+    int attributes() const { return mAttributes; }
+    int bits() const { return mBits; }
+    int keyframeEvery() const { return mKeyframeEvery; }
+    int numFrames() const { return mEntries.size(); }
+    int frameNumber(int entry) const { return mEntries[entry].frame; }
+    bool isKeyframe(int entry) const { return mEntries[entry].keyframe; }
+    size_t frameBytes(int entry) const { return mEntries[entry].size; }
+    // file offset just past the last complete frame at or before frame
+    std::streamoff endOffset(int frame) const;
+
+    const std::vector<float>& masses() const { return mMasses; }
+
+    // 3 floats per particle for each dynamic attribute, empty when not stored
+    bool read(int frame, std::vector<float> &positions, std::vector<float> &velocities, std::vector<float> &forces);
+
+private:
+    struct Entry {
+        int frame;
+        bool keyframe;
+        std::streamoff offset;      // start of the payload
+        size_t size;
+    };
+
+    bool decodeEntry(int entry);
+
+    std::ifstream mIn;
+    std::string mPath;
+    int mNumParticles;
+    int mAttributes;
+    int mBits;
+    int mKeyframeEvery;
+    std::streamoff mDataOffset;
+    std::vector<float> mMasses;
+    std::vector<Entry> mEntries;
+    int mDecodedEntry;
+    std::vector<float> mDecoded[FrameStream::NUM_DYNAMIC];
+};
+
+template<class T, int dim>
+class FrameStreamWriter {
+
+public:
+    FrameStreamWriter();
+
+    // starts a new file, or when startFrame > 0 keeps the frames of a compatible file up to
+    // startFrame and appends after them
+    bool open(const std::string &path, const Particles<T,dim> &particles,
+              int attributes, int bits, int keyframeEvery, int startFrame);
+    bool isOpen() const { return mOut.is_open(); }
+    bool write(int frame, const Particles<T,dim> &particles);
+    void close();
+
+private:
+    template<class V>
+    void put(const V &value) {
+        mOut.write(reinterpret_cast<const char*>(&value), sizeof(V));
+    }
+
+    void gather(int attribute, const Particles<T,dim> &particles, std::vector<float> &values) const;
+
+    std::ofstream mOut;
+    int mAttributes;
+    int mBits;
+    int mKeyframeEvery;
+    int mSinceKeyframe;
+    // what a reader reconstructs for the previous frame, deltas are taken against it
+    // so quantization errors do not accumulate
+    std::vector<float> mDecoded[FrameStream::NUM_DYNAMIC];
+    std::vector<float> mValues;
+    std::vector<float> mReconstructed;
+    std::vector<char> mBlock;
+    std::vector<char> mPayload;
+};
+
+template<class T, int dim>
+FrameStreamWriter<T,dim>::FrameStreamWriter() : mAttributes(0), mBits(16), mKeyframeEvery(30), mSinceKeyframe(0) {}
+
+template<class T, int dim>
+bool FrameStreamWriter<T,dim>::open(const std::string &path, const Particles<T,dim> &particles,
+                                    int attributes, int bits, int keyframeEvery, int startFrame) {
+    const int numParticles = particles.positions.size();
+    mAttributes = attributes;
+    mBits = bits;
+    mKeyframeEvery = keyframeEvery;
+    mSinceKeyframe = 0;
+    for(int a = 0; a < FrameStream::NUM_DYNAMIC; ++a){
+        mDecoded[a].clear();
+    }
+
+    if(startFrame > 0){
+        FrameStreamReader existing;
+        if(existing.open(path) && existing.numParticles() == numParticles && existing.attributes() == attributes
+           && existing.bits() == bits){
+            const std::streamoff end = existing.endOffset(startFrame);
+            if(!FileHelper::truncateFile(path, end)){
+                return false;
+            }
+            // the first frame written after a resume is a keyframe, the decoded state is not kept
+            mOut.open(path, std::ios::binary | std::ios::app);
+            if(!mOut){
+                std::cout << "Unable to append to frame stream " << path << std::endl;
+                return false;
+            }
+            return true;
+        }
+        std::cout << "starting a new frame stream " << path << std::endl;
+    }
+
+    mOut.open(path, std::ios::binary | std::ios::trunc);
+    if(!mOut){
+        std::cout << "Unable to open frame stream " << path << std::endl;
+        return false;
+    }
+    mOut.write(FrameStream::magic(), 8);
+    put(int(FrameStream::VERSION));
+    put(numParticles);
+    put(attributes);
+    put(bits);
+    put(keyframeEvery);
+
+    if(attributes & STREAM_MASS){
+        std::vector<float> masses(particles.masses.begin(), particles.masses.end());
+        FrameStream::deflateBlock(reinterpret_cast<const char*>(masses.data()), masses.size() * sizeof(float), mBlock);
+        mOut.write(mBlock.data(), mBlock.size());
+    }
+    mOut.flush();
+    return bool(mOut);
+}
+
+template<class T, int dim>
+void FrameStreamWriter<T,dim>::gather(int attribute, const Particles<T,dim> &particles, std::vector<float> &values) const {
+    const std::vector<Eigen::Matrix<T,dim,1>> &source = attribute == 0 ? particles.positions
+                                                      : attribute == 1 ? particles.velocities : particles.forces;
+    values.resize(3 * source.size());
+    for(unsigned int i = 0; i < source.size(); ++i){
+        for(int k = 0; k < 3; ++k){
+            values[3 * i + k] = k < dim ? float(source[i][k]) : 0.f;
+        }
+    }
+}
+
+template<class T, int dim>
+bool FrameStreamWriter<T,dim>::write(int frame, const Particles<T,dim> &particles) {
+    // the first frame after open is always a keyframe
+    const bool keyframe = mSinceKeyframe == 0 || mSinceKeyframe >= mKeyframeEvery;
+    mPayload.clear();
+    for(int a = 0; a < FrameStream::NUM_DYNAMIC; ++a){
+        if(!(mAttributes & (1 << a))){
+            continue;
+        }
+        gather(a, particles, mValues);
+        if(!keyframe){
+            for(unsigned int i = 0; i < mValues.size(); ++i){
+                mValues[i] -= mDecoded[a][i];
+            }
+        }
+        FrameStream::encodeChannel(mValues, mBits, mBlock, mReconstructed);
+        mPayload.insert(mPayload.end(), mBlock.begin(), mBlock.end());
+        if(keyframe){
+            mDecoded[a].swap(mReconstructed);
+        }
+        else{
+            for(unsigned int i = 0; i < mReconstructed.size(); ++i){
+                mDecoded[a][i] += mReconstructed[i];
+            }
+        }
+    }
+    mSinceKeyframe = keyframe ? 1 : mSinceKeyframe + 1;
+
+    mOut.write(FrameStream::frameTag(), 4);
+    put(frame);
+    put(int(keyframe));
+    put(uint64_t(mPayload.size()));
+    mOut.write(mPayload.data(), mPayload.size());
+    mOut.flush();
+    if(!mOut){
+        std::cout << "Error writing frame " << frame << " to frame stream" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+template<class T, int dim>
+void FrameStreamWriter<T,dim>::close() {
+    if(mOut.is_open()){
+        mOut.close();
+    }
+}
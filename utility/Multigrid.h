@@ -0,0 +1,255 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+#include <Eigen/SparseCholesky>
+
+#include "../mesh/TetBVH.h"
+#include "../mesh/TetraMesh.h"
+
+// Nested embedding grids for geometric multigrid on an unstructured tetrahedral
+// mesh. Level 0 is the mesh itself; level l is a box mesh (generateBox, 5
+// tetrahedra per cell) around the mesh's bounding box with half the cells of
+// level l - 1, the first with about an eighth of the mesh's vertices. Every
+// vertex of level l - 1 is located in level l with a TetBVH and interpolated
+// from that tetrahedron's corners with barycentric weights; grid vertices no
+// finer vertex depends on are dropped, so coarse operators stay nonsingular.
+// The hierarchy only depends on the positions it was built from.
+template<class T, int dim>
+class MultigridHierarchy {
+public:
+    typedef Eigen::Matrix<T,dim,1> Vec;
+    typedef Eigen::SparseMatrix<T, Eigen::RowMajor> Matrix;
+
+    MultigridHierarchy();
+
+    // stops after maxLevels levels or at a level of at most coarsestVertices vertices
+    void build(const std::vector<Vec>& positions, int maxLevels, int coarsestVertices);
+
+    int numLevels() const { return mNumVertices.size(); }
+    int numVertices(int level) const { return mNumVertices[level]; }
+    // dim * numVertices(level - 1) x dim * numVertices(level), for level >= 1
+    const Matrix& prolongation(int level) const { return mProlongations[level - 1]; }
+
+private:
+    std::vector<int> mNumVertices;
+    std::vector<Matrix> mProlongations;
+};
+
+// One V-cycle over a MultigridHierarchy as a preconditioner for Eigen's
+// ConjugateGradient or MINRES: Galerkin coarse operators P^T A P, damped Jacobi
+// smoothing with the same number of sweeps before and after the coarse
+// correction, and a sparse Cholesky solve on the coarsest level. The cycle is
+// a symmetric positive definite operator whenever A is, as CG requires. Set the
+// hierarchy before the solver's compute().
+template<class T, int dim>
+class MultigridPreconditioner {
+public:
+    typedef typename MultigridHierarchy<T,dim>::Matrix Matrix;
+    typedef Eigen::Matrix<T,Eigen::Dynamic,1> Vector;
+
+    MultigridPreconditioner();
+
+    void setHierarchy(const MultigridHierarchy<T,dim>* hierarchy, int sweeps = 2);
+
+    template<class MatrixType>
+    MultigridPreconditioner& analyzePattern(const MatrixType&) { return *this; }
+    template<class MatrixType>
+    MultigridPreconditioner& factorize(const MatrixType& matrix);
+    template<class MatrixType>
+    MultigridPreconditioner& compute(const MatrixType& matrix) { return factorize(matrix); }
+
+    Vector solve(const Vector& b) const;
+
+    Eigen::ComputationInfo info() const { return mInfo; }
+    Eigen::Index rows() const { return mOperators.empty() ? 0 : mOperators[0].rows(); }
+    Eigen::Index cols() const { return rows(); }
+
+private:
+    void cycle(int level, const Vector& b, Vector& x) const;
+
+    const MultigridHierarchy<T,dim>* mHierarchy;
+    int mSweeps;
+    std::vector<Matrix> mOperators;             // A on every level
+    std::vector<Vector> mDamping;               // omega / diag(A) on every level but the coarsest
+    Eigen::SimplicialLDLT<Eigen::SparseMatrix<T>> mCoarse;
+    Eigen::ComputationInfo mInfo;
+};
+
+template<class T, int dim>
+MultigridHierarchy<T,dim>::MultigridHierarchy() {}
+
+template<class T, int dim>
+void MultigridHierarchy<T,dim>::build(const std::vector<Vec>& positions, int maxLevels, int coarsestVertices) {
+    mNumVertices.assign(1, positions.size());
+    mProlongations.clear();
+    if(positions.empty()){
+        return;
+    }
+
+    Vec minCorner = positions[0];
+    Vec maxCorner = positions[0];
+    for(const Vec& p : positions){
+        minCorner = minCorner.cwiseMin(p);
+        maxCorner = maxCorner.cwiseMax(p);
+    }
+    // padded so that every vertex is strictly inside the grids
+    const T pad = T(1e-3) * std::max((maxCorner - minCorner).maxCoeff(), T(1e-6));
+    minCorner -= Vec::Constant(pad);
+    maxCorner += Vec::Constant(pad);
+    const Vec extent = maxCorner - minCorner;
+    const T spacing = std::cbrt(extent.prod() / std::max<T>(1, T(positions.size()) / 8));
+    Eigen::Vector3i cells;
+    for(int d = 0; d < dim; ++d){
+        cells[d] = std::max(1, int(std::ceil(extent[d] / spacing)));
+    }
+
+    std::vector<Vec> fine = positions;
+    while(numLevels() < maxLevels && int(fine.size()) > coarsestVertices){
+        TetraMesh<T,dim> grid("");
+        grid.generateBox(cells, minCorner, maxCorner, 5, T(0), 1);
+        const std::vector<Vec>& gridPositions = grid.mParticles.positions;
+        const std::vector<Tetrahedron<T,dim>>& gridTetras = *grid.mTetras;
+        TetBVH<T,dim> bvh;
+        bvh.build(gridPositions, gridTetras);
+
+        const int numFine = fine.size();
+        std::vector<int> tets(numFine);
+        std::vector<typename TetBVH<T,dim>::Weights> weights(numFine);
+        #pragma omp parallel for
+        for(int i = 0; i < numFine; ++i){
+            bvh.locate(fine[i], tets[i], weights[i]);
+        }
+
+        // compact numbering of the grid vertices that are interpolated from
+        std::vector<int> index(gridPositions.size(), -1);
+        std::vector<Vec> coarse;
+        for(int i = 0; i < numFine; ++i){
+            for(int k = 0; k < dim + 1; ++k){
+                const int v = gridTetras[tets[i]].mPIndices[k];
+                if(weights[i][k] != 0 && index[v] < 0){
+                    index[v] = coarse.size();
+                    coarse.push_back(gridPositions[v]);
+                }
+            }
+        }
+        if(coarse.size() >= fine.size()){
+            break;
+        }
+
+        std::vector<Eigen::Triplet<T>> entries;
+        entries.reserve(size_t(numFine) * (dim + 1) * dim);
+        for(int i = 0; i < numFine; ++i){
+            for(int k = 0; k < dim + 1; ++k){
+                if(weights[i][k] == 0){
+                    continue;
+                }
+                const int c = index[gridTetras[tets[i]].mPIndices[k]];
+                for(int d = 0; d < dim; ++d){
+                    entries.push_back(Eigen::Triplet<T>(dim * i + d, dim * c + d, weights[i][k]));
+                }
+            }
+        }
+        Matrix P(dim * numFine, dim * coarse.size());
+        P.setFromTriplets(entries.begin(), entries.end());
+        mProlongations.push_back(P);
+        mNumVertices.push_back(coarse.size());
+
+        fine.swap(coarse);
+        for(int d = 0; d < dim; ++d){
+            cells[d] = std::max(1, (cells[d] + 1) / 2);
+        }
+    }
+}
+
+template<class T, int dim>
+MultigridPreconditioner<T,dim>::MultigridPreconditioner() : mHierarchy(nullptr), mSweeps(2), mInfo(Eigen::Success) {}
+
+template<class T, int dim>
+void MultigridPreconditioner<T,dim>::setHierarchy(const MultigridHierarchy<T,dim>* hierarchy, int sweeps) {
+    mHierarchy = hierarchy;
+    mSweeps = sweeps;
+}
+
+template<class T, int dim>
+template<class MatrixType>
+MultigridPreconditioner<T,dim>& MultigridPreconditioner<T,dim>::factorize(const MatrixType& matrix) {
+    const int levels = mHierarchy == nullptr ? 1 : mHierarchy->numLevels();
+    mOperators.resize(levels);
+    mDamping.resize(levels - 1);
+    mOperators[0] = matrix;
+    for(int l = 1; l < levels; ++l){
+        const Matrix& P = mHierarchy->prolongation(l);
+        if(P.rows() != mOperators[l - 1].rows()){
+            std::cout << "error: multigrid hierarchy does not match the system size" << std::endl;
+            mInfo = Eigen::InvalidInput;
+            return *this;
+        }
+        Matrix AP = mOperators[l - 1] * P;
+        mOperators[l] = Matrix(P.transpose()) * AP;
+    }
+
+    // omega = 4 / (3 rho(D^-1 A)), the spectral radius from a few power iterations
+    for(int l = 0; l < levels - 1; ++l){
+        const Matrix& A = mOperators[l];
+        Vector inverseDiagonal = A.diagonal().cwiseInverse();
+        Vector v = Vector::Ones(A.rows()).normalized();
+        T rho = 1;
+        for(int k = 0; k < 10; ++k){
+            Vector w = inverseDiagonal.cwiseProduct(A * v);
+            rho = w.norm();
+            if(rho <= 0){
+                rho = 1;
+                break;
+            }
+            v = w / rho;
+        }
+        mDamping[l] = (T(4) / (3 * rho)) * inverseDiagonal;
+    }
+
+    mCoarse.compute(Eigen::SparseMatrix<T>(mOperators[levels - 1]));
+    mInfo = mCoarse.info();
+    if(mInfo != Eigen::Success){
+        std::cout << "error: coarsest multigrid level is singular" << std::endl;
+    }
+    return *this;
+}
+
+template<class T, int dim>
+typename MultigridPreconditioner<T,dim>::Vector MultigridPreconditioner<T,dim>::solve(const Vector& b) const {
+    Vector x;
+    cycle(0, b, x);
+    return x;
+}
+
+template<class T, int dim>
+void MultigridPreconditioner<T,dim>::cycle(int level, const Vector& b, Vector& x) const {
+    if(level == int(mOperators.size()) - 1){
+        x = mCoarse.solve(b);
+        return;
+    }
+    const Matrix& A = mOperators[level];
+    const Vector& damping = mDamping[level];
+
+    // starting from zero the first sweep is just the damped diagonal
+    x = damping.cwiseProduct(b);
+    for(int s = 1; s < mSweeps; ++s){
+        x += damping.cwiseProduct(b - A * x);
+    }
+
+    const Matrix& P = mHierarchy->prolongation(level + 1);
+    Vector coarseB = P.transpose() * (b - A * x);
+    Vector coarseX;
+    cycle(level + 1, coarseB, coarseX);
+    x += P * coarseX;
+
+    for(int s = 0; s < mSweeps; ++s){
+        x += damping.cwiseProduct(b - A * x);
+    }
+}
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../mesh/TetraMesh.h"
+#include "FileHelper.h"
+
+// On-disk cache of a precomputed mesh: rest positions, lumped masses and
+// tetrahedron counts per particle, indices, Dm, DmInv, volume, VolDmInvT and
+// mass per tetrahedron. Files are named by a 64 bit FNV-1a key over the mesh
+// source and the density, and are read through mmap. Layout (native endianness):
+//   header    FileHelper::Header, counts numParticles, numTets
+//   scalars   positions, masses, per tet: Dm, DmInv, VolDmInvT (column major), volume, mass
+//   integers  tets per particle, indices per tet
+template<class T, int dim>
+class PrecomputeCache {
+
+public:
+    static const int VERSION = 2;
+
+    // key over the given files' contents and any other parameters the mesh depends on
+    static uint64_t key(const std::vector<std::string> &files, const std::string &parameters);
+    static std::string path(const std::string &directory, uint64_t key);
+
+    // fills an empty mesh, returns false on a missing or mismatching file
+    static bool read(const std::string &path, uint64_t key, TetraMesh<T,dim> &mesh);
+    // writes through FileHelper::writeAtomic
+    static bool write(const std::string &path, uint64_t key, const TetraMesh<T,dim> &mesh);
+
+private:
+    static const int HEADER_BYTES = FileHelper::HEADER_BYTES;
+    static const int TET_SCALARS = 3 * dim * dim + 2;
+
+    static uint64_t fnv1a(const char *data, size_t size, uint64_t hash) {
+        for(size_t i = 0; i < size; ++i){
+            hash ^= (unsigned char)data[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    static size_t fileSize(int numParticles, int numTets) {
+        return HEADER_BYTES + sizeof(T) * (size_t(numParticles) * (dim + 1) + size_t(numTets) * TET_SCALARS)
+               + sizeof(int) * (size_t(numParticles) + size_t(numTets) * (dim + 1));
+    }
+
+    static const char* magic() { return "FEMCACHE"; }
+};
+
+template<class T, int dim>
+uint64_t PrecomputeCache<T,dim>::key(const std::vector<std::string> &files, const std::string &parameters) {
+    uint64_t hash = 14695981039346656037ull;
+    for(const std::string &file : files){
+        size_t size = 0;
+        const char *data = FileHelper::mapFile(file, size);
+        if(data == nullptr){
+            std::cout << "Unable to read " << file << " for the precompute cache" << std::endl;
+            return 0;
+        }
+        hash = fnv1a(data, size, hash);
+        FileHelper::unmapFile(data, size);
+    }
+    std::string tail = parameters + " density " + std::to_string(Tetrahedron<T,dim>::DENSITY)
+                       + " version " + std::to_string(VERSION) + " scalar " + std::to_string(sizeof(T))
+                       + " dim " + std::to_string(dim);
+    return fnv1a(tail.data(), tail.size(), hash);
+}
+
+template<class T, int dim>
+std::string PrecomputeCache<T,dim>::path(const std::string &directory, uint64_t key) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.femcache", (unsigned long long)key);
+    return directory + "/" + name;
+}
+
+template<class T, int dim>
+bool PrecomputeCache<T,dim>::read(const std::string &path, uint64_t key, TetraMesh<T,dim> &mesh) {
+    size_t size = 0;
+    const char *data = FileHelper::mapFile(path, size);
+    if(data == nullptr){
+        return false;
+    }
+    FileHelper::Header header;
+    std::memcpy(&header, data, std::min(size, sizeof(FileHelper::Header)));
+    if(size < size_t(HEADER_BYTES) || !FileHelper::matchHeader(header, FileHelper::makeHeader(magic(), VERSION, sizeof(T), dim, key))
+       || size != fileSize(header.counts[0], header.counts[1])){
+        std::cout << "ignoring stale precompute cache " << path << std::endl;
+        FileHelper::unmapFile(data, size);
+        return false;
+    }
+
+    const int numParticles = header.counts[0];
+    const int numTets = header.counts[1];
+    const T *positions = reinterpret_cast<const T*>(data + HEADER_BYTES);
+    const T *masses = positions + size_t(numParticles) * dim;
+    const T *tetData = masses + numParticles;
+    const int *tetCounts = reinterpret_cast<const int*>(tetData + size_t(numTets) * TET_SCALARS);
+    const int *indices = tetCounts + numParticles;
+
+    Particles<T,dim> &particles = mesh.mParticles;
+    particles.resize(numParticles);
+    #pragma omp parallel for
+    for(int i = 0; i < numParticles; ++i){
+        particles.positions[i] = Eigen::Map<const Eigen::Matrix<T,dim,1>>(positions + size_t(i) * dim);
+        particles.masses[i] = masses[i];
+        particles.tets[i] = tetCounts[i];
+    }
+
+    mesh.mTetras = std::make_shared<std::vector<Tetrahedron<T,dim>>>(numTets, Tetrahedron<T,dim>(std::vector<int>(dim + 1, 0)));
+    std::vector<Tetrahedron<T,dim>> &tetras = *mesh.mTetras;
+    #pragma omp parallel for
+    for(int n = 0; n < numTets; ++n){
+        Tetrahedron<T,dim> &t = tetras[n];
+        const T *s = tetData + size_t(n) * TET_SCALARS;
+        for(int i = 0; i < dim + 1; ++i){
+            t.mPIndices[i] = indices[size_t(n) * (dim + 1) + i];
+        }
+        t.mDm = Eigen::Map<const Eigen::Matrix<T,dim,dim>>(s);
+        t.mDmInv = Eigen::Map<const Eigen::Matrix<T,dim,dim>>(s + dim * dim);
+        t.mVolDmInvT = Eigen::Map<const Eigen::Matrix<T,dim,dim>>(s + 2 * dim * dim);
+        t.volume = s[3 * dim * dim];
+        t.mass = s[3 * dim * dim + 1];
+    }
+
+    FileHelper::unmapFile(data, size);
+    return true;
+}
+
+template<class T, int dim>
+bool PrecomputeCache<T,dim>::write(const std::string &path, uint64_t key, const TetraMesh<T,dim> &mesh) {
+    const Particles<T,dim> &particles = mesh.mParticles;
+    const std::vector<Tetrahedron<T,dim>> &tetras = *mesh.mTetras;
+    const int numParticles = particles.positions.size();
+    const int numTets = tetras.size();
+
+    std::vector<char> buffer(fileSize(numParticles, numTets), 0);
+    FileHelper::Header header = FileHelper::makeHeader(magic(), VERSION, sizeof(T), dim, key);
+    header.counts[0] = numParticles;
+    header.counts[1] = numTets;
+    std::memcpy(buffer.data(), &header, sizeof(FileHelper::Header));
+
+    T *positions = reinterpret_cast<T*>(buffer.data() + HEADER_BYTES);
+    T *masses = positions + size_t(numParticles) * dim;
+    T *tetData = masses + numParticles;
+    int *tetCounts = reinterpret_cast<int*>(tetData + size_t(numTets) * TET_SCALARS);
+    int *indices = tetCounts + numParticles;
+
+    for(int i = 0; i < numParticles; ++i){
+        Eigen::Map<Eigen::Matrix<T,dim,1>>(positions + size_t(i) * dim) = particles.positions[i];
+        masses[i] = particles.masses[i];
+        tetCounts[i] = particles.tets[i];
+    }
+    for(int n = 0; n < numTets; ++n){
+        const Tetrahedron<T,dim> &t = tetras[n];
+        T *s = tetData + size_t(n) * TET_SCALARS;
+        for(int i = 0; i < dim + 1; ++i){
+            indices[size_t(n) * (dim + 1) + i] = t.mPIndices[i];
+        }
+        Eigen::Map<Eigen::Matrix<T,dim,dim>> Dm(s), DmInv(s + dim * dim), VolDmInvT(s + 2 * dim * dim);
+        Dm = t.mDm;
+        DmInv = t.mDmInv;
+        VolDmInvT = t.mVolDmInvT;
+        s[3 * dim * dim] = t.volume;
+        s[3 * dim * dim + 1] = t.mass;
+    }
+
+    return FileHelper::writeAtomic(path, "precompute cache", [&](std::ofstream &out){
+        out.write(buffer.data(), buffer.size());
+    });
+}
@@ -0,0 +1,208 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Phases timed by the simulation loop. Nested phases are inclusive:
+// substep contains forces and integrate, forces contains svd, integrate contains collision.
+enum ProfilePhase {
+    PROFILE_SUBSTEP = 0,
+    PROFILE_FORCES,
+    PROFILE_SVD,
+    PROFILE_INTEGRATE,
+    PROFILE_COLLISION,
+    PROFILE_ASSEMBLE,
+    PROFILE_STIFFNESS,
+    PROFILE_SOLVE,
+    PROFILE_OUTPUT,
+    PROFILE_CHECKPOINT,
+    PROFILE_NUM_PHASES
+};
+
+// Aggregates wall time per phase and per frame. When disabled a scope costs a
+// single branch; building with FEM_NO_PROFILER removes the scopes entirely.
+// Phases recorded from several threads add their individual times.
+class Profiler {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    Profiler() : mEnabled(false), mTracing(false), mStart(Clock::now()) {
+        for (int i = 0; i < PROFILE_NUM_PHASES; ++i) {
+            mNanos[i] = 0;
+            mCounts[i] = 0;
+        }
+    }
+
+    static const char* phaseName(int phase) {
+        static const char* names[PROFILE_NUM_PHASES] = {
+            "substep", "forces", "svd", "integrate", "collision",
+            "assemble", "stiffness", "solve", "output", "checkpoint"
+        };
+        return names[phase];
+    }
+
+    void enable(bool trace) {
+        mEnabled = true;
+        mTracing = trace;
+        mStart = Clock::now();
+    }
+
+    bool enabled() const { return mEnabled; }
+
+    void add(int phase, Clock::time_point begin, Clock::time_point end) {
+        const long long nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+        mNanos[phase] += nanos;
+        mCounts[phase] += 1;
+        // per-element phases would flood the trace, only coarse phases are traced
+        if (mTracing && phase != PROFILE_SVD && phase != PROFILE_COLLISION) {
+            TraceEvent event;
+            event.phase = phase;
+            event.thread = std::hash<std::thread::id>()(std::this_thread::get_id()) % 100000;
+            event.beginMicros = std::chrono::duration_cast<std::chrono::nanoseconds>(begin - mStart).count() / 1000.0;
+            event.durationMicros = nanos / 1000.0;
+            std::lock_guard<std::mutex> lock(mTraceMutex);
+            mTrace.push_back(event);
+        }
+    }
+
+    // closes the current frame and starts aggregating the next one
+    void endFrame(int frame) {
+        if (!mEnabled) {
+            return;
+        }
+        FrameRecord record;
+        record.frame = frame;
+        for (int i = 0; i < PROFILE_NUM_PHASES; ++i) {
+            record.millis[i] = mNanos[i].exchange(0) * 1e-6;
+            record.counts[i] = mCounts[i].exchange(0);
+        }
+        mFrames.push_back(record);
+    }
+
+    // CSV (one row per frame, ms and call count per phase) or JSON, chosen by extension
+    bool writeSummary(const std::string& path) const {
+        std::ofstream out(path);
+        if (!out) {
+            std::cout << "Unable to write profile summary " << path << std::endl;
+            return false;
+        }
+        const bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+        if (json) {
+            out << "{\n  \"frames\": [\n";
+            for (unsigned int f = 0; f < mFrames.size(); ++f) {
+                out << "    {\"frame\": " << mFrames[f].frame;
+                for (int i = 0; i < PROFILE_NUM_PHASES; ++i) {
+                    out << ", \"" << phaseName(i) << "_ms\": " << mFrames[f].millis[i]
+                        << ", \"" << phaseName(i) << "_calls\": " << mFrames[f].counts[i];
+                }
+                out << "}" << (f + 1 < mFrames.size() ? "," : "") << "\n";
+            }
+            out << "  ],\n  \"total_ms\": {";
+            for (int i = 0; i < PROFILE_NUM_PHASES; ++i) {
+                out << (i ? ", " : "") << "\"" << phaseName(i) << "\": " << totalMillis(i);
+            }
+            out << "}\n}\n";
+        }
+        else {
+            out << "frame";
+            for (int i = 0; i < PROFILE_NUM_PHASES; ++i) {
+                out << "," << phaseName(i) << "_ms," << phaseName(i) << "_calls";
+            }
+            out << "\n";
+            for (unsigned int f = 0; f < mFrames.size(); ++f) {
+                out << mFrames[f].frame;
+                for (int i = 0; i < PROFILE_NUM_PHASES; ++i) {
+                    out << "," << mFrames[f].millis[i] << "," << mFrames[f].counts[i];
+                }
+                out << "\n";
+            }
+        }
+        return true;
+    }
+
+    // Chrome trace-event JSON, open in chrome://tracing or Perfetto
+    bool writeTrace(const std::string& path) const {
+        std::ofstream out(path);
+        if (!out) {
+            std::cout << "Unable to write profile trace " << path << std::endl;
+            return false;
+        }
+        out << "{\"traceEvents\": [\n";
+        for (unsigned int i = 0; i < mTrace.size(); ++i) {
+            const TraceEvent& e = mTrace[i];
+            out << "{\"name\": \"" << phaseName(e.phase) << "\", \"ph\": \"X\", \"pid\": 0, \"tid\": " << e.thread
+                << ", \"ts\": " << e.beginMicros << ", \"dur\": " << e.durationMicros << "}"
+                << (i + 1 < mTrace.size() ? "," : "") << "\n";
+        }
+        out << "]}\n";
+        return true;
+    }
+
+    double totalMillis(int phase) const {
+        double total = 0.0;
+        for (unsigned int f = 0; f < mFrames.size(); ++f) {
+            total += mFrames[f].millis[phase];
+        }
+        return total;
+    }
+
+private:
+    struct FrameRecord {
+        int frame;
+        double millis[PROFILE_NUM_PHASES];
+        long long counts[PROFILE_NUM_PHASES];
+    };
+
+    struct TraceEvent {
+        int phase;
+        size_t thread;
+        double beginMicros;
+        double durationMicros;
+    };
+
+    bool mEnabled;
+    bool mTracing;
+    Clock::time_point mStart;
+    std::atomic<long long> mNanos[PROFILE_NUM_PHASES];
+    std::atomic<long long> mCounts[PROFILE_NUM_PHASES];
+    std::vector<FrameRecord> mFrames;
+    std::mutex mTraceMutex;
+    std::vector<TraceEvent> mTrace;
+};
+
+// Times the enclosing scope into a phase of the profiler.
+class ProfileScope {
+public:
+    ProfileScope(Profiler& profiler, int phase) : mProfiler(profiler), mPhase(phase), mActive(profiler.enabled()) {
+        if (mActive) {
+            mBegin = Profiler::Clock::now();
+        }
+    }
+
+    ~ProfileScope() {
+        if (mActive) {
+            mProfiler.add(mPhase, mBegin, Profiler::Clock::now());
+        }
+    }
+
+private:
+    Profiler& mProfiler;
+    int mPhase;
+    bool mActive;
+    Profiler::Clock::time_point mBegin;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#ifdef FEM_NO_PROFILER
+#define PROFILE_SCOPE(profiler, phase)
+#else
+#define PROFILE_SCOPE(profiler, phase) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(profiler, phase)
+#endif
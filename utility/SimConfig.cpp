@@ -0,0 +1,379 @@
+#include <fstream>
+#include <iostream>
+#include <cstdlib>
+#include "SimConfig.h"
+
+namespace {
+
+std::string trim(const std::string &s) {
+    const char *whitespace = " \t\r\n";
+    size_t begin = s.find_first_not_of(whitespace);
+    if (begin == std::string::npos) {
+        return "";
+    }
+    size_t end = s.find_last_not_of(whitespace);
+    return s.substr(begin, end - begin + 1);
+}
+
+bool parseDouble(const std::string &value, double &result) {
+    char *end = nullptr;
+    result = std::strtod(value.c_str(), &end);
+    return end != value.c_str() && *end == '\0';
+}
+
+bool parseBool(const std::string &value, bool &result) {
+    if (value == "true" || value == "1" || value == "on") {
+        result = true;
+        return true;
+    }
+    if (value == "false" || value == "0" || value == "off") {
+        result = false;
+        return true;
+    }
+    return false;
+}
+
+bool parseInt(const std::string &value, int &result) {
+    char *end = nullptr;
+    result = std::strtol(value.c_str(), &end, 10);
+    return end != value.c_str() && *end == '\0';
+}
+
+// "a, b, c"
+template<class V>
+bool parseTriple(const std::string &value, V result[3], bool (*parse)(const std::string &, V &)) {
+    size_t begin = 0;
+    for (int i = 0; i < 3; ++i) {
+        size_t end = i < 2 ? value.find(',', begin) : value.size();
+        if (end == std::string::npos || !parse(trim(value.substr(begin, end - begin)), result[i])) {
+            return false;
+        }
+        begin = end + 1;
+    }
+    return true;
+}
+
+}
+
+SimConfig::SimConfig() : integrator("explicit"), timeStep(0.0), stepsPerFrame(0), frames(240), threads(0), scheduler("tasks"), taskChunk(256), linearSolver("minres"), linearIterations(20), linearTolerance(1e-6), multigridLevels(4), projectiveIterations(10), xpbdIterations(2), rotation("svd"), rotationIterations(4),
+                         k(500000.0), nu(0.3), materialModel("fixed_corotated"), dampingMass(0.0), dampingStiffness(0.0), modalModes(12), modalBasis(""),
+                         subspaceSize(20), subspaceCubature(200), subspaceBasis("subspace.bin"),
+                         multirateLevels(4), multirateCourant(0.5),
+                         qualityReport(false), qualityCourant(0.5), qualityMassScaleStep(0.0), meshGenerator("tetgen"), meshPath("objects/cube.1"),
+                         boxCells{10, 10, 10}, boxMin{0.0, 0.0, -1.0}, boxMax{1.0, 1.0, 0.0}, boxSplit(5), boxJitter(0.0), boxSeed(1), meshCacheDir(""),
+                         scene("default"),
+                         outputDir("output"), outputEvery(1), colliderDir("."),
+                         outputFormat("bgeo"), outputAttributes("position, velocity, mass"), outputBits(16), keyframeEvery(30), outputAsync(true),
+                         renderPath(""), renderScale(1.0), renderOffset{0.0, 0.0, 0.0},
+                         sleep(false), sleepSpeed(1e-3), sleepStrain(1e-4), sleepCheckEvery(100), sleepChecks(3), checkpointDir("checkpoints"), checkpointEvery(0),
+                         profile(false), profileSummary("profile.csv"), profileTrace("") {}
+
+bool SimConfig::load(const std::string &path) {
+
+    std::vector<std::pair<std::string, std::string>> entries;
+    if (!readIni(path, entries)) {
+        return false;
+    }
+
+    for (unsigned int i = 0; i < entries.size(); ++i)
+    {
+        if (!set(entries[i].first, entries[i].second)) {
+            std::cout << path << ": rejected " << entries[i].first << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool SimConfig::save(const std::string &path) const {
+
+    std::ofstream outFile(path);
+
+    if (!outFile)
+    {
+        std::cout << "\nError writing config file " << path << ".\n";
+        return false;
+    }
+
+    outFile.precision(12);
+    outFile << "[solver]\n";
+    outFile << "integrator = " << integrator << "\n";
+    outFile << "timestep = " << timeStep << "\n";
+    outFile << "steps_per_frame = " << stepsPerFrame << "\n";
+    outFile << "frames = " << frames << "\n";
+    outFile << "threads = " << threads << "\n";
+    outFile << "scheduler = " << scheduler << "\n";
+    outFile << "task_chunk = " << taskChunk << "\n";
+    outFile << "linear_solver = " << linearSolver << "\n";
+    outFile << "linear_iterations = " << linearIterations << "\n";
+    outFile << "linear_tolerance = " << linearTolerance << "\n";
+    outFile << "multigrid_levels = " << multigridLevels << "\n";
+    outFile << "projective_iterations = " << projectiveIterations << "\n";
+    outFile << "xpbd_iterations = " << xpbdIterations << "\n";
+    outFile << "rotation = " << rotation << "\n";
+    outFile << "rotation_iterations = " << rotationIterations << "\n";
+    outFile << "\n[material]\n";
+    outFile << "k = " << k << "\n";
+    outFile << "nu = " << nu << "\n";
+    outFile << "model = " << materialModel << "\n";
+    outFile << "\n[damping]\n";
+    outFile << "mass = " << dampingMass << "\n";
+    outFile << "stiffness = " << dampingStiffness << "\n";
+    outFile << "\n[modal]\n";
+    outFile << "modes = " << modalModes << "\n";
+    outFile << "basis = " << modalBasis << "\n";
+    outFile << "\n[subspace]\n";
+    outFile << "size = " << subspaceSize << "\n";
+    outFile << "cubature = " << subspaceCubature << "\n";
+    outFile << "basis = " << subspaceBasis << "\n";
+    outFile << "\n[multirate]\n";
+    outFile << "levels = " << multirateLevels << "\n";
+    outFile << "courant = " << multirateCourant << "\n";
+    outFile << "\n[quality]\n";
+    outFile << "report = " << (qualityReport ? "true" : "false") << "\n";
+    outFile << "courant = " << qualityCourant << "\n";
+    outFile << "mass_scale_step = " << qualityMassScaleStep << "\n";
+    outFile << "\n[mesh]\n";
+    outFile << "generator = " << meshGenerator << "\n";
+    outFile << "path = " << meshPath << "\n";
+    outFile << "box_cells = " << boxCells[0] << ", " << boxCells[1] << ", " << boxCells[2] << "\n";
+    outFile << "box_min = " << boxMin[0] << ", " << boxMin[1] << ", " << boxMin[2] << "\n";
+    outFile << "box_max = " << boxMax[0] << ", " << boxMax[1] << ", " << boxMax[2] << "\n";
+    outFile << "box_split = " << boxSplit << "\n";
+    outFile << "box_jitter = " << boxJitter << "\n";
+    outFile << "box_seed = " << boxSeed << "\n";
+    outFile << "cache_dir = " << meshCacheDir << "\n";
+    outFile << "\n[scene]\n";
+    outFile << "name = " << scene << "\n";
+    outFile << "\n[output]\n";
+    outFile << "dir = " << outputDir << "\n";
+    outFile << "every = " << outputEvery << "\n";
+    outFile << "collider_dir = " << colliderDir << "\n";
+    outFile << "format = " << outputFormat << "\n";
+    outFile << "attributes = " << outputAttributes << "\n";
+    outFile << "bits = " << outputBits << "\n";
+    outFile << "keyframe_every = " << keyframeEvery << "\n";
+    outFile << "async = " << (outputAsync ? "true" : "false") << "\n";
+    outFile << "\n[render]\n";
+    outFile << "path = " << renderPath << "\n";
+    outFile << "scale = " << renderScale << "\n";
+    outFile << "offset = " << renderOffset[0] << ", " << renderOffset[1] << ", " << renderOffset[2] << "\n";
+    outFile << "\n[sleep]\n";
+    outFile << "enabled = " << (sleep ? "true" : "false") << "\n";
+    outFile << "speed = " << sleepSpeed << "\n";
+    outFile << "strain = " << sleepStrain << "\n";
+    outFile << "check_every = " << sleepCheckEvery << "\n";
+    outFile << "checks = " << sleepChecks << "\n";
+    outFile << "\n[checkpoint]\n";
+    outFile << "dir = " << checkpointDir << "\n";
+    outFile << "every = " << checkpointEvery << "\n";
+    outFile << "\n[profile]\n";
+    outFile << "enabled = " << (profile ? "true" : "false") << "\n";
+    outFile << "summary = " << profileSummary << "\n";
+    outFile << "trace = " << profileTrace << "\n";
+
+    return true;
+}
+
+bool SimConfig::readIni(const std::string &path, std::vector<std::pair<std::string, std::string>> &entries) {
+
+    std::ifstream inFile(path);
+
+    if (!inFile)
+    {
+        std::cout << "\nError opening config file " << path << ".\n";
+        return false;
+    }
+
+    std::string line;
+    std::string section = "";
+    int lineNumber = 0;
+
+    while (std::getline(inFile, line))
+    {
+        ++lineNumber;
+        size_t comment = line.find_first_of("#;");
+        if (comment != std::string::npos) {
+            line = line.substr(0, comment);
+        }
+        line = trim(line);
+        if (line.empty()) {
+            continue;
+        }
+
+        if (line[0] == '[' && line[line.size() - 1] == ']') {
+            section = trim(line.substr(1, line.size() - 2));
+            continue;
+        }
+
+        size_t equals = line.find('=');
+        if (equals == std::string::npos) {
+            std::cout << path << ":" << lineNumber << ": expected key = value" << std::endl;
+            return false;
+        }
+        std::string key = trim(line.substr(0, equals));
+        std::string value = trim(line.substr(equals + 1));
+        entries.push_back(std::make_pair(section.empty() ? key : section + "." + key, value));
+    }
+
+    return true;
+}
+
+bool SimConfig::set(const std::string &key, const std::string &value) {
+
+    bool ok = true;
+
+    if (key == "solver.integrator") {
+        integrator = value;
+        ok = (value == "explicit" || value == "implicit" || value == "projective" || value == "xpbd" || value == "modal"
+              || value == "subspace" || value == "multirate");
+    }
+    else if (key == "solver.timestep") ok = parseDouble(value, timeStep);
+    else if (key == "solver.steps_per_frame") ok = parseInt(value, stepsPerFrame);
+    else if (key == "solver.frames") ok = parseInt(value, frames);
+    else if (key == "solver.threads") ok = parseInt(value, threads);
+    else if (key == "solver.scheduler") {
+        scheduler = value;
+        ok = (value == "serial" || value == "tasks");
+    }
+    else if (key == "solver.task_chunk") ok = parseInt(value, taskChunk) && taskChunk >= 1;
+    else if (key == "solver.linear_solver") {
+        linearSolver = value;
+        ok = (value == "minres" || value == "gauss_seidel" || value == "multigrid");
+    }
+    else if (key == "solver.linear_iterations") ok = parseInt(value, linearIterations) && linearIterations >= 1;
+    else if (key == "solver.linear_tolerance") ok = parseDouble(value, linearTolerance) && linearTolerance > 0.0;
+    else if (key == "solver.multigrid_levels") ok = parseInt(value, multigridLevels) && multigridLevels >= 1;
+    else if (key == "solver.projective_iterations") ok = parseInt(value, projectiveIterations) && projectiveIterations >= 1;
+    else if (key == "solver.xpbd_iterations") ok = parseInt(value, xpbdIterations) && xpbdIterations >= 1;
+    else if (key == "solver.rotation") {
+        rotation = value;
+        ok = (value == "svd" || value == "warm_start");
+    }
+    else if (key == "solver.rotation_iterations") ok = parseInt(value, rotationIterations) && rotationIterations >= 1;
+    else if (key == "material.k") ok = parseDouble(value, k);
+    else if (key == "material.nu") ok = parseDouble(value, nu);
+    else if (key == "material.model") {
+        materialModel = value;
+        ok = (value == "fixed_corotated" || value == "corotated_linear");
+    }
+    else if (key == "damping.mass") ok = parseDouble(value, dampingMass) && dampingMass >= 0.0;
+    else if (key == "damping.stiffness") ok = parseDouble(value, dampingStiffness) && dampingStiffness >= 0.0;
+    else if (key == "modal.modes") ok = parseInt(value, modalModes) && modalModes >= 1;
+    else if (key == "modal.basis") modalBasis = value;
+    else if (key == "subspace.size") ok = parseInt(value, subspaceSize) && subspaceSize >= 1;
+    else if (key == "subspace.cubature") ok = parseInt(value, subspaceCubature) && subspaceCubature >= 1;
+    else if (key == "subspace.basis") subspaceBasis = value;
+    else if (key == "multirate.levels") ok = parseInt(value, multirateLevels) && multirateLevels >= 1 && multirateLevels <= 16;
+    else if (key == "multirate.courant") ok = parseDouble(value, multirateCourant) && multirateCourant > 0.0;
+    else if (key == "quality.report") ok = parseBool(value, qualityReport);
+    else if (key == "quality.courant") ok = parseDouble(value, qualityCourant) && qualityCourant > 0.0;
+    else if (key == "quality.mass_scale_step") ok = parseDouble(value, qualityMassScaleStep) && qualityMassScaleStep >= 0.0;
+    else if (key == "mesh.generator") {
+        meshGenerator = value;
+        ok = (value == "tetgen" || value == "box");
+    }
+    else if (key == "mesh.path") meshPath = value;
+    else if (key == "mesh.box_cells") ok = parseTriple(value, boxCells, parseInt);
+    else if (key == "mesh.box_min") ok = parseTriple(value, boxMin, parseDouble);
+    else if (key == "mesh.box_max") ok = parseTriple(value, boxMax, parseDouble);
+    else if (key == "mesh.box_split") ok = parseInt(value, boxSplit) && (boxSplit == 5 || boxSplit == 6);
+    else if (key == "mesh.box_jitter") ok = parseDouble(value, boxJitter);
+    else if (key == "mesh.box_seed") ok = parseInt(value, boxSeed);
+    else if (key == "mesh.cache_dir") meshCacheDir = value;
+    else if (key == "scene.name") scene = value;
+    else if (key == "output.dir") outputDir = value;
+    else if (key == "output.every") ok = parseInt(value, outputEvery);
+    else if (key == "output.collider_dir") colliderDir = value;
+    else if (key == "output.format") {
+        outputFormat = value;
+        ok = (value == "bgeo" || value == "stream" || value == "surface");
+    }
+    else if (key == "output.attributes") outputAttributes = value;
+    else if (key == "output.bits") ok = parseInt(value, outputBits) && outputBits >= 4 && outputBits <= 16;
+    else if (key == "output.keyframe_every") ok = parseInt(value, keyframeEvery) && keyframeEvery >= 1;
+    else if (key == "output.async") ok = parseBool(value, outputAsync);
+    else if (key == "render.path") renderPath = value;
+    else if (key == "render.scale") ok = parseDouble(value, renderScale);
+    else if (key == "render.offset") ok = parseTriple(value, renderOffset, parseDouble);
+    else if (key == "sleep.enabled") ok = parseBool(value, sleep);
+    else if (key == "sleep.speed") ok = parseDouble(value, sleepSpeed);
+    else if (key == "sleep.strain") ok = parseDouble(value, sleepStrain);
+    else if (key == "sleep.check_every") ok = parseInt(value, sleepCheckEvery) && sleepCheckEvery >= 1;
+    else if (key == "sleep.checks") ok = parseInt(value, sleepChecks) && sleepChecks >= 1;
+    else if (key == "checkpoint.dir") checkpointDir = value;
+    else if (key == "checkpoint.every") ok = parseInt(value, checkpointEvery);
+    else if (key == "profile.enabled") ok = parseBool(value, profile);
+    else if (key == "profile.summary") profileSummary = value;
+    else if (key == "profile.trace") profileTrace = value;
+    else {
+        std::cout << "error: unknown config key " << key << std::endl;
+        return false;
+    }
+
+    if (!ok) {
+        std::cout << "error: bad value '" << value << "' for " << key << std::endl;
+    }
+    return ok;
+}
+
+bool SimConfig::finalize() {
+
+    // projective, xpbd and reduced steps are stable at large timesteps and cover an explicit frame in 6,
+    // multirate steps subdivide where the mesh needs it
+    const bool largeSteps = integrator == "projective" || integrator == "xpbd" || integrator == "modal"
+                            || integrator == "subspace" || integrator == "multirate";
+    if (timeStep <= 0.0) {
+        timeStep = useImplicit() ? 0.01 : largeSteps ? 1e-3 : 1e-5;
+    }
+    if (stepsPerFrame <= 0) {
+        stepsPerFrame = useImplicit() ? 10 : largeSteps ? 6 : 600;
+    }
+    if (outputEvery <= 0) {
+        outputEvery = 1;
+    }
+    for (int i = 0; i < 3; ++i) {
+        if (boxCells[i] < 1 || boxMax[i] <= boxMin[i]) {
+            std::cout << "error: mesh.box_cells must be positive and mesh.box_max above mesh.box_min" << std::endl;
+            return false;
+        }
+    }
+    if (boxJitter < 0.0 || boxJitter >= 0.5) {
+        std::cout << "error: mesh.box_jitter must be in [0, 0.5)" << std::endl;
+        return false;
+    }
+    if (nu <= 0.0 || nu >= 0.5) {
+        std::cout << "error: material.nu must be in (0, 0.5)" << std::endl;
+        return false;
+    }
+    // CG needs M / dt^2 - K positive definite, which the fixed corotated K does not guarantee under compression
+    if (useImplicit() && linearSolver == "multigrid" && materialModel != "corotated_linear") {
+        std::cout << "error: solver.linear_solver = multigrid needs material.model = corotated_linear" << std::endl;
+        return false;
+    }
+    // projective, xpbd and the reduced integrators have no Rayleigh term
+    if ((dampingMass != 0.0 || dampingStiffness != 0.0) && integrator != "explicit" && integrator != "multirate"
+        && !useImplicit()) {
+        std::cout << "error: damping.mass and damping.stiffness need solver.integrator = explicit, multirate or implicit" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool SimConfig::useImplicit() const {
+    return integrator == "implicit";
+}
+
+void SimConfig::print() const {
+    std::cout << "integrator " << integrator << ", dt " << timeStep << ", " << stepsPerFrame
+              << " steps/frame, " << frames << " frames" << std::endl;
+    if (meshGenerator == "box") {
+        std::cout << "mesh box " << boxCells[0] << "x" << boxCells[1] << "x" << boxCells[2]
+                  << " cells, " << boxSplit << " tets per cell";
+    }
+    else {
+        std::cout << "mesh " << meshPath;
+    }
+    std::cout << ", scene " << scene << ", k " << k << ", nu " << nu << std::endl;
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// Runtime configuration for a simulation run, read from an INI file:
+//
+//   [solver]     integrator = explicit | implicit | projective | xpbd | modal | subspace | multirate,
+//                timestep, steps_per_frame, frames, threads,
+//                scheduler = serial | tasks (force and integration chunks as a task graph), task_chunk,
+//                linear_solver = minres | gauss_seidel (implicit only, colored, fixed linear_iterations)
+//                | multigrid (CG to linear_tolerance, V-cycle over multigrid_levels embedding grids,
+//                corotated_linear only),
+//                projective_iterations (local/global iterations per projective step),
+//                xpbd_iterations (colored constraint sweeps per xpbd substep),
+//                rotation = svd | warm_start (polar iterations from each element's last rotation), rotation_iterations
+//   [material]   k, nu, model = fixed_corotated | corotated_linear (precomputed rest stiffness, rotated)
+//   [damping]    mass, stiffness (Rayleigh coefficients of the explicit, multirate and implicit integrators,
+//                force -mass M v - stiffness K v, rejected by the others)
+//   [modal]      modes (elastic modes of the rest shape), basis (modal basis file, recomputed when stale,
+//                empty computes it every run)
+//   [subspace]   size (basis vectors), cubature (at most this many tetrahedra), basis (file trained by FEMTrain)
+//   [multirate]  levels (power of two subdivisions of timestep, at most), courant (fraction of each
+//                tetrahedron's stable step it may take)
+//   [quality]    report (stable step and shape histograms at load time), courant, mass_scale_step
+//                (tetrahedra whose stable step is below it are made denser until it is not, 0 disables)
+//   [mesh]       generator = tetgen | box, path (tetgen basename without extension),
+//                box_cells (nx, ny, nz), box_min, box_max (x, y, z), box_split = 5 | 6 tets per cell,
+//                box_jitter (fraction of a cell), box_seed, cache_dir (precomputed mesh cache, empty disables)
+//   [scene]      name = default | plinko | bulldoze | constrained
+//   [output]     dir, every (write every Nth frame), collider_dir (parent of moving collider output),
+//                format = bgeo | stream (compressed dir/frames.femstream, see utility/FrameStream.h)
+//                | surface (boundary triangles with normals, dir/surfaceNNNN.ply),
+//                attributes (stream only: position, velocity, force, mass), bits (stream quantization, 4 to 16),
+//                keyframe_every (stream frames between keyframes), async (write frames on a background thread)
+//   [render]     path (.ply or .stl embedded in the mesh and written as dir/renderNNNN.ply next to the
+//                output format's files, empty disables),
+//                scale, offset (x, y, z) placing it in the simulation mesh
+//   [sleep]      enabled (explicit only), speed (mean speed threshold), strain (deformation gradient change
+//                between checks), check_every (substeps between checks), checks (calm checks before sleeping)
+//   [checkpoint] dir, every (0 disables)
+//   [profile]    enabled, summary (.csv or .json per-frame phase times), trace (Chrome trace-event file, empty disables)
+//
+// Keys may also be set individually as "section.key" (e.g. from --set on the command line).
+class SimConfig {
+
+public:
+    // solver
+    std::string integrator;
+    double timeStep;            // 0 picks the integrator default
+    int stepsPerFrame;          // 0 picks the integrator default
+    int frames;
+    int threads;                // 0 leaves the OpenMP default
+    std::string scheduler;
+    int taskChunk;              // tetrahedra or particles per task
+    std::string linearSolver;
+    int linearIterations;       // Gauss-Seidel sweeps per implicit step
+    double linearTolerance;     // relative CG residual for multigrid
+    int multigridLevels;        // levels including the mesh itself
+    int projectiveIterations;   // local/global iterations per projective step
+    int xpbdIterations;         // constraint sweeps per xpbd substep
+    std::string rotation;
+    int rotationIterations;     // polar iterations before falling back to the SVD
+
+    // material, values are for rubber
+    double k;
+    double nu;
+    std::string materialModel;
+
+    double dampingMass;         // 1/s
+    double dampingStiffness;    // s
+
+    int modalModes;
+    std::string modalBasis;
+
+    int subspaceSize;
+    int subspaceCubature;
+    std::string subspaceBasis;
+
+    int multirateLevels;
+    double multirateCourant;
+
+    bool qualityReport;
+    double qualityCourant;
+    double qualityMassScaleStep;
+
+    std::string meshGenerator;
+    std::string meshPath;
+    int boxCells[3];
+    double boxMin[3];
+    double boxMax[3];
+    int boxSplit;
+    double boxJitter;
+    int boxSeed;
+    std::string meshCacheDir;
+    std::string scene;
+
+    std::string outputDir;
+    int outputEvery;
+    std::string colliderDir;
+    std::string outputFormat;
+    std::string outputAttributes;
+    int outputBits;
+    int keyframeEvery;
+    bool outputAsync;
+
+    std::string renderPath;
+    double renderScale;
+    double renderOffset[3];
+
+    bool sleep;
+    double sleepSpeed;
+    double sleepStrain;
+    int sleepCheckEvery;
+    int sleepChecks;
+
+    std::string checkpointDir;
+    int checkpointEvery;
+
+    bool profile;
+    std::string profileSummary;
+    std::string profileTrace;
+
+    SimConfig();
+
+    bool load(const std::string &path);
+    bool save(const std::string &path) const;
+    bool set(const std::string &key, const std::string &value);
+
+    // fills in integrator dependent defaults and validates values
+    bool finalize();
+
+    bool useImplicit() const;
+    void print() const;
+
+    // reads an INI file into ordered ("section.key", value) pairs
+    static bool readIni(const std::string &path, std::vector<std::pair<std::string, std::string>> &entries);
+};
@@ -0,0 +1,158 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <cstdlib>
+#include "SweepSpec.h"
+
+namespace {
+
+std::vector<std::string> splitList(const std::string &list) {
+    std::vector<std::string> values;
+    size_t begin = 0;
+    while (begin <= list.size()) {
+        size_t end = list.find(',', begin);
+        if (end == std::string::npos) {
+            end = list.size();
+        }
+        std::string value = list.substr(begin, end - begin);
+        size_t first = value.find_first_not_of(" \t");
+        size_t last = value.find_last_not_of(" \t");
+        if (first != std::string::npos) {
+            values.push_back(value.substr(first, last - first + 1));
+        }
+        begin = end + 1;
+    }
+    return values;
+}
+
+}
+
+SweepSpec::SweepSpec() : base(), axes(), jobs(1), directory("sweep") {}
+
+bool SweepSpec::load(const std::string &path) {
+
+    std::vector<std::pair<std::string, std::string>> entries;
+    if (!SimConfig::readIni(path, entries)) {
+        return false;
+    }
+
+    for (unsigned int i = 0; i < entries.size(); ++i)
+    {
+        const std::string &key = entries[i].first;
+        const std::string &value = entries[i].second;
+
+        if (key.compare(0, 6, "sweep.") == 0) {
+            std::string swept = key.substr(6);
+            if (swept.compare(0, 5, "mesh.") == 0 || swept.compare(0, 7, "output.") == 0 || swept.compare(0, 11, "checkpoint.") == 0
+                || swept.compare(0, 8, "profile.") == 0) {
+                std::cout << path << ": " << swept << " cannot be swept" << std::endl;
+                return false;
+            }
+            std::vector<std::string> values = splitList(value);
+            SimConfig scratch;
+            for (unsigned int j = 0; j < values.size(); ++j) {
+                if (!scratch.set(swept, values[j])) {
+                    return false;
+                }
+            }
+            if (values.empty()) {
+                std::cout << path << ": no values for " << swept << std::endl;
+                return false;
+            }
+            axes.push_back(std::make_pair(swept, values));
+        }
+        else if (key == "batch.jobs") {
+            jobs = std::max(1, std::atoi(value.c_str()));
+        }
+        else if (key == "batch.dir") {
+            directory = value;
+        }
+        else if (!base.set(key, value)) {
+            std::cout << path << ": rejected " << key << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int SweepSpec::numRuns() const {
+    int runs = 1;
+    for (unsigned int i = 0; i < axes.size(); ++i) {
+        runs *= axes[i].second.size();
+    }
+    return runs;
+}
+
+std::vector<int> SweepSpec::axisIndices(int run) const {
+    std::vector<int> indices(axes.size(), 0);
+    for (int i = int(axes.size()) - 1; i >= 0; --i) {
+        int count = axes[i].second.size();
+        indices[i] = run % count;
+        run /= count;
+    }
+    return indices;
+}
+
+std::string SweepSpec::runName(int run) const {
+    std::string r = std::to_string(run);
+    return "run_" + std::string(r.length() < 3 ? 3 - r.length() : 0, '0') + r;
+}
+
+std::string SweepSpec::runDirectory(int run) const {
+    return directory + "/" + runName(run);
+}
+
+bool SweepSpec::runConfig(int run, SimConfig &config) const {
+
+    config = base;
+    std::vector<int> indices = axisIndices(run);
+    for (unsigned int i = 0; i < axes.size(); ++i) {
+        if (!config.set(axes[i].first, axes[i].second[indices[i]])) {
+            return false;
+        }
+    }
+
+    const std::string runDir = runDirectory(run);
+    config.outputDir = runDir + "/output";
+    config.checkpointDir = runDir + "/checkpoints";
+    config.colliderDir = runDir;
+    config.profileSummary = runDir + "/" + config.profileSummary.substr(config.profileSummary.find_last_of('/') + 1);
+    if (!config.profileTrace.empty()) {
+        config.profileTrace = runDir + "/" + config.profileTrace.substr(config.profileTrace.find_last_of('/') + 1);
+    }
+    // runs may sweep the mesh or material and would compute different bases for the same file
+    if (!config.modalBasis.empty()) {
+        config.modalBasis = runDir + "/" + config.modalBasis.substr(config.modalBasis.find_last_of('/') + 1);
+    }
+    // integrator dependent defaults are resolved per run
+    return config.finalize();
+}
+
+bool SweepSpec::writeIndex() const {
+
+    std::ofstream outFile(directory + "/runs.csv");
+
+    if (!outFile)
+    {
+        std::cout << "\nError writing " << directory << "/runs.csv.\n";
+        return false;
+    }
+
+    outFile << "run";
+    for (unsigned int i = 0; i < axes.size(); ++i) {
+        outFile << "," << axes[i].first;
+    }
+    outFile << "\n";
+
+    for (int run = 0; run < numRuns(); ++run) {
+        std::vector<int> indices = axisIndices(run);
+        outFile << runName(run);
+        for (unsigned int i = 0; i < axes.size(); ++i) {
+            outFile << "," << axes[i].second[indices[i]];
+        }
+        outFile << "\n";
+    }
+
+    return true;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "SimConfig.h"
+
+// Parameter sweep over a base SimConfig. A sweep file is a regular config plus
+//
+//   [sweep]   section.key = value, value, ...   (one axis per key, runs are the cartesian product)
+//   [batch]   jobs (runs in flight at once, 1 runs them back to back), dir (parent of the run directories)
+//
+// The mesh is shared by every run, so mesh keys cannot be swept.
+class SweepSpec {
+
+public:
+    SimConfig base;
+    std::vector<std::pair<std::string, std::vector<std::string>>> axes;
+    int jobs;
+    std::string directory;
+
+    SweepSpec();
+
+    bool load(const std::string &path);
+
+    int numRuns() const;
+    std::string runName(int run) const;
+    std::string runDirectory(int run) const;
+
+    // base config with the values of this run applied and outputs redirected to its directory
+    bool runConfig(int run, SimConfig &config) const;
+
+    // writes directory/runs.csv mapping run names to swept values
+    bool writeIndex() const;
+
+private:
+    // value index on each axis for a run, first axis varies slowest
+    std::vector<int> axisIndices(int run) const;
+};
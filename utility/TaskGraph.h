@@ -0,0 +1,97 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Static dependency graph executed with OpenMP tasks. Every node runs once per
+// execute(), as soon as the last of its predecessors has finished, so there is
+// no barrier between stages: a consumer starts while producers it does not
+// read from are still running. Ready nodes are queued as OpenMP tasks and idle
+// threads take them from the runtime's task queues (LLVM's runtime steals from
+// per-thread deques, GCC's shares one queue). Without OpenMP the graph runs
+// depth first on the calling thread.
+class TaskGraph {
+public:
+    TaskGraph() : mNumNodes(0) {}
+
+    void clear() {
+        mNumNodes = 0;
+        mEdges.clear();
+        mStart.clear();
+        mSuccessors.clear();
+        mInDegree.clear();
+        mPending.reset();
+    }
+
+    int addNode() { return mNumNodes++; }
+    void addEdge(int from, int to) { mEdges.push_back(std::make_pair(from, to)); }
+
+    // sorts and deduplicates the edges, call after the last addEdge
+    void finalize() {
+        std::sort(mEdges.begin(), mEdges.end());
+        mEdges.erase(std::unique(mEdges.begin(), mEdges.end()), mEdges.end());
+        mStart.assign(mNumNodes + 1, 0);
+        mInDegree.assign(mNumNodes, 0);
+        mSuccessors.resize(mEdges.size());
+        for(const std::pair<int,int>& edge : mEdges){
+            ++mStart[edge.first + 1];
+            ++mInDegree[edge.second];
+        }
+        for(int i = 0; i < mNumNodes; ++i){
+            mStart[i + 1] += mStart[i];
+        }
+        for(unsigned int e = 0; e < mEdges.size(); ++e){
+            mSuccessors[e] = mEdges[e].second;
+        }
+        mEdges.clear();
+        mPending.reset(new std::atomic<int>[mNumNodes]);
+    }
+
+    int numNodes() const { return mNumNodes; }
+    int numEdges() const { return mSuccessors.size(); }
+
+    // calls work(node) for every node in dependency order, returns when all have run
+    template<class Work>
+    void execute(const Work& work) {
+        for(int i = 0; i < mNumNodes; ++i){
+            mPending[i].store(mInDegree[i], std::memory_order_relaxed);
+        }
+        const Work* w = &work;
+        #pragma omp parallel
+        {
+            #pragma omp single
+            {
+                for(int i = 0; i < mNumNodes; ++i){
+                    if(mInDegree[i] == 0){
+                        spawn(i, w);
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    template<class Work>
+    void spawn(int node, const Work* work) {
+        #pragma omp task firstprivate(node, work)
+        {
+            (*work)(node);
+            for(int e = mStart[node]; e < mStart[node + 1]; ++e){
+                // the last finishing predecessor releases the successor
+                if(mPending[mSuccessors[e]].fetch_sub(1, std::memory_order_acq_rel) == 1){
+                    spawn(mSuccessors[e], work);
+                }
+            }
+        }
+    }
+
+    int mNumNodes;
+    std::vector<std::pair<int,int>> mEdges;         // until finalize
+    std::vector<int> mStart;                        // successors of each node
+    std::vector<int> mSuccessors;
+    std::vector<int> mInDegree;
+    std::unique_ptr<std::atomic<int>[]> mPending;   // unfinished predecessors during execute
+};